@@ -79,6 +79,7 @@ namespace Editor
                 ImGui::Separator();
                 EditorCommands::SaveMap.Menu();
                 EditorCommands::SaveMapAs.Menu();
+                EditorCommands::CompactMap.Menu();
 
                 ImGui::Separator();
                 EditorCommands::Quit.Menu();
@@ -115,6 +116,28 @@ namespace Editor
         }
     }
 
+    // a small window with the progress of the map being opened, and a way out of it
+    void ShowLoadProgress()
+    {
+        const LoadTask* task = ActiveEditor.GetLoadingTask();
+        if (!task)
+            return;
+
+        ImGuiViewport* viewport = ImGui::GetMainViewport();
+        ImGui::SetNextWindowPos(viewport->GetCenter(), ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+        ImGui::SetNextWindowSize(ImVec2(400, 0));
+
+        if (ImGui::Begin("Loading", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoSavedSettings))
+        {
+            ImGui::TextUnformatted(task->GetName().c_str());
+            ImGui::ProgressBar(task->GetProgress());
+
+            if (ImGui::Button("Cancel"))
+                ActiveEditor.CancelLoad();
+        }
+        ImGui::End();
+    }
+
     void ShowUI()
     {
         MainMenu();
@@ -124,6 +147,8 @@ namespace Editor
         for (auto* panel : Panels)
             panel->Show();
 
+        ShowLoadProgress();
+
         ImGui::UpdateDialogs();
     }
 
@@ -6,8 +6,8 @@
 #include "tinyfiledialogs.h"
 #include "utils/imgui_dialogs.h"
 
-constexpr int MapFilterPatternSize = 1;
-constexpr  char* MapFilterPatterns[MapFilterPatternSize] = { "*.mres" };
+constexpr int MapFilterPatternSize = 2;
+constexpr  char* MapFilterPatterns[MapFilterPatternSize] = { "*.mres", "*.mimg" };
 
 namespace EditorCommands
 {
@@ -22,6 +22,7 @@ namespace EditorCommands
     OpenMapCommand OpenMap;
     SaveMapCommand SaveMap;
     SaveMapAsCommand SaveMapAs;
+    CompactMapCommand CompactMap;
 	UndoCommand Undo;
 	RedoCommand Redo;
     ResizeCommand Resize;
@@ -128,6 +129,23 @@ void SaveMapAsCommand::Process()
     Editor::GetActiveEditor().Save();
 }
 
+CompactMapCommand::CompactMapCommand()
+{
+    Name = "Compact";
+    Icon = ICON_FA_COMPRESS;
+}
+
+// saves go to the journal, this writes the whole map so the journal starts over
+void CompactMapCommand::Process()
+{
+    Editor::GetActiveEditor().Compact();
+}
+
+bool CompactMapCommand::IsEnabled() const
+{
+    return !Editor::GetActiveEditor().MapFilepath.empty();
+}
+
 UndoCommand::UndoCommand()
 {
 	Name = "Undo";
@@ -193,9 +211,9 @@ void ResizeCommand::Process()
         delete(size);
 	};
 
-    auto& state = Editor::GetActiveEditor().GetCurrentState();
+    const Map& map = Editor::GetActiveEditor().GetWorkingMap();
 
-    Vector2i* size = new Vector2i(state.GetWidth(), state.GetHeight());
+    Vector2i* size = new Vector2i(map.GetWidth(), map.GetHeight());
 
     ImGui::CallbackDialog* dialog = ImGui::CallbackDialog::Show("New Size", ICON_FA_BOX, onShow, onResult, size);
 }
@@ -211,8 +229,8 @@ void BorderCommand::Process()
 {
     auto& editor = Editor::GetActiveEditor();
 
-    int width = editor.GetCurrentState().GetWidth();
-    int height = editor.GetCurrentState().GetHeight();
+    int width = editor.GetWorkingMap().GetWidth();
+    int height = editor.GetWorkingMap().GetHeight();
 
     uint8_t tile = editor.GetCurrentMaterial();
 
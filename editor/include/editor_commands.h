@@ -44,6 +44,14 @@ public:
     void Process() override;
 };
 
+class CompactMapCommand : public EditorCommand
+{
+public:
+    CompactMapCommand();
+    void Process() override;
+    bool IsEnabled() const override;
+};
+
 class UndoCommand : public EditorCommand
 {
 public:
@@ -81,6 +89,7 @@ namespace EditorCommands
     extern OpenMapCommand OpenMap;
     extern SaveMapCommand SaveMap;
     extern SaveMapAsCommand SaveMapAs;
+    extern CompactMapCommand CompactMap;
 
     extern UndoCommand Undo;
     extern RedoCommand Redo;
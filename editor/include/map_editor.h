@@ -1,37 +1,43 @@
 #pragma once
 
+#include "async_loader.h"
 #include "map.h"
 #include "map_serializer.h"
 #include "tool_system.h"
 #include "entity_location.h"
 
+#include <deque>
+#include <memory>
 #include <string>
 #include <string_view>
 
+// one cell changed by a step in the edit history, with what it was before and after
+struct CellChange
+{
+    uint32_t Index = 0;
+    MapCell Before;
+    MapCell After;
+};
+
+// one step in the edit history, kept as the changes it made and not as a copy of the map
+// the first step is the base the others are applied on, it has no changes of its own
 class HistoryState
 {
 public:
     std::string EventName;
 
-    Map Cells;
-
     int ToolId = -1;
 
-    inline int GetWidth() const { return Cells.GetWidth(); }
-    inline int GetHeight() const { return Cells.GetHeight(); }
-
-	inline void SetCellState(const int x, const int y, CellState state, int tile = 1)
-	{
-        Cells.SetCellState(x, y, state);
-		switch (state)
-		{
-			case CellState::Door:
-                Cells.SetCellTile(x, y, tile);
-				break;
-			default:
-				break;
-		}
-	}
+    // in the order they were made, a cell can be in here more than once
+    std::vector<CellChange> Changes;
+
+    // a resize keeps every cell from before it packed, since all of them can move
+    bool IsResize = false;
+    Vector2i SizeBefore;
+    Vector2i SizeAfter;
+    std::vector<uint8_t> PackedBefore;
+
+    size_t GetMemoryUse() const;
 };
 
 class MapEditor
@@ -42,18 +48,36 @@ public:
     void Update();
 
     void Clear();
+    // the map is read on a loader thread, the current one stays up and editable until it is ready
     void Load(std::string_view filepath);
+    void CancelLoad();
+
+    // only the cells changed since the last save are written, to the map's journal, when the file on disk is the base they go on
+    // anything the journal can't follow, like a resize or a new file, writes the whole map
     void Save();
 
+    // writes the whole map, which folds the journal into a new base
+    void Compact();
+
+    inline bool IsLoading() const { return LoadingTask != nullptr; }
+    inline const LoadTask* GetLoadingTask() const { return LoadingTask.get(); }
+
     inline bool IsDirty() const { return DirtyFlag; }
 
-    void Undo();
-    void Redo();
+    // false when there is no step to move to, or the step could not be applied
+    bool Undo();
+    bool Redo();
     bool CanUndo() const;
     bool CanRedo() const;
 
+    // jumps to any step, undoing or redoing every step between here and there
     void SetHistoryIndex(int index);
 
+    // once the history uses more than this the oldest steps are folded into the base and can't be undone any more
+    void SetHistoryMemoryLimit(size_t bytes);
+    inline size_t GetHistoryMemoryLimit() const { return HistoryMemoryLimit; }
+    inline size_t GetHistoryMemoryUse() const { return HistoryMemory; }
+
     void Resize(int newX, int newY);
 
     void SetCell(int x, int y, CellState cellState, uint8_t cellTile, int toolId = -1);
@@ -69,9 +93,7 @@ public:
     std::string MapFilepath;
     bool Loaded = false;
   
-    HistoryState& GetCurrentState();
-
-    const std::vector<HistoryState>& GetEditHistory() const { return EditHistory; }
+    const std::deque<HistoryState>& GetEditHistory() const { return EditHistory; }
     const size_t GetCurrentEditHistoryIndex() const { return EditHistoryIndex; }
 
     inline const int GetCurrentMaterial() const { return CurrentMaterial; }
@@ -79,25 +101,46 @@ public:
 
     inline ToolSystem& GetTools() { return ToolManager; }
 
-    inline Map& GetWorkingMap() 
-    { 
-        return EditHistory[EditHistoryIndex].Cells;
-    }
+    inline Map& GetWorkingMap() { return WorkingMap; }
 
     inline EntityLocation& GetViewLocation() { return ViewLocaion; }
 
 protected:
-    void SaveState(std::string_view eventName, int toolId = -1);
+    // the step new changes go in, a new one unless the last step was made by the same tool
+    HistoryState& SaveState(std::string_view eventName, int toolId = -1);
+    void StartHistory(std::string_view eventName);
+    void FoldHistory();
+
+    bool UndoStep(const HistoryState& state);
+    bool RedoStep(const HistoryState& state);
+    void ResizeMap(int newX, int newY);
+
+    void AddJournalCell(int index);
+    void ResetJournal(bool usable);
 
     inline void SetDirty() { DirtyFlag = true; }
 
     bool DirtyFlag = false;
+
+    // the map as of the current step, undo and redo apply the steps' changes to it
+    Map WorkingMap;
+
     size_t EditHistoryIndex = 0;
-    std::vector<HistoryState> EditHistory;
+    std::deque<HistoryState> EditHistory;
+    size_t HistoryMemory = 0;
+    size_t HistoryMemoryLimit = size_t(64) * 1024 * 1024;
 
     int CurrentMaterial = 1;
 
     ToolSystem ToolManager;
 
     EntityLocation ViewLocaion;
+
+    AsyncLoader Loader;
+    std::shared_ptr<LoadTask> LoadingTask;
+
+    // cells changed since the last save, and the file and stamp of the base they go on, the path is empty when there is none
+    std::vector<JournalCell> PendingJournal;
+    std::string JournalBase;
+    uint32_t JournalStamp = 0;
 };
\ No newline at end of file
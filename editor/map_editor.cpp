@@ -1,4 +1,14 @@
 #include "map_editor.h"
+#include "map_codec.h"
+#include "raylib.h"
+
+// what painting a cell does, a door keeps the tile it is given, anything else only changes the state
+static void PaintCell(Map& map, int x, int y, CellState state, uint8_t tile)
+{
+	map.SetCellState(x, y, state);
+	if (state == CellState::Door)
+		map.SetCellTile(x, y, tile);
+}
 
 MapEditor::MapEditor()
 {
@@ -7,6 +17,16 @@ MapEditor::MapEditor()
 
 void MapEditor::Update()
 {
+	Loader.Update();
+	if (LoadingTask && LoadingTask->IsDone())
+	{
+		// the map and its file are left as they were, so a save can't write an empty map over the damaged file
+		if (!LoadingTask->Succeeded() && !LoadingTask->IsCancelled())
+			TraceLog(LOG_WARNING, "EDITOR: Could not load map %s", LoadingTask->GetName().c_str());
+
+		LoadingTask.reset();
+	}
+
 	ToolManager.Update();
 }
 
@@ -15,99 +35,338 @@ void MapEditor::Clear()
 	ViewLocaion.Position = Vector2{ 5, 5 };
 	ViewLocaion.Facing.x = 1;
 
-	EditHistoryIndex = 0;
-	EditHistory.clear();
-	EditHistory.emplace_back(HistoryState{ "New Map" });
-
-	auto& state = EditHistory.back();
+	WorkingMap = Map();
+	StartHistory("New Map");
+	ResetJournal(false);
 
     uint8_t tile = GetCurrentMaterial();
 
-    for (int i = 0; i < state.GetWidth(); i++)
+    for (int i = 0; i < WorkingMap.GetWidth(); i++)
     {
-        state.SetCellState(i, 0, CellState::Solid, tile);
-        state.SetCellState(i, state.GetHeight() - 1, CellState::Solid, tile);
+        PaintCell(WorkingMap, i, 0, CellState::Solid, tile);
+        PaintCell(WorkingMap, i, WorkingMap.GetHeight() - 1, CellState::Solid, tile);
     }
 
-    for (int i = 0; i < state.GetHeight(); i++)
+    for (int i = 0; i < WorkingMap.GetHeight(); i++)
     {
-        state.SetCellState(0, i, CellState::Solid, tile);
-        state.SetCellState(state.GetWidth()-1, i, CellState::Solid, tile);
+        PaintCell(WorkingMap, 0, i, CellState::Solid, tile);
+        PaintCell(WorkingMap, WorkingMap.GetWidth()-1, i, CellState::Solid, tile);
     }
 }
 
 void MapEditor::Load(std::string_view filepath)
 {
-	MapFilepath = filepath;
+	CancelLoad();
 
-	EditHistoryIndex = 0;
-	EditHistory.clear();
-	EditHistory.emplace_back(HistoryState{ "Load Map" });
+	std::string path(filepath);
+	auto onLoaded = [this, path](Map& map)
+	{
+		MapFilepath = path;
 
-	MapSerializer serializer;
-	EditHistory.back().Cells = serializer.ReadResource(filepath);
+		WorkingMap = std::move(map);
+		StartHistory("Load Map");
 
-	DirtyFlag = false;
+		DirtyFlag = false;
+		ResetJournal(true);
+	};
+
+	LoadingTask = Loader.QueueMap(filepath, MapStorage::Dense, onLoaded);
+}
+
+// the map that was being read is dropped when it comes back
+void MapEditor::CancelLoad()
+{
+	if (LoadingTask)
+		LoadingTask->Cancel();
+
+	LoadingTask.reset();
 }
 
 void MapEditor::Save()
 {
+	if (!JournalBase.empty() && JournalBase == MapFilepath)
+	{
+		MapSerializer serializer;
+		if (PendingJournal.empty() || serializer.WriteJournal(MapFilepath, JournalStamp, PendingJournal))
+		{
+			PendingJournal.clear();
+			DirtyFlag = false;
+			return;
+		}
+	}
+
+	Compact();
+}
+
+void MapEditor::Compact()
+{
+	// a loaded image may be the file being replaced, so nothing can still be reading it through a mapping
+	if (WorkingMap.IsMapped())
+		WorkingMap = Map(WorkingMap);
+
+	bool image = MapFilepath.size() > 5 && MapFilepath.compare(MapFilepath.size() - 5, 5, ".mimg") == 0;
+
 	MapSerializer serializer;
-	serializer.WriteResource(GetWorkingMap(), MapFilepath);
+	if (image)
+		serializer.WriteImage(GetWorkingMap(), MapFilepath);
+	else
+		serializer.WriteResource(GetWorkingMap(), MapFilepath);
 
 	DirtyFlag = false;
+	ResetJournal(!image);
 }
 
-HistoryState& MapEditor::GetCurrentState()
+// the stamp is read back from the file, so a base that failed to write is never journaled on
+void MapEditor::ResetJournal(bool usable)
 {
-	return EditHistory[EditHistoryIndex];
+	PendingJournal.clear();
+	JournalBase.clear();
+
+	MapSerializer serializer;
+	if (usable && serializer.ReadStamp(MapFilepath, JournalStamp))
+		JournalBase = MapFilepath;
 }
 
-void MapEditor::SetCell(int x, int y, CellState cellState, uint8_t cellTile, int toolId)
+void MapEditor::AddJournalCell(int index)
 {
-	if (x < 0 || x >= GetCurrentState().Cells.GetWidth() || y < 0 || y > GetCurrentState().Cells.GetHeight())
+	if (JournalBase.empty())
 		return;
 
-	SaveState("Set Cell", toolId);
-	GetCurrentState().SetCellState(x, y, cellState, cellTile);
+	const Map& map = GetWorkingMap();
+
+	int x = 0;
+	int y = 0;
+	map.GetCellXY(size_t(index), x, y);
+	PendingJournal.push_back(JournalCell{ uint32_t(index), map.GetCell(x, y) });
 }
 
-void MapEditor::Resize(int newX, int newY)
+size_t HistoryState::GetMemoryUse() const
+{
+	return sizeof(HistoryState) + EventName.capacity() + Changes.capacity() * sizeof(CellChange) + PackedBefore.capacity();
+}
+
+void MapEditor::StartHistory(std::string_view eventName)
+{
+	EditHistoryIndex = 0;
+	EditHistory.clear();
+	EditHistory.emplace_back();
+	EditHistory.back().EventName = eventName;
+	HistoryMemory = EditHistory.back().GetMemoryUse();
+}
+
+HistoryState& MapEditor::SaveState(std::string_view eventName, int toolId)
+{
+	DirtyFlag = true;
+
+	// can we merge this edit with the last one?
+	HistoryState& currentState = EditHistory[EditHistoryIndex];
+	if (EditHistoryIndex > 0 && EditHistoryIndex + 1 == EditHistory.size() && toolId != -1 && currentState.ToolId == toolId)
+		return currentState;
+
+	// trim off everything after now
+	while (EditHistory.size() > EditHistoryIndex + 1)
+	{
+		HistoryMemory -= EditHistory.back().GetMemoryUse();
+		EditHistory.pop_back();
+	}
+
+	// add the new state to the end
+	EditHistory.emplace_back();
+	EditHistory.back().EventName = eventName;
+	EditHistory.back().ToolId = toolId;
+	EditHistoryIndex++;
+
+	HistoryMemory += EditHistory.back().GetMemoryUse();
+	return EditHistory.back();
+}
+
+// the oldest step after the base becomes part of it, the base is the map as it is with every later step undone
+// steps that would be redone from here are never folded
+void MapEditor::FoldHistory()
 {
-	SaveState("Resize");
-	auto& state = GetCurrentState();
-	state.Cells.Resize(newX,newY);
+	while (HistoryMemory > HistoryMemoryLimit && EditHistoryIndex > 1)
+	{
+		HistoryMemory -= EditHistory[1].GetMemoryUse();
+		EditHistory.erase(EditHistory.begin() + 1);
+		EditHistoryIndex--;
+	}
+}
 
-	const HistoryState& oldState = EditHistory[EditHistoryIndex - 1];
+void MapEditor::SetHistoryMemoryLimit(size_t bytes)
+{
+	HistoryMemoryLimit = bytes;
+	FoldHistory();
+}
+
+void MapEditor::SetCell(int x, int y, CellState cellState, uint8_t cellTile, int toolId)
+{
+	if (x < 0 || x >= WorkingMap.GetWidth() || y < 0 || y >= WorkingMap.GetHeight())
+		return;
+
+	MapCell before = WorkingMap.GetCell(x, y);
+	PaintCell(WorkingMap, x, y, cellState, cellTile);
+
+	MapCell after = WorkingMap.GetCell(x, y);
+	if (after == before)
+		return;
+
+	HistoryState& state = SaveState("Set Cell", toolId);
+
+	size_t memory = state.GetMemoryUse();
+	state.Changes.push_back(CellChange{ uint32_t(WorkingMap.GetCellIndex(x, y)), before, after });
+	HistoryMemory += state.GetMemoryUse() - memory;
+
+	AddJournalCell(WorkingMap.GetCellIndex(x, y));
+	FoldHistory();
+}
+
+// cells inside both sizes stay where they are, the rest of the new map is empty
+void MapEditor::ResizeMap(int newX, int newY)
+{
+	Map resized;
+	resized.SetStorage(WorkingMap.GetStorage());
+	resized.ResizeRaw(newX, newY);
 
 	for (int y = 0; y < newY; y++)
 	{
 		for (int x = 0; x < newX; x++)
 		{
-			uint8_t newCell = 0;
+			bool inside = x < WorkingMap.GetWidth() && y < WorkingMap.GetHeight();
+			resized.SetCellRaw(x, y, inside ? WorkingMap.GetCell(x, y) : MapCell());
+		}
+	}
+
+	resized.UpdateOccupancy();
+	WorkingMap = std::move(resized);
+}
+
+void MapEditor::Resize(int newX, int newY)
+{
+	if (newX <= 0 || newY <= 0)
+		return;
+
+	HistoryState& state = SaveState("Resize");
+	size_t memory = state.GetMemoryUse();
+
+	state.IsResize = true;
+	state.SizeBefore = Vector2i(WorkingMap.GetWidth(), WorkingMap.GetHeight());
+	state.SizeAfter = Vector2i(newX, newY);
+
+	// the states, then the tiles, then the flags
+	size_t count = size_t(WorkingMap.GetWidth()) * WorkingMap.GetHeight();
+	std::vector<uint8_t> planes(count * 3);
+	for (size_t i = 0; i < count; i++)
+	{
+		int x = 0;
+		int y = 0;
+		WorkingMap.GetCellXY(i, x, y);
+
+		MapCell cell = WorkingMap.GetCell(x, y);
+		planes[i] = uint8_t(cell.State);
+		planes[count + i] = cell.Tile;
+		planes[count * 2 + i] = cell.Flags;
+	}
+
+	MapCodec::Compress(planes.data(), planes.size(), state.PackedBefore);
+	state.PackedBefore.shrink_to_fit();
+	HistoryMemory += state.GetMemoryUse() - memory;
+
+	ResizeMap(newX, newY);
+	ResetJournal(false);
+	FoldHistory();
+}
+
+// false when the step could not be undone, the map is left as it was
+bool MapEditor::UndoStep(const HistoryState& state)
+{
+	if (state.IsResize)
+	{
+		size_t count = size_t(state.SizeBefore.x) * state.SizeBefore.y;
+		std::vector<uint8_t> planes(count * 3);
+		if (!MapCodec::Decompress(state.PackedBefore.data(), state.PackedBefore.size(), planes.data(), planes.size()))
+		{
+			TraceLog(LOG_WARNING, "EDITOR: Could not restore the map from before \"%s\", the step was not undone", state.EventName.c_str());
+			return false;
+		}
 
-			if (x < oldState.GetWidth() && y < oldState.GetHeight())
-				newCell = oldState.Cells.GetCellTile(x, y);
-			GetCurrentState().SetCellState(x,y, newCell == 0 ? CellState::Empty : CellState::Solid, newCell);
+		WorkingMap.ResizeRaw(state.SizeBefore.x, state.SizeBefore.y);
+		for (size_t i = 0; i < count; i++)
+		{
+			MapCell cell;
+			cell.State = CellState(planes[i]);
+			cell.Tile = planes[count + i];
+			cell.Flags = planes[count * 2 + i];
+
+			int x = 0;
+			int y = 0;
+			WorkingMap.GetCellXY(i, x, y);
+			WorkingMap.SetCellRaw(x, y, cell);
 		}
+
+		WorkingMap.UpdateOccupancy();
+		ResetJournal(false);
+		return true;
 	}
+
+	// backwards, so a cell changed more than once ends up as it was before the first change
+	for (auto change = state.Changes.rbegin(); change != state.Changes.rend(); ++change)
+	{
+		int x = 0;
+		int y = 0;
+		WorkingMap.GetCellXY(change->Index, x, y);
+		WorkingMap.SetCell(x, y, change->Before);
+		AddJournalCell(int(change->Index));
+	}
+
+	return true;
 }
 
-void MapEditor::Undo()
+bool MapEditor::RedoStep(const HistoryState& state)
+{
+	if (state.IsResize)
+	{
+		ResizeMap(state.SizeAfter.x, state.SizeAfter.y);
+		ResetJournal(false);
+		return true;
+	}
+
+	for (const auto& change : state.Changes)
+	{
+		int x = 0;
+		int y = 0;
+		WorkingMap.GetCellXY(change.Index, x, y);
+		WorkingMap.SetCell(x, y, change.After);
+		AddJournalCell(int(change.Index));
+	}
+
+	return true;
+}
+
+// the index only moves when the step was applied, so it always matches the map
+bool MapEditor::Undo()
 {
 	if (EditHistory.empty() || EditHistoryIndex == 0)
-		return;
+		return false;
+
+	if (!UndoStep(EditHistory[EditHistoryIndex]))
+		return false;
 
 	SetDirty();
 	EditHistoryIndex--;
+	return true;
 }
 
-void MapEditor::Redo()
+bool MapEditor::Redo()
 {
 	if (EditHistory.empty() || EditHistoryIndex >= EditHistory.size()-1)
-		return;
+		return false;
+
+	if (!RedoStep(EditHistory[EditHistoryIndex + 1]))
+		return false;
+
 	SetDirty();
 	EditHistoryIndex++;
+	return true;
 }
 
 void MapEditor::SetHistoryIndex(int index)
@@ -116,7 +375,18 @@ void MapEditor::SetHistoryIndex(int index)
 		return;
 
 	SetDirty();
-	EditHistoryIndex = size_t(index);
+	// stops at a step that could not be applied, rather than going past it
+	while (EditHistoryIndex > size_t(index))
+	{
+		if (!Undo())
+			break;
+	}
+
+	while (EditHistoryIndex < size_t(index))
+	{
+		if (!Redo())
+			break;
+	}
 }
 
 bool MapEditor::CanUndo() const
@@ -126,29 +396,5 @@ bool MapEditor::CanUndo() const
 
 bool MapEditor::CanRedo() const
 {
-	return EditHistory.size() > EditHistoryIndex;
-}
-
-void MapEditor::SaveState(std::string_view eventName, int toolId)
-{
-	DirtyFlag = true;
-
-	HistoryState& currentState = GetCurrentState();
-
-	// can we merge this edit with the last one?
-	if (toolId != -1 && currentState.ToolId != -1 && currentState.ToolId == toolId)
-		return;
-
-	// copy our current state
-	HistoryState state = currentState;
-	state.EventName = eventName;
-	state.ToolId = toolId;
-
-	// trim off everything after now
-	if (EditHistory.size() > EditHistoryIndex+1)
-		EditHistory.resize(EditHistoryIndex+1);
-
-	// add the new state to the end
-	EditHistory.emplace_back(std::move(state));
-	EditHistoryIndex++;
+	return EditHistoryIndex + 1 < EditHistory.size();
 }
@@ -12,28 +12,39 @@ EditHistoryPanel::EditHistoryPanel()
 	Size = ImVec2(200, 200);
 }
 
+// only the rows in view are drawn, so a long history costs the same as a short one
 void EditHistoryPanel::OnShow()
 {
 	auto& activeEditor = Editor::GetActiveEditor();
+	const auto& history = activeEditor.GetEditHistory();
 
-	bool scrollToBottom = ItemCount != int(activeEditor.GetEditHistory().size());
+	bool scrollToBottom = ItemCount != int(history.size());
 
-	for (int i = 0; i < activeEditor.GetEditHistory().size(); i++)
+	ImGuiListClipper clipper;
+	clipper.Begin(int(history.size()));
+	while (clipper.Step())
 	{
-		const auto& item = activeEditor.GetEditHistory()[i];
-		bool selected = i == activeEditor.GetCurrentEditHistoryIndex();
-		char tempName[512] = { 0 };
-
-		ImGui::BeginDisabled(i > activeEditor.GetCurrentEditHistoryIndex());
-		sprintf(tempName, "%s %s", selected ? ICON_FA_CIRCLE_CHEVRON_RIGHT : " ", item.EventName.c_str());
-
-		ImGui::Selectable(tempName, false, ImGuiSelectableFlags_AllowDoubleClick);
-		if (ImGui::IsItemHovered() && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
-			activeEditor.SetHistoryIndex(i);
-		ImGui::EndDisabled();
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+		{
+			const auto& item = history[i];
+			bool selected = i == activeEditor.GetCurrentEditHistoryIndex();
+			char tempName[512] = { 0 };
+
+			ImGui::PushID(i);
+			ImGui::BeginDisabled(i > activeEditor.GetCurrentEditHistoryIndex());
+			snprintf(tempName, sizeof(tempName), "%s %s", selected ? ICON_FA_CIRCLE_CHEVRON_RIGHT : " ", item.EventName.c_str());
+
+			ImGui::Selectable(tempName, false, ImGuiSelectableFlags_AllowDoubleClick);
+			if (ImGui::IsItemHovered() && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+				activeEditor.SetHistoryIndex(i);
+			ImGui::EndDisabled();
+			ImGui::PopID();
+		}
 	}
+	clipper.End();
+
 	if (scrollToBottom)
 		ImGui::SetScrollHereY();
 
-	ItemCount = int(activeEditor.GetEditHistory().size());
+	ItemCount = int(history.size());
 }
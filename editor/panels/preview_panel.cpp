@@ -14,6 +14,11 @@ PreviewPanel::PreviewPanel()
 
     Size = ImVec2(600, 440);
     Offset.x = 200;
+
+    Caster.SetCoherentMode(true);
+
+    // editor maps are rooms and doorways, and the sectors follow each edit without rebuilding the whole map
+    Caster.SetVisibilityBackend(VisibilityBackend::SectorPortals);
 }
 
 void PreviewPanel::OnShow()
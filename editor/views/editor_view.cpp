@@ -3,6 +3,8 @@
 #include "raymath.h"
 #include "rlgl.h"
 
+#include <algorithm>
+
 constexpr float CellRenderSize = 32;
 
 EditorView::EditorView(MapEditor& editor)
@@ -23,6 +25,143 @@ void EditorView::Shutdown()
 		UnloadRenderTexture(MapCacheTexture);
 
 	MapCacheTexture.id = 0;
+
+	UnloadCellChunks();
+}
+
+void EditorView::UnloadCellChunks()
+{
+	for (auto& texture : CellChunks)
+	{
+		if (texture.id != 0)
+			UnloadTexture(texture);
+	}
+
+	CellChunks.clear();
+	DirtyChunks.clear();
+	ChunksX = 0;
+	ChunksY = 0;
+	ChunkSource = nullptr;
+}
+
+// marks the chunks with edited cells, a new or resized map, or more edits than the map keeps a record of, marks them all
+void EditorView::UpdateCellChunks()
+{
+	const Map& map = Editor.GetWorkingMap();
+
+	if (&map != ChunkSource || map.GetWidth() != ChunkSourceWidth || map.GetHeight() != ChunkSourceHeight)
+	{
+		UnloadCellChunks();
+
+		ChunksX = (map.GetWidth() + CellChunkSize - 1) / CellChunkSize;
+		ChunksY = (map.GetHeight() + CellChunkSize - 1) / CellChunkSize;
+		CellChunks.assign(size_t(ChunksX) * ChunksY, Texture2D{ 0 });
+		DirtyChunks.assign(CellChunks.size(), 1);
+
+		ChunkSource = &map;
+		ChunkSourceWidth = map.GetWidth();
+		ChunkSourceHeight = map.GetHeight();
+		ChunkVersion = map.GetVersion();
+		return;
+	}
+
+	if (!map.GetEditsSince(ChunkVersion, EditedAreas))
+	{
+		std::fill(DirtyChunks.begin(), DirtyChunks.end(), 1);
+	}
+	else
+	{
+		for (const MapEditArea& area : EditedAreas)
+		{
+			for (int chunkY = area.MinY / CellChunkSize; chunkY <= area.MaxY / CellChunkSize; chunkY++)
+			{
+				for (int chunkX = area.MinX / CellChunkSize; chunkX <= area.MaxX / CellChunkSize; chunkX++)
+					DirtyChunks[size_t(chunkY) * ChunksX + chunkX] = 1;
+			}
+		}
+	}
+
+	ChunkVersion = map.GetVersion();
+}
+
+// solid cells are opaque white and everything else is clear, the same as drawing a white square for each solid cell
+void EditorView::RebuildCellChunk(int chunkX, int chunkY)
+{
+	const Map& map = Editor.GetWorkingMap();
+	ChunkPixels.assign(size_t(CellChunkSize) * CellChunkSize * 2, 0);
+
+	int startX = chunkX * CellChunkSize;
+	int startY = chunkY * CellChunkSize;
+	int endX = std::min(startX + CellChunkSize, map.GetWidth());
+	int endY = std::min(startY + CellChunkSize, map.GetHeight());
+
+	for (int y = startY; y < endY; y++)
+	{
+		uint8_t* pixel = ChunkPixels.data() + size_t(y - startY) * CellChunkSize * 2;
+		for (int x = startX; x < endX; x++, pixel += 2)
+		{
+			if (map.GetCell(x, y).State != CellState::Empty)
+			{
+				pixel[0] = 255;
+				pixel[1] = 255;
+			}
+		}
+	}
+
+	Texture2D& texture = CellChunks[size_t(chunkY) * ChunksX + chunkX];
+	if (texture.id == 0)
+	{
+		Image image = { ChunkPixels.data(), CellChunkSize, CellChunkSize, 1, PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA };
+		texture = LoadTextureFromImage(image);
+	}
+	else
+	{
+		UpdateTexture(texture, ChunkPixels.data());
+	}
+
+	DirtyChunks[size_t(chunkY) * ChunksX + chunkX] = 0;
+}
+
+void EditorView::DrawCells(const Rectangle& visibleCells)
+{
+	int startX = int(visibleCells.x) / CellChunkSize;
+	int startY = int(visibleCells.y) / CellChunkSize;
+	int endX = std::min(int(visibleCells.x + visibleCells.width + CellChunkSize - 1) / CellChunkSize, ChunksX);
+	int endY = std::min(int(visibleCells.y + visibleCells.height + CellChunkSize - 1) / CellChunkSize, ChunksY);
+
+	float chunkRenderSize = CellChunkSize * CellRenderSize;
+
+	for (int chunkY = startY; chunkY < endY; chunkY++)
+	{
+		for (int chunkX = startX; chunkX < endX; chunkX++)
+		{
+			if (DirtyChunks[size_t(chunkY) * ChunksX + chunkX])
+				RebuildCellChunk(chunkX, chunkY);
+
+			const Texture2D& texture = CellChunks[size_t(chunkY) * ChunksX + chunkX];
+			Rectangle source = { 0, 0, float(CellChunkSize), float(CellChunkSize) };
+			Rectangle dest = { chunkX * chunkRenderSize, chunkY * chunkRenderSize, chunkRenderSize, chunkRenderSize };
+			DrawTexturePro(texture, source, dest, Vector2{ 0, 0 }, 0, WHITE);
+		}
+	}
+}
+
+// one line for each row and column edge in view, left out once the cells are too small on screen for lines to help
+void EditorView::DrawGrid(const Rectangle& visibleCells)
+{
+	if (CellRenderSize * ViewCamea.zoom < 4)
+		return;
+
+	float left = visibleCells.x * CellRenderSize;
+	float top = visibleCells.y * CellRenderSize;
+	float right = (visibleCells.x + visibleCells.width) * CellRenderSize;
+	float bottom = (visibleCells.y + visibleCells.height) * CellRenderSize;
+
+	for (int x = int(visibleCells.x); x <= int(visibleCells.x + visibleCells.width); x++)
+		DrawLineV(Vector2{ x * CellRenderSize, top }, Vector2{ x * CellRenderSize, bottom }, BLACK);
+
+	for (int y = int(visibleCells.y); y <= int(visibleCells.y + visibleCells.height); y++)
+		DrawLineV(Vector2{ left, y * CellRenderSize }, Vector2{ right, y * CellRenderSize }, BLACK);
 }
 
 void EditorView::Show()
@@ -46,19 +185,21 @@ void EditorView::Show()
 
 	BeginMode2D(ViewCamea);
 
-	
-
 	const auto& currentState = Editor.GetWorkingMap();
+	UpdateCellChunks();
 
-	for (int y = 0; y < currentState.GetHeight(); y++)
-	{
-		for (int x = 0; x < currentState.GetWidth(); x++)
-		{
-			if (currentState.GetCellSolid(x, y))
-				DrawRectangleRec(Rectangle{ x * CellRenderSize, y * CellRenderSize, CellRenderSize, CellRenderSize }, WHITE);
-			DrawRectangleLinesEx(Rectangle{ x * CellRenderSize, y * CellRenderSize, CellRenderSize, CellRenderSize }, 1, BLACK);
-		}
-	}
+	// the cells under the corners of the view, clamped to the map
+	Vector2 corner = GetScreenToWorld2D(Vector2{ 0, 0 }, ViewCamea);
+	Vector2 oppositeCorner = GetScreenToWorld2D(Vector2{ float(MapCacheTexture.texture.width), float(MapCacheTexture.texture.height) }, ViewCamea);
+
+	int minX = std::clamp(int(floorf(std::min(corner.x, oppositeCorner.x) / CellRenderSize)), 0, currentState.GetWidth());
+	int minY = std::clamp(int(floorf(std::min(corner.y, oppositeCorner.y) / CellRenderSize)), 0, currentState.GetHeight());
+	int maxX = std::clamp(int(ceilf(std::max(corner.x, oppositeCorner.x) / CellRenderSize)), 0, currentState.GetWidth());
+	int maxY = std::clamp(int(ceilf(std::max(corner.y, oppositeCorner.y) / CellRenderSize)), 0, currentState.GetHeight());
+	Rectangle visibleCells = { float(minX), float(minY), float(maxX - minX), float(maxY - minY) };
+
+	DrawCells(visibleCells);
+	DrawGrid(visibleCells);
 
 	// draw view location
 	const auto& loc = Editor.GetViewLocation();
@@ -112,10 +253,17 @@ void EditorView::Zoom(float wheel)
 		// set the target to match, so that the camera maps the world space point under the cursor to the screen space point under the cursor at any zoom
 		ViewCamea.target = mouseWorldPos;
 
-		// zoom
-		ViewCamea.zoom += wheel * 0.125f;
-		if (ViewCamea.zoom < 0.125f)
-			ViewCamea.zoom = 0.125f;
+		// zoom, in steps of a scale when far out so it can go out far enough to see all of a large map
+		if (ViewCamea.zoom >= 0.125f && ViewCamea.zoom + wheel * 0.125f >= 0.125f)
+			ViewCamea.zoom += wheel * 0.125f;
+		else
+			ViewCamea.zoom *= powf(1.25f, wheel);
+
+		const Map& map = Editor.GetWorkingMap();
+		float fitZoom = std::min(GetScreenWidth(), GetScreenHeight()) / (std::max(map.GetWidth(), map.GetHeight()) * CellRenderSize);
+		float minZoom = std::min(0.125f, fitZoom);
+		if (ViewCamea.zoom < minZoom)
+			ViewCamea.zoom = minZoom;
 	}
 }
 
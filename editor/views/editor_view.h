@@ -4,6 +4,9 @@
 
 #include "raylib.h"
 
+#include <stdint.h>
+#include <vector>
+
 class EditorView
 {
 public:
@@ -46,4 +49,26 @@ protected:
 	Vector2i HoveredCell;
 
 	void CheckCacheSize(int width, int height);
+
+	// the map is drawn from a texture per chunk of cells, one texel per cell, sampled without filtering so every zoom shows sharp cells
+	// a chunk's texture is only rebuilt when a cell in it has been edited, and only once it is on screen
+	static constexpr int CellChunkSize = 128;
+
+	void UpdateCellChunks();
+	void RebuildCellChunk(int chunkX, int chunkY);
+	void UnloadCellChunks();
+	void DrawCells(const Rectangle& visibleCells);
+	void DrawGrid(const Rectangle& visibleCells);
+
+	std::vector<Texture2D> CellChunks;
+	std::vector<uint8_t> DirtyChunks;
+	std::vector<uint8_t> ChunkPixels;
+	int ChunksX = 0;
+	int ChunksY = 0;
+
+	const Map* ChunkSource = nullptr;
+	uint64_t ChunkVersion = 0;
+	int ChunkSourceWidth = 0;
+	int ChunkSourceHeight = 0;
+	std::vector<MapEditArea> EditedAreas;
 };
\ No newline at end of file
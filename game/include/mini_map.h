@@ -3,6 +3,9 @@
 #include "raylib.h"
 #include "raycaster.h"
 
+#include <stdint.h>
+#include <vector>
+
 class MiniMap
 {
 public:
@@ -10,6 +13,7 @@ public:
 
     void Unload();
 
+    // pixels per cell, the tiles are drawn scaled so changing it rebuilds nothing
     void SetGridSize(int size);
     inline int GetGridSize() const { return MapPixelSize; }
 
@@ -17,14 +21,43 @@ public:
 
 protected:
     void Render(const EntityLocation& loc);
+    void DrawTiles(int minX, int minY, int maxX, int maxY);
+    void DrawGrid(int minX, int minY, int maxX, int maxY);
+    void DrawVisibleCells();
     void DrawRayset(const Vector2& playerPos, float scale);
 
+    // the map is cut into tiles of cells, one texel per cell, and only the tiles near the player are kept
+    // a tile is rebuilt when a cell in it is edited, or when its texture is taken for another tile
+    static constexpr int TileCells = 64;
+    static constexpr int MaxTiles = 64;
+
+    struct CachedTile
+    {
+        int TileX = -1;
+        int TileY = -1;
+        Texture2D Texture = { 0 };
+        bool Dirty = true;
+        uint64_t LastUsed = 0;
+    };
+
+    void UpdateTiles();
+    const CachedTile& GetTile(int tileX, int tileY);
+    void RebuildTile(CachedTile& tile);
+
     const Raycaster& Caster;
     const Map& WorldMap;
 
     int MapPixelSize = 20;
-    float MiniMapSize = 200;
+    static constexpr int MiniMapSize = 300;
+
+    RenderTexture MapRenderTexture = { 0 };	// render texture for the top view, the size of the minimap
+
+    std::vector<CachedTile> Tiles;
+    std::vector<uint8_t> TilePixels;
+    uint64_t Frame = 0;
 
-    RenderTexture MapRenderTexture = { 0 };	// render texture for the top view
-    RenderTexture MapTileCache = { 0 };	// render texture for the top view
+    uint64_t TileVersion = 0;
+    int TileMapWidth = 0;
+    int TileMapHeight = 0;
+    std::vector<MapEditArea> EditedAreas;
 };
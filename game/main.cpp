@@ -29,9 +29,13 @@
 #include "raylib.h"
 #include "raymath.h"
 
+#include "async_loader.h"
+#include "camera_path.h"
 #include "map.h"
 #include "map_serializer.h"
+#include "map_streamer.h"
 #include "raycaster.h"
+#include "potentially_visible_set.h"
 #include "mini_map.h"
 #include "view_render.h"
 #include "map_collider.h"
@@ -42,7 +46,12 @@
 Map WorldMap;
 constexpr float ViewFOVY = 40;
 
+// how far the view reaches with fog on, rays and faces stop there
+constexpr float FogViewDistance = 16;
+bool UseFog = false;
+
 // HUD info
+Texture2D TileTexture = { 0 };
 Texture2D GunTexture = { 0 };
 Texture2D CrosshairTexture = { 0 };
 Vector2 GunBobble = { 0,0 };
@@ -105,6 +114,10 @@ float GetFOVX(float fovY)
 // player data
 EntityLocation Player{ Vector2{ 4.5f,  2.5f }, Vector2{1, 0} };
 
+// the player's view each frame while recording, for raycastBench to replay
+CameraPath RecordedPath;
+bool RecordingPath = false;
+
 // move the player around the map
 void UpdateMovement(MapCollider& collider)
 {
@@ -174,22 +187,70 @@ void DrawGun()
     DrawTexture(CrosshairTexture, GetScreenWidth()/2 - CrosshairTexture.width/2, GetScreenHeight()/2 - CrosshairTexture.height/2, ColorAlpha(WHITE, 0.5f));
 }
 
-void ProcessInput(MiniMap &miniMap, MapCollider& collider)
+void ProcessInput(MiniMap &miniMap, MapCollider& collider, ViewRenderer& renderer)
 {
     if (IsKeyPressed(KEY_PAGE_UP))
         miniMap.SetGridSize(miniMap.GetGridSize() + 1);
     if (IsKeyPressed(KEY_PAGE_DOWN) && miniMap.GetGridSize() > 1)
         miniMap.SetGridSize(miniMap.GetGridSize() - 1);
 
+    if (IsKeyPressed(KEY_F6))
+        UseFog = !UseFog;
+    if (IsKeyPressed(KEY_F7))
+        renderer.SetUseChunkMeshes(!renderer.GetUseChunkMeshes());
+    if (IsKeyPressed(KEY_F8))
+        renderer.SetGreedyMeshing(!renderer.GetGreedyMeshing());
+
+    if (IsKeyPressed(KEY_F5))
+    {
+        if (RecordingPath)
+            RecordedPath.Write("camera_path.txt");
+
+        RecordedPath.Clear();
+        RecordingPath = !RecordingPath;
+    }
+
     // move the player
     UpdateMovement(collider);
 }
 
-void LoadResources()
+void LoadResources(AsyncLoader& loader)
 {
+    loader.QueueTexture("textures/textures.png", [](Texture2D texture) { TileTexture = texture; });
+
     // texture for the gun
-    GunTexture = LoadTexture("textures/gun.png");
-    CrosshairTexture = LoadTexture("textures/crosshair.png");
+    loader.QueueTexture("textures/gun.png", [](Texture2D texture) { GunTexture = texture; });
+    loader.QueueTexture("textures/crosshair.png", [](Texture2D texture) { CrosshairTexture = texture; });
+}
+
+// draw a progress bar until every load has come back, false if the window was closed first
+bool ShowLoadingScreen(AsyncLoader& loader)
+{
+    while (loader.GetPendingCount() > 0)
+    {
+        if (WindowShouldClose())
+        {
+            loader.CancelAll();
+            return false;
+        }
+
+        loader.Update();
+
+        int barWidth = GetScreenWidth() / 2;
+        int barX = (GetScreenWidth() - barWidth) / 2;
+        int barY = GetScreenHeight() / 2;
+
+        BeginDrawing();
+        ClearBackground(BLACK);
+
+        DrawText("Loading", barX, barY - 30, 20, WHITE);
+        DrawRectangle(barX, barY, int(barWidth * loader.GetProgress()), 20, DARKGRAY);
+        DrawRectangleLines(barX, barY, barWidth, 20, GRAY);
+
+        EndDrawing();
+    }
+
+    return true;
 }
 
 void UnloadResources(MiniMap &miniMap, ViewRenderer &renderer)
@@ -227,27 +288,60 @@ int main()
     UseButtonForMouse = false;
 #endif
 
-    MapSerializer serializer;
-    WorldMap = serializer.ReadResource("maps/test.mres");
+    // the map and the textures load on the loader's threads while the loading screen is drawn
+    AsyncLoader loader;
+
+    // stream the map when it has been saved as chunks, otherwise read all of it up front
+    MapStreamer streamer(WorldMap);
+    bool streaming = streamer.Open(MapStreamFile::GetStreamPath("maps/test.mres"));
+    if (streaming)
+        streamer.LoadAround(Player);
+    else
+        loader.QueueMap("maps/test.mres", MapStorage::Dense, [](Map& map) { WorldMap = std::move(map); });
+
+    LoadResources(loader);
+
+    if (!ShowLoadingScreen(loader))
+    {
+        UnloadTexture(TileTexture);
+        UnloadTexture(GunTexture);
+        UnloadTexture(CrosshairTexture);
+        CloseWindow();
+        return 0;
+    }
 
     Raycaster raycaster(&WorldMap, GetScreenWidth(), GetFOVX(ViewFOVY));
+
+    // use the baked visibility when there is one for this version of the map
+    PotentiallyVisibleSet pvs;
+    if (pvs.Read(PotentiallyVisibleSet::GetSidecarPath("maps/test.mres")) && pvs.IsBakedFor(WorldMap))
+        raycaster.SetPVS(&pvs);
+
     MiniMap miniMap(20, raycaster, WorldMap);
     ViewRenderer renderer(raycaster, &WorldMap);
     MapCollider collider(WorldMap);
 
-    renderer.SetTileTexture(LoadTexture("textures/textures.png"));
+    renderer.SetTileTexture(TileTexture);
 
     renderer.SetFOVY(ViewFOVY);
 
-    LoadResources();
-
     // game loop
     while (!WindowShouldClose())
     {
-        ProcessInput(miniMap, collider);
+        if (streaming)
+            streamer.Update(Player);
+
+        ProcessInput(miniMap, collider, renderer);
+
+        float viewDistance = UseFog ? FogViewDistance : 0;
+        raycaster.SetMaxViewDistance(viewDistance);
+        renderer.SetMaxViewDistance(viewDistance);
 
         raycaster.StartFrame(Player);
 
+        if (RecordingPath)
+            RecordedPath.AddFrame(Player);
+
         // Draw the results to the screen
         BeginDrawing();
         ClearBackground(BLACK);
@@ -259,9 +353,15 @@ int main()
         miniMap.Draw(Player);
 
         // text overlay
-        DrawRectangle(0, 0, 450, 50, ColorAlpha(BLACK, 0.25f));
+        DrawRectangle(0, 0, 560, 50, ColorAlpha(BLACK, 0.25f));
         DrawFPS(2, 0);
-        DrawText(TextFormat("Player X%2.1f, X%2.1f, Casts %d Faces = %d", Player.Position.x, Player.Position.y, raycaster.GetCastCount(), renderer.GetFaceCount()), 2, 20, 20, WHITE);
+        DrawText(TextFormat("Player X%2.1f, X%2.1f, Casts %d Faces = %d of %d", Player.Position.x, Player.Position.y, raycaster.GetCastCount(), renderer.GetFaceCount(), renderer.GetUnculledFaceCount()), 2, 20, 20, WHITE);
+
+        if (streaming)
+            DrawText(TextFormat("Chunks %d loaded, %d pending, %.1f MB", streamer.GetLoadedCount(), streamer.GetPendingCount(), streamer.GetMemoryUse() / (1024.0f * 1024.0f)), 2, 70, 20, WHITE);
+
+        if (RecordingPath)
+            DrawText(TextFormat("Recording path, %d frames", int(RecordedPath.GetFrameCount())), 2, 50, 20, RED);
 
         EndDrawing();
     }
@@ -12,11 +12,13 @@ bool MapCollider::Move(EntityLocation& loc, const Vector2& desiredMotion, float
 	Vector2 newPos = Vector2Add(loc.Position, desiredMotion);
 	bool collided = false;
 
+	const OccupancyGrid& solidGrid = WorldMap.GetSolidGrid();
+
 	for (int y = int(loc.Position.y - 1); y <= int(loc.Position.y + 1); y++)
 	{
 		for (int x = int(loc.Position.x - 1); x <= int(loc.Position.x + 1); x++)
 		{
-			if (!WorldMap.GetCellPassable(x, y))
+			if (!solidGrid.IsPassable(x, y))
 			{
 				// check rectangle
 
@@ -1,5 +1,12 @@
 #include "mini_map.h"
 
+#include "rlgl.h"
+
+#include <algorithm>
+
+// quads and lines are sent in groups that always fit in one render batch
+constexpr int BatchGroupSize = 1024;
+
 MiniMap::MiniMap(int size, const Raycaster& raycaster, const Map& map)
     : Caster(raycaster)
     , WorldMap(map)
@@ -13,85 +20,268 @@ void MiniMap::Unload()
     if (MapRenderTexture.id != 0)
         UnloadRenderTexture(MapRenderTexture);
 
-    if (MapTileCache.id != 0)
-        UnloadRenderTexture(MapTileCache);
-
     MapRenderTexture.id = 0;
-    MapTileCache.id = 0;
+
+    for (auto& tile : Tiles)
+    {
+        if (tile.Texture.id != 0)
+            UnloadTexture(tile.Texture);
+    }
+
+    Tiles.clear();
 }
 
 void MiniMap::SetGridSize(int size)
 {
-    MapPixelSize = size;
+    MapPixelSize = std::max(size, 1);
+}
 
-    Unload();
+void MiniMap::Draw(const EntityLocation& loc)
+{
+    Render(loc);
 
-    MapRenderTexture = LoadRenderTexture(int(WorldMap.GetWidth()) * MapPixelSize, int(WorldMap.GetHeight()) * MapPixelSize);
+    Rectangle mapRect = { 0, 0, float(MiniMapSize), float(MiniMapSize) };
+    mapRect.x = GetScreenWidth() - mapRect.width;
+    mapRect.y = 0;
+
+    DrawRectangleRec(mapRect, ColorAlpha(BLACK, 0.5f));
+
+    // Note that this render texture is NOT flipped in Y, so that the view has Y be up not down
+    Rectangle sourceRect = { 0, 0, float(MapRenderTexture.texture.width), float(MapRenderTexture.texture.height) };
+    DrawTextureRec(MapRenderTexture.texture, sourceRect, Vector2{ mapRect.x, mapRect.y }, WHITE);
+}
 
-    MapTileCache = LoadRenderTexture(int(WorldMap.GetWidth()) * MapPixelSize, int(WorldMap.GetHeight()) * MapPixelSize);
-    BeginTextureMode(MapTileCache);
-    ClearBackground(DARKGRAY);
-    // cache off the fixed part of the map so we don't have to draw it every time
-    for (uint8_t y = 0; y < WorldMap.GetHeight(); y++)
+// marks the tiles with edited cells, a resized map or more edits than the map keeps a record of marks them all
+void MiniMap::UpdateTiles()
+{
+    bool resized = WorldMap.GetWidth() != TileMapWidth || WorldMap.GetHeight() != TileMapHeight;
+    if (resized || !WorldMap.GetEditsSince(TileVersion, EditedAreas))
+    {
+        for (auto& tile : Tiles)
+            tile.Dirty = true;
+    }
+    else
     {
-        for (uint8_t x = 0; x < WorldMap.GetWidth(); x++)
+        for (const MapEditArea& area : EditedAreas)
         {
-            if (WorldMap.GetCellSolid(x, y))
-                DrawRectangle(x * MapPixelSize, y * MapPixelSize, MapPixelSize, MapPixelSize, WHITE);
-            DrawRectangleLines(x * MapPixelSize, y * MapPixelSize, MapPixelSize, MapPixelSize, BLACK);
+            for (auto& tile : Tiles)
+            {
+                if (tile.TileX >= area.MinX / TileCells && tile.TileX <= area.MaxX / TileCells
+                    && tile.TileY >= area.MinY / TileCells && tile.TileY <= area.MaxY / TileCells)
+                    tile.Dirty = true;
+            }
         }
     }
-    EndTextureMode();
+
+    TileVersion = WorldMap.GetVersion();
+    TileMapWidth = WorldMap.GetWidth();
+    TileMapHeight = WorldMap.GetHeight();
 }
 
-void MiniMap::Draw(const EntityLocation& loc)
+// solid cells are opaque white and everything else is clear, cells that are not loaded yet are left clear too
+void MiniMap::RebuildTile(CachedTile& tile)
 {
-    Render(loc);
+    TilePixels.assign(size_t(TileCells) * TileCells * 2, 0);
 
-    Rectangle mapRect = { 0, 0, 300, 300 };
-    mapRect.x = GetScreenWidth() - mapRect.width;
-    mapRect.y = 0;
+    int startX = tile.TileX * TileCells;
+    int startY = tile.TileY * TileCells;
+    int endX = std::min(startX + TileCells, WorldMap.GetWidth());
+    int endY = std::min(startY + TileCells, WorldMap.GetHeight());
 
-    DrawRectangleRec(mapRect, ColorAlpha(BLACK, 0.5f));
+    for (int y = startY; y < endY; y++)
+    {
+        uint8_t* pixel = TilePixels.data() + size_t(y - startY) * TileCells * 2;
+        for (int x = startX; x < endX; x++, pixel += 2)
+        {
+            MapCell cell = WorldMap.GetCell(x, y);
+            if (cell.State != CellState::Empty && !cell.IsUnknown())
+            {
+                pixel[0] = 255;
+                pixel[1] = 255;
+            }
+        }
+    }
 
-    Rectangle destRect = { mapRect.x + mapRect.width * 0.5f, mapRect.y + mapRect.height * 0.5f, float(MapRenderTexture.texture.width), float(MapRenderTexture.texture.height) };
+    if (tile.Texture.id == 0)
+    {
+        Image image = { TilePixels.data(), TileCells, TileCells, 1, PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA };
+        tile.Texture = LoadTextureFromImage(image);
+    }
+    else
+    {
+        UpdateTexture(tile.Texture, TilePixels.data());
+    }
 
-    BeginScissorMode(int(mapRect.x), int(mapRect.y), int(mapRect.width), int(mapRect.height));
+    tile.Dirty = false;
+}
 
-    Rectangle sourceRect = { 0, 0, float(MapRenderTexture.texture.width), float(MapRenderTexture.texture.height) };
-    Vector2 offset = { (loc.Position.x * MapPixelSize), MapRenderTexture.texture.height - (loc.Position.y * MapPixelSize) };
+// a tile that is not kept takes the texture of the one that was used the longest ago
+const MiniMap::CachedTile& MiniMap::GetTile(int tileX, int tileY)
+{
+    CachedTile* found = nullptr;
+    for (auto& tile : Tiles)
+    {
+        if (tile.TileX == tileX && tile.TileY == tileY)
+        {
+            found = &tile;
+            break;
+        }
+    }
 
-    // Note that this render texture is NOT flipped in Y, so that the view has Y be up not down
-    DrawTexturePro(MapRenderTexture.texture, sourceRect, destRect, offset, 0, WHITE);
-    EndScissorMode();
+    if (!found)
+    {
+        if (Tiles.size() < size_t(MaxTiles))
+        {
+            Tiles.emplace_back();
+            found = &Tiles.back();
+        }
+        else
+        {
+            found = &*std::min_element(Tiles.begin(), Tiles.end(), [](const CachedTile& a, const CachedTile& b) { return a.LastUsed < b.LastUsed; });
+        }
+
+        found->TileX = tileX;
+        found->TileY = tileY;
+        found->Dirty = true;
+    }
+
+    found->LastUsed = Frame;
+    if (found->Dirty)
+        RebuildTile(*found);
+
+    return *found;
 }
 
-void MiniMap::DrawRayset(const Vector2& playerPos, float scale)
+void MiniMap::DrawTiles(int minX, int minY, int maxX, int maxY)
 {
-    for (const RayResult& ray : Caster.GetResults())
+    DrawRectangle(minX * MapPixelSize, minY * MapPixelSize, (maxX - minX) * MapPixelSize, (maxY - minY) * MapPixelSize, DARKGRAY);
+
+    float tileSize = float(TileCells * MapPixelSize);
+    for (int tileY = minY / TileCells; tileY * TileCells < maxY; tileY++)
     {
-        if (ray.Distance >= 0 && ray.HitCellIndex >= 0)
-            DrawLineV(playerPos, Vector2Add(playerPos, Vector2Scale(ray.Directon, ray.Distance * scale)), ColorAlpha(SKYBLUE, 0.75f));
+        for (int tileX = minX / TileCells; tileX * TileCells < maxX; tileX++)
+        {
+            const CachedTile& tile = GetTile(tileX, tileY);
+
+            Rectangle source = { 0, 0, float(TileCells), float(TileCells) };
+            Rectangle dest = { tileX * tileSize, tileY * tileSize, tileSize, tileSize };
+            DrawTexturePro(tile.Texture, source, dest, Vector2Zero(), 0, WHITE);
+        }
     }
 }
 
-void MiniMap::Render(const EntityLocation& loc)
+// one line for each row and column edge in view, left out when the cells are too small for lines to help
+void MiniMap::DrawGrid(int minX, int minY, int maxX, int maxY)
 {
-    BeginTextureMode(MapRenderTexture);
-    ClearBackground(DARKGRAY);
+    if (MapPixelSize < 4)
+        return;
+
+    for (int x = minX; x <= maxX; x++)
+        DrawLine(x * MapPixelSize, minY * MapPixelSize, x * MapPixelSize, maxY * MapPixelSize, BLACK);
+
+    for (int y = minY; y <= maxY; y++)
+        DrawLine(minX * MapPixelSize, y * MapPixelSize, maxX * MapPixelSize, y * MapPixelSize, BLACK);
+}
+
+static void AddQuad(float x, float y, float size, Color color)
+{
+    rlColor4ub(color.r, color.g, color.b, color.a);
+    rlVertex2f(x, y);
+    rlVertex2f(x, y + size);
+    rlVertex2f(x + size, y + size);
+    rlVertex2f(x + size, y);
+}
+
+// every cell and block the rays saw, as quads in as few batches as fit
+void MiniMap::DrawVisibleCells()
+{
+    const auto& cells = Caster.GetHitCelList();
+    const auto& blocks = Caster.GetHitBlockList();
 
-    DrawTextureRec(MapTileCache.texture, Rectangle{ 0,0,float(MapTileCache.texture.width),float(-MapTileCache.texture.height) }, Vector2Zero(), WHITE);
+    Color solidColor = ColorAlpha(PURPLE, 0.5f);
+    Color emptyColor = ColorAlpha(DARKPURPLE, 0.5f);
+    float size = float(MapPixelSize);
 
-    for (const auto& cell : Caster.GetHitCelList())
+    size_t total = cells.size() + blocks.size();
+    for (size_t start = 0; start < total; start += BatchGroupSize)
     {
-        if (WorldMap.GetCellSolid(cell.x, cell.y))
-            DrawRectangle(cell.x * MapPixelSize, cell.y * MapPixelSize, MapPixelSize, MapPixelSize, ColorAlpha(PURPLE, 0.5f));
-        else
-            DrawRectangle(cell.x * MapPixelSize, cell.y * MapPixelSize, MapPixelSize, MapPixelSize, ColorAlpha(DARKPURPLE, 0.5f));
+        size_t end = std::min(start + BatchGroupSize, total);
+        rlCheckRenderBatchLimit(int(end - start) * 4);
+
+        rlBegin(RL_QUADS);
+        for (size_t i = start; i < end; i++)
+        {
+            if (i < cells.size())
+            {
+                const auto& cell = cells[i];
+                AddQuad(cell.x * size, cell.y * size, size, WorldMap.GetCellSolid(cell.x, cell.y) ? solidColor : emptyColor);
+            }
+            else
+            {
+                const auto& block = blocks[i - cells.size()];
+                AddQuad(block.X * size, block.Y * size, block.Size * size, emptyColor);
+            }
+        }
+        rlEnd();
+    }
+}
+
+void MiniMap::DrawRayset(const Vector2& playerPos, float scale)
+{
+    const auto& rays = Caster.GetResults();
+    Color color = ColorAlpha(SKYBLUE, 0.75f);
+
+    for (size_t start = 0; start < rays.size(); start += BatchGroupSize)
+    {
+        size_t end = std::min(start + BatchGroupSize, rays.size());
+        rlCheckRenderBatchLimit(int(end - start) * 2);
+
+        rlBegin(RL_LINES);
+        rlColor4ub(color.r, color.g, color.b, color.a);
+        for (size_t i = start; i < end; i++)
+        {
+            const RayResult& ray = rays[i];
+            if (ray.Distance < 0 || ray.HitCellIndex < 0)
+                continue;
+
+            Vector2 hit = Vector2Add(playerPos, Vector2Scale(ray.Directon, ray.Distance * scale));
+            rlVertex2f(playerPos.x, playerPos.y);
+            rlVertex2f(hit.x, hit.y);
+        }
+        rlEnd();
     }
+}
+
+void MiniMap::Render(const EntityLocation& loc)
+{
+    if (MapRenderTexture.id == 0)
+        MapRenderTexture = LoadRenderTexture(MiniMapSize, MiniMapSize);
+
+    Frame++;
+    UpdateTiles();
 
     Vector2 playerPixelSpace = Vector2Scale(loc.Position, float(MapPixelSize));
 
+    // the player stays in the middle and only the cells around them are drawn
+    Camera2D camera = { 0 };
+    camera.offset = Vector2{ MiniMapSize * 0.5f, MiniMapSize * 0.5f };
+    camera.target = playerPixelSpace;
+    camera.zoom = 1;
+
+    float halfCells = MiniMapSize * 0.5f / MapPixelSize;
+    int minX = std::clamp(int(floorf(loc.Position.x - halfCells)), 0, WorldMap.GetWidth());
+    int minY = std::clamp(int(floorf(loc.Position.y - halfCells)), 0, WorldMap.GetHeight());
+    int maxX = std::clamp(int(ceilf(loc.Position.x + halfCells)), 0, WorldMap.GetWidth());
+    int maxY = std::clamp(int(ceilf(loc.Position.y + halfCells)), 0, WorldMap.GetHeight());
+
+    BeginTextureMode(MapRenderTexture);
+    ClearBackground(BLANK);
+    BeginMode2D(camera);
+
+    DrawTiles(minX, minY, maxX, maxY);
+    DrawGrid(minX, minY, maxX, maxY);
+    DrawVisibleCells();
+
     // draw rays
     DrawRayset(playerPixelSpace, float(MapPixelSize));
 
@@ -107,5 +297,6 @@ void MiniMap::Render(const EntityLocation& loc)
     DrawLine(MapPixelSize / 4, MapPixelSize / 4, MapPixelSize, MapPixelSize / 4, RED);
     DrawLine(MapPixelSize / 4, MapPixelSize / 4, MapPixelSize / 4, MapPixelSize, GREEN);
 
+    EndMode2D();
     EndTextureMode();
-}
\ No newline at end of file
+}
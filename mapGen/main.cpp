@@ -0,0 +1,119 @@
+/*
+*   Map generator
+*   Builds a maze, cave, rooms or arena map from a seed and writes it as a .mres file
+*   The same seed and size give the same map on any machine, the hash it prints can be compared between runs
+*
+*   usage: mapGen [--chunked] [--bench] [style] [width] [height] [seed] [output file]
+*
+*   --chunked   build the map in chunked storage, which the largest sizes need to fit in memory
+*   --bench     read the file back and report the write and read speed, in MB of cells a second
+*
+*   an output file ending in .mstream is written as a stream file, which the game loads a chunk at a time
+*   one ending in .mimg is written as a map image, which is mapped into memory when it is read
+*/
+
+#include "map.h"
+#include "map_generator.h"
+#include "map_serializer.h"
+#include "map_stream_file.h"
+#include "potentially_visible_set.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+    MapStorage storage = MapStorage::Dense;
+    bool bench = false;
+    std::vector<const char*> args;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--chunked") == 0)
+            storage = MapStorage::Chunked;
+        else if (strcmp(argv[i], "--bench") == 0)
+            bench = true;
+        else
+            args.push_back(argv[i]);
+    }
+
+    const char* styleName = args.size() > 0 ? args[0] : "rooms";
+    int width = args.size() > 1 ? atoi(args[1]) : 256;
+    int height = args.size() > 2 ? atoi(args[2]) : width;
+    uint64_t seed = args.size() > 3 ? strtoull(args[3], nullptr, 10) : 1;
+
+    MapStyle style = MapStyle::Rooms;
+    if (!MapGenerator::FindStyle(styleName, style))
+    {
+        printf("unknown style %s, use maze, cave, rooms or arena\n", styleName);
+        return 1;
+    }
+
+    if (width < MapGenerator::MinSize || width > MapGenerator::MaxSize || height < MapGenerator::MinSize || height > MapGenerator::MaxSize)
+    {
+        printf("sizes go from %d to %d\n", MapGenerator::MinSize, MapGenerator::MaxSize);
+        return 1;
+    }
+
+    std::string outFile = args.size() > 4 ? args[4] : std::string(styleName) + "_" + std::to_string(width) + "x" + std::to_string(height) + "_" + std::to_string(seed) + ".mres";
+
+    auto start = std::chrono::steady_clock::now();
+
+    Map map;
+    map.SetStorage(storage);
+
+    MapGenerator generator(seed);
+    generator.Generate(map, style, width, height);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bool stream = outFile.size() > 8 && outFile.compare(outFile.size() - 8, 8, ".mstream") == 0;
+    bool image = outFile.size() > 5 && outFile.compare(outFile.size() - 5, 5, ".mimg") == 0;
+
+    auto writeStart = std::chrono::steady_clock::now();
+
+    MapSerializer serializer;
+    bool written = stream ? MapStreamFile::Write(map, outFile) : image ? serializer.WriteImage(map, outFile) : serializer.WriteResource(map, outFile);
+    double writeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - writeStart).count();
+    if (!written)
+    {
+        printf("could not write %s\n", outFile.c_str());
+        return 1;
+    }
+
+    printf("%s %dx%d seed %llu built in %.2fs, %.1f MB of cells, hash %016llx, wrote %s\n", styleName, width, height, (unsigned long long)seed, seconds,
+        map.GetCellMemoryUse() / (1024.0 * 1024.0), (unsigned long long)PotentiallyVisibleSet::GetMapHash(map), outFile.c_str());
+
+    // stream files are read a chunk at a time by the game, so only whole map files are read back
+    if (bench && !stream)
+    {
+        auto readStart = std::chrono::steady_clock::now();
+        Map readBack = serializer.ReadResource(outFile, storage);
+        double readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - readStart).count();
+
+        // every load rebuilds the occupancy, time it again on its own to see what the file itself costs
+        auto occupancyStart = std::chrono::steady_clock::now();
+        readBack.UpdateOccupancy();
+        double occupancySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - occupancyStart).count();
+
+        long fileSize = 0;
+        if (FILE* fp = fopen(outFile.c_str(), "rb"))
+        {
+            fseek(fp, 0, SEEK_END);
+            fileSize = ftell(fp);
+            fclose(fp);
+        }
+
+        // the state, tile and flags of every cell
+        double cellMB = double(width) * height * 3 / (1024.0 * 1024.0);
+        bool same = PotentiallyVisibleSet::GetMapHash(readBack) == PotentiallyVisibleSet::GetMapHash(map);
+
+        printf("write %.0f MB/s, read %.0f MB/s of which %.0f ms is the occupancy, file %.1f MB, %.1f%% of the cells, read back %s\n", cellMB / writeSeconds, cellMB / readSeconds,
+            occupancySeconds * 1000.0, fileSize / (1024.0 * 1024.0), 100.0 * fileSize / (cellMB * 1024.0 * 1024.0), same ? "matches" : "DIFFERS");
+    }
+
+    return 0;
+}
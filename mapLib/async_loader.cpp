@@ -0,0 +1,206 @@
+#include "async_loader.h"
+#include "map_serializer.h"
+
+#include <algorithm>
+
+AsyncLoader::AsyncLoader(int threadCount)
+    : ThreadCount(threadCount)
+{
+    // leave a core for the thread that draws
+    if (ThreadCount <= 0)
+        ThreadCount = std::clamp(int(std::thread::hardware_concurrency()) - 1, 1, 4);
+}
+
+// whatever came back but was never finished is released as not loaded
+AsyncLoader::~AsyncLoader()
+{
+    CancelAll();
+
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        Quit = true;
+    }
+    WakeWorkers.notify_all();
+
+    for (auto& worker : Workers)
+        worker.join();
+
+    for (auto& job : Jobs)
+        Results.Push(Result{ job.Task, job.Finish, false });
+    Jobs.clear();
+
+    Result result;
+    while (Results.Pop(result))
+        FinishResult(result);
+}
+
+void AsyncLoader::StartWorkers()
+{
+    if (!Workers.empty())
+        return;
+
+    for (int i = 0; i < ThreadCount; i++)
+        Workers.emplace_back(&AsyncLoader::WorkerLoop, this);
+}
+
+void AsyncLoader::WorkerLoop()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(Lock);
+            WakeWorkers.wait(lock, [this]() { return Quit || !Jobs.empty(); });
+
+            if (Quit)
+                return;
+
+            job = std::move(Jobs.front());
+            Jobs.pop_front();
+        }
+
+        bool loaded = !job.Task->IsCancelled() && job.Work(*job.Task);
+        if (loaded)
+            job.Task->SetProgress(1);
+
+        Result result;
+        result.Task = std::move(job.Task);
+        result.Finish = std::move(job.Finish);
+        result.Loaded = loaded;
+        Results.Push(std::move(result));
+    }
+}
+
+std::shared_ptr<LoadTask> AsyncLoader::Queue(std::string_view name, WorkFunction work, FinishFunction finish)
+{
+    StartWorkers();
+
+    // a new batch starts the overall progress again
+    if (Active.empty())
+        FinishedCount = 0;
+
+    auto task = std::make_shared<LoadTask>(name);
+    Active.push_back(task);
+
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        Jobs.push_back(Job{ task, std::move(work), std::move(finish) });
+    }
+    WakeWorkers.notify_one();
+
+    return task;
+}
+
+std::shared_ptr<LoadTask> AsyncLoader::QueueMap(std::string_view filepath, MapStorage storage, std::function<void(Map& map)> onLoaded)
+{
+    auto map = std::make_shared<Map>();
+    std::string path(filepath);
+
+    auto work = [map, path, storage](LoadTask& task)
+    {
+        MapSerializer serializer;
+        serializer.OnProgress = [&task](float progress)
+        {
+            task.SetProgress(progress);
+            return !task.IsCancelled();
+        };
+
+        // a missing or damaged file is not loaded, so nothing takes the empty map for the file's contents
+        return serializer.ReadResource(path, *map, storage) && !task.IsCancelled();
+    };
+
+    auto finish = [map, onLoaded](bool loaded)
+    {
+        if (loaded && onLoaded)
+            onLoaded(*map);
+    };
+
+    return Queue(filepath, work, finish);
+}
+
+std::shared_ptr<LoadTask> AsyncLoader::QueueImage(std::string_view filepath, std::function<void(Image& image)> onLoaded)
+{
+    auto image = std::make_shared<Image>();
+    *image = Image{ 0 };
+    std::string path(filepath);
+
+    // decoding only touches memory, so it is safe off the main thread
+    auto work = [image, path](LoadTask& task)
+    {
+        *image = LoadImage(path.c_str());
+        return image->data != nullptr && !task.IsCancelled();
+    };
+
+    auto finish = [image, onLoaded](bool loaded)
+    {
+        if (loaded && onLoaded)
+            onLoaded(*image);
+
+        if (image->data)
+            UnloadImage(*image);
+        *image = Image{ 0 };
+    };
+
+    return Queue(filepath, work, finish);
+}
+
+std::shared_ptr<LoadTask> AsyncLoader::QueueTexture(std::string_view filepath, std::function<void(Texture2D texture)> onLoaded)
+{
+    auto upload = [onLoaded](Image& image)
+    {
+        Texture2D texture = LoadTextureFromImage(image);
+        if (onLoaded)
+            onLoaded(texture);
+    };
+
+    return QueueImage(filepath, upload);
+}
+
+void AsyncLoader::FinishResult(Result& result)
+{
+    bool loaded = result.Loaded && !result.Task->IsCancelled();
+
+    if (result.Finish)
+        result.Finish(loaded);
+
+    result.Task->Success.store(loaded);
+    result.Task->Done.store(true);
+}
+
+void AsyncLoader::Update()
+{
+    Result result;
+    while (Results.Pop(result))
+    {
+        FinishResult(result);
+
+        auto itr = std::find(Active.begin(), Active.end(), result.Task);
+        if (itr != Active.end())
+        {
+            Active.erase(itr);
+            FinishedCount++;
+        }
+
+        result = Result();
+    }
+}
+
+// queued jobs still come back through Update, as not loaded, so their finish functions run
+void AsyncLoader::CancelAll()
+{
+    for (auto& task : Active)
+        task->Cancel();
+}
+
+float AsyncLoader::GetProgress() const
+{
+    int total = FinishedCount + int(Active.size());
+    if (total == 0)
+        return 1;
+
+    float progress = float(FinishedCount);
+    for (const auto& task : Active)
+        progress += task->GetProgress();
+
+    return progress / total;
+}
@@ -0,0 +1,141 @@
+#include "camera_path.h"
+#include "raymath.h"
+
+#include <string>
+
+// frames it takes to go from one cell to the next
+static constexpr int StepFrames = 8;
+
+// how far the view turns away from the way it is walking, and how many frames a full swing takes
+static constexpr float SwingAngle = 45 * DEG2RAD;
+static constexpr int SwingFrames = 120;
+
+bool CameraPath::Write(std::string_view filepath) const
+{
+    FILE* fp = fopen(std::string(filepath).c_str(), "w");
+    if (!fp)
+        return false;
+
+    bool valid = true;
+    for (const auto& frame : Frames)
+        valid &= fprintf(fp, "%.9g %.9g %.9g %.9g\n", frame.Position.x, frame.Position.y, frame.Facing.x, frame.Facing.y) > 0;
+
+    fclose(fp);
+    return valid;
+}
+
+bool CameraPath::Read(std::string_view filepath)
+{
+    Frames.clear();
+
+    FILE* fp = fopen(std::string(filepath).c_str(), "r");
+    if (!fp)
+        return false;
+
+    EntityLocation frame;
+    while (fscanf(fp, "%f %f %f %f", &frame.Position.x, &frame.Position.y, &frame.Facing.x, &frame.Facing.y) == 4)
+        Frames.push_back(frame);
+
+    bool valid = feof(fp) != 0;
+    fclose(fp);
+
+    return valid && !Frames.empty();
+}
+
+// a depth first walk over the open cells, going back over the cells it came through when it reaches a dead end
+// every step is between two cells that share an edge, so the view never goes through a wall
+void CameraPath::BuildScripted(const Map& map, int frameCount)
+{
+    Frames.clear();
+
+    int start = -1;
+    for (int i = 0; i < map.GetWidth() * map.GetHeight() && start < 0; i++)
+    {
+        int x = 0;
+        int y = 0;
+        map.GetCellXY(i, x, y);
+        if (map.GetCellPassable(x, y))
+            start = i;
+    }
+
+    if (start < 0 || frameCount <= 0)
+        return;
+
+    const int offsets[4][2] = { {1, 0}, {0, 1}, {-1, 0}, {0, -1} };
+
+    std::vector<uint8_t> visited(size_t(map.GetWidth()) * map.GetHeight(), 0);
+    std::vector<int> stack;
+    stack.push_back(start);
+    visited[start] = 1;
+
+    int current = start;
+    Vector2 heading = { 1, 0 };
+    size_t walkStart = 0;
+
+    while (int(Frames.size()) < frameCount)
+    {
+        int x = 0;
+        int y = 0;
+        map.GetCellXY(current, x, y);
+
+        // the next cell that has not been walked yet, or back to the one before
+        int next = -1;
+        for (const auto& offset : offsets)
+        {
+            int nextX = x + offset[0];
+            int nextY = y + offset[1];
+            if (!map.GetCellPassable(nextX, nextY) || visited[map.GetCellIndex(nextX, nextY)])
+                continue;
+
+            next = map.GetCellIndex(nextX, nextY);
+            visited[next] = 1;
+            stack.push_back(next);
+            break;
+        }
+
+        if (next < 0)
+        {
+            stack.pop_back();
+
+            // walked everything, start over
+            if (stack.empty())
+            {
+                // a cell with no open neighbors, so just look around
+                if (Frames.size() == walkStart)
+                {
+                    while (int(Frames.size()) < frameCount)
+                        Frames.push_back(EntityLocation{ Vector2{ x + 0.5f, y + 0.5f }, Vector2Rotate(heading, Frames.size() * 2 * PI / SwingFrames) });
+                    break;
+                }
+
+                walkStart = Frames.size();
+                visited.assign(visited.size(), 0);
+                visited[current] = 1;
+                stack.push_back(current);
+                continue;
+            }
+
+            next = stack.back();
+        }
+
+        int nextX = 0;
+        int nextY = 0;
+        map.GetCellXY(next, nextX, nextY);
+
+        Vector2 from = { x + 0.5f, y + 0.5f };
+        Vector2 to = { nextX + 0.5f, nextY + 0.5f };
+        heading = Vector2Normalize(Vector2Subtract(to, from));
+
+        for (int i = 0; i < StepFrames && int(Frames.size()) < frameCount; i++)
+        {
+            float swing = sinf(Frames.size() * 2 * PI / SwingFrames) * SwingAngle;
+
+            EntityLocation frame;
+            frame.Position = Vector2Lerp(from, to, float(i) / StepFrames);
+            frame.Facing = Vector2Rotate(heading, swing);
+            Frames.push_back(frame);
+        }
+
+        current = next;
+    }
+}
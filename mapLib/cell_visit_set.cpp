@@ -0,0 +1,55 @@
+#include "cell_visit_set.h"
+
+// mixes all the bits of the index, cells in the same column of a power of two wide map only differ in the high bits
+static inline size_t HashCell(int cellIndex, size_t mask)
+{
+    uint32_t hash = uint32_t(cellIndex);
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash & mask;
+}
+
+void CellVisitSet::Clear()
+{
+    Slots.assign(Slots.size(), -1);
+    Cells.clear();
+}
+
+bool CellVisitSet::Insert(int cellIndex)
+{
+    // keep the table at most half full
+    if ((Cells.size() + 1) * 2 > Slots.size())
+        Grow();
+
+    size_t mask = Slots.size() - 1;
+    for (size_t slot = HashCell(cellIndex, mask); ; slot = (slot + 1) & mask)
+    {
+        if (Slots[slot] == cellIndex)
+            return false;
+
+        if (Slots[slot] < 0)
+        {
+            Slots[slot] = cellIndex;
+            Cells.push_back(cellIndex);
+            return true;
+        }
+    }
+}
+
+void CellVisitSet::Grow()
+{
+    Slots.assign(Slots.empty() ? 1024 : Slots.size() * 2, -1);
+
+    size_t mask = Slots.size() - 1;
+    for (int cellIndex : Cells)
+    {
+        size_t slot = HashCell(cellIndex, mask);
+        while (Slots[slot] >= 0)
+            slot = (slot + 1) & mask;
+
+        Slots[slot] = cellIndex;
+    }
+}
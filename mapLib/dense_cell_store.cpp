@@ -0,0 +1,107 @@
+#include "dense_cell_store.h"
+#include "map_image.h"
+
+#include <utility>
+
+DenseCellStore::DenseCellStore(const DenseCellStore& other)
+{
+    CopyFrom(other);
+}
+
+DenseCellStore& DenseCellStore::operator= (const DenseCellStore& other)
+{
+    if (this != &other)
+        CopyFrom(other);
+
+    return *this;
+}
+
+// a vector keeps its buffer when it is moved, so the plane pointers stay good
+DenseCellStore::DenseCellStore(DenseCellStore&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+DenseCellStore& DenseCellStore::operator= (DenseCellStore&& other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    States = std::move(other.States);
+    Tiles = std::move(other.Tiles);
+    Flags = std::move(other.Flags);
+    Image = std::move(other.Image);
+
+    Count = other.Count;
+    StateData = other.StateData;
+    TileData = other.TileData;
+    FlagData = other.FlagData;
+
+    other.Clear();
+    return *this;
+}
+
+void DenseCellStore::CopyFrom(const DenseCellStore& other)
+{
+    Image.reset();
+
+    States.assign(other.StateData, other.StateData + other.Count);
+    Tiles.assign(other.TileData, other.TileData + other.Count);
+    Flags.assign(other.FlagData, other.FlagData + other.Count);
+
+    Count = other.Count;
+    Bind();
+}
+
+void DenseCellStore::Bind()
+{
+    StateData = States.data();
+    TileData = Tiles.data();
+    FlagData = Flags.data();
+}
+
+void DenseCellStore::Resize(size_t count, const MapCell& fill)
+{
+    if (Image)
+    {
+        DenseCellStore copy(*this);
+        *this = std::move(copy);
+    }
+
+    States.resize(count, fill.State);
+    Tiles.resize(count, fill.Tile);
+    Flags.resize(count, fill.Flags);
+
+    Count = count;
+    Bind();
+}
+
+void DenseCellStore::Clear()
+{
+    States = std::vector<CellState>();
+    Tiles = std::vector<uint8_t>();
+    Flags = std::vector<uint8_t>();
+    Image.reset();
+
+    Count = 0;
+    Bind();
+}
+
+void DenseCellStore::UseImage(const std::shared_ptr<MapImage>& image)
+{
+    Clear();
+
+    if (!image)
+        return;
+
+    Image = image;
+    Count = size_t(image->GetWidth()) * image->GetHeight();
+    StateData = image->GetStates();
+    TileData = image->GetTiles();
+    FlagData = image->GetFlags();
+}
+
+size_t DenseCellStore::GetMemoryUse() const
+{
+    return States.capacity() * sizeof(CellState) + Tiles.capacity() + Flags.capacity();
+}
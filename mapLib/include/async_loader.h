@@ -0,0 +1,123 @@
+#pragma once
+
+#include "raylib.h"
+
+#include "map.h"
+#include "lock_free_queue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// one load handed to an AsyncLoader, shared between the thread that queued it and the thread running it
+class LoadTask
+{
+public:
+    LoadTask(std::string_view name) : Name(name) {}
+
+    inline const std::string& GetName() const { return Name; }
+
+    // from 0 to 1, set by the work as it goes
+    inline float GetProgress() const { return Progress.load(std::memory_order_relaxed); }
+    inline void SetProgress(float progress) { Progress.store(progress, std::memory_order_relaxed); }
+
+    // asks the work to stop, a cancelled task never succeeds even if its work had already finished
+    inline void Cancel() { Cancelled.store(true); }
+    inline bool IsCancelled() const { return Cancelled.load(); }
+
+    // true once the result has been handed over, in AsyncLoader::Update
+    inline bool IsDone() const { return Done.load(); }
+    inline bool Succeeded() const { return Success.load(); }
+
+protected:
+    friend class AsyncLoader;
+
+    std::string Name;
+    std::atomic<float> Progress = { 0 };
+    std::atomic<bool> Cancelled = { false };
+    std::atomic<bool> Done = { false };
+    std::atomic<bool> Success = { false };
+};
+
+// runs loads on worker threads, so reading files, unpacking maps and decoding images never stall a frame
+// finished loads come back through a lock free queue and are handed over in Update, on the thread that owns the window
+// that is where anything that needs the GPU, like making a texture from an image, has to happen
+class AsyncLoader
+{
+public:
+    // runs on a worker thread, false if the load failed or saw that it was cancelled
+    using WorkFunction = std::function<bool(LoadTask& task)>;
+
+    // runs in Update, always, so whatever the work made can be released when it is not used
+    using FinishFunction = std::function<void(bool loaded)>;
+
+    // no threads are started until something is queued, 0 threads picks a count from the cores
+    AsyncLoader(int threadCount = 0);
+    ~AsyncLoader();
+
+    // non copyable
+    AsyncLoader(const AsyncLoader&) = delete;
+    AsyncLoader& operator= (const AsyncLoader&) = delete;
+
+    std::shared_ptr<LoadTask> Queue(std::string_view name, WorkFunction work, FinishFunction finish);
+
+    // onLoaded is only called for a load that worked and was not cancelled
+    std::shared_ptr<LoadTask> QueueMap(std::string_view filepath, MapStorage storage, std::function<void(Map& map)> onLoaded);
+
+    // the image is unloaded after onLoaded returns, so it has to be used or copied there
+    std::shared_ptr<LoadTask> QueueImage(std::string_view filepath, std::function<void(Image& image)> onLoaded);
+    std::shared_ptr<LoadTask> QueueTexture(std::string_view filepath, std::function<void(Texture2D texture)> onLoaded);
+
+    // call once a frame, finishes every load that has come back since the last call
+    void Update();
+
+    void CancelAll();
+
+    // loads queued and not yet finished
+    inline int GetPendingCount() const { return int(Active.size()); }
+
+    // over everything queued since the loader was last idle
+    float GetProgress() const;
+
+protected:
+    struct Job
+    {
+        std::shared_ptr<LoadTask> Task;
+        WorkFunction Work;
+        FinishFunction Finish;
+    };
+
+    struct Result
+    {
+        std::shared_ptr<LoadTask> Task;
+        FinishFunction Finish;
+        bool Loaded = false;
+    };
+
+    void StartWorkers();
+    void WorkerLoop();
+
+    void FinishResult(Result& result);
+
+    int ThreadCount = 0;
+    std::vector<std::thread> Workers;
+
+    // only used on the thread that calls Update
+    std::vector<std::shared_ptr<LoadTask>> Active;
+    int FinishedCount = 0;
+
+    // shared with the workers
+    std::mutex Lock;
+    std::condition_variable WakeWorkers;
+    std::deque<Job> Jobs;
+    bool Quit = false;
+
+    LockFreeQueue<Result> Results;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "entity_location.h"
+#include "map.h"
+
+#include <string_view>
+#include <vector>
+
+// one view location per frame, recorded in the game or scripted from a map, so the same frames can be cast again
+class CameraPath
+{
+public:
+    inline void AddFrame(const EntityLocation& loc) { Frames.push_back(loc); }
+    inline void Clear() { Frames.clear(); }
+
+    inline const std::vector<EntityLocation>& GetFrames() const { return Frames; }
+    inline size_t GetFrameCount() const { return Frames.size(); }
+
+    // text, one frame per line as position x, y then facing x, y, written so they read back exactly
+    bool Write(std::string_view filepath) const;
+    bool Read(std::string_view filepath);
+
+    // walk every open cell that can be reached from the first one, turning side to side while going
+    // the walk only depends on the map, so two runs on the same map get the same frames
+    void BuildScripted(const Map& map, int frameCount);
+
+protected:
+    std::vector<EntityLocation> Frames;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+// a set of cell indexes that keeps the order they were added in
+// used to collect visited cells on a thread without touching a map sized buffer
+class CellVisitSet
+{
+public:
+    void Clear();
+
+    // returns true if the cell was not already in the set
+    bool Insert(int cellIndex);
+
+    inline const std::vector<int>& GetCells() const { return Cells; }
+
+protected:
+    void Grow();
+
+    std::vector<int> Slots;
+    std::vector<int> Cells;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "map_cell.h"
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+class MapImage;
+
+// the cells of a dense map, with the states, tiles and flags each in their own plane
+// the planes are either kept here or are the pages of a mapped map image, which the system copies one page at a time as they are written to
+class DenseCellStore
+{
+public:
+    DenseCellStore() = default;
+
+    // a copy always keeps its own planes, a mapped image's written pages can't be shared
+    DenseCellStore(const DenseCellStore& other);
+    DenseCellStore& operator= (const DenseCellStore& other);
+
+    DenseCellStore(DenseCellStore&& other) noexcept;
+    DenseCellStore& operator= (DenseCellStore&& other) noexcept;
+
+    inline size_t GetCount() const { return Count; }
+
+    inline CellState* GetStates() { return StateData; }
+    inline const CellState* GetStates() const { return StateData; }
+    inline uint8_t* GetTiles() { return TileData; }
+    inline const uint8_t* GetTiles() const { return TileData; }
+    inline uint8_t* GetFlags() { return FlagData; }
+    inline const uint8_t* GetFlags() const { return FlagData; }
+
+    // keeps the cells in order, new cells are the fill cell
+    // a mapped image is copied into the store first
+    void Resize(size_t count, const MapCell& fill = MapCell());
+    void Clear();
+
+    // use the planes of an image in place, nothing is copied
+    void UseImage(const std::shared_ptr<MapImage>& image);
+    inline bool IsMapped() const { return Image != nullptr; }
+
+    // bytes of planes kept here, a mapped image's pages belong to the system
+    size_t GetMemoryUse() const;
+
+protected:
+    void CopyFrom(const DenseCellStore& other);
+    void Bind();
+
+    std::vector<CellState> States;
+    std::vector<uint8_t> Tiles;
+    std::vector<uint8_t> Flags;
+
+    std::shared_ptr<MapImage> Image;
+
+    size_t Count = 0;
+    CellState* StateData = nullptr;
+    uint8_t* TileData = nullptr;
+    uint8_t* FlagData = nullptr;
+};
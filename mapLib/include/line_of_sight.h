@@ -0,0 +1,62 @@
+#pragma once
+
+#include "map.h"
+#include "raycaster.h"
+#include "worker_pool.h"
+
+#include <memory>
+
+// one line of sight check, from an agent to a target
+struct LineOfSightQuery
+{
+    Vector2 Origin = { 0 };
+    Vector2 Target = { 0 };
+};
+
+struct LineOfSightResult
+{
+    bool Visible = false;
+
+    // the distance to the target when it is visible, or to the first blocking cell when it is not
+    float Distance = 0;
+};
+
+// answers batches of line of sight checks against a map, independent of any camera
+class LineOfSight
+{
+public:
+    LineOfSight(const Map* map);
+
+    void SetMap(const Map* map);
+
+    // split large batches across worker threads, 1 runs everything on the calling thread
+    void SetThreadCount(int threads);
+    inline int GetThreadCount() const { return Workers ? Workers->GetThreadCount() : 1; }
+
+    // use the cells a raycaster saw this frame from viewerPos
+    // a query that targets the viewer's cell from a cell the raycaster marked visible is answered without walking the grid,
+    // when the two cells are also in one empty block of the map's occupancy pyramid, anything else is walked
+    void SetViewer(const Raycaster* raycaster, const Vector2& viewerPos);
+
+    void Query(const LineOfSightQuery* queries, LineOfSightResult* results, size_t count);
+    LineOfSightResult Query(const LineOfSightQuery& query) const;
+
+    // how many queries in the last batch needed a grid walk
+    inline int GetWalkCount() const { return WalkCount; }
+
+protected:
+    bool CheckViewerCache(const LineOfSightQuery& query, LineOfSightResult& result) const;
+    bool IsInEmptyBlock(int x1, int y1, int x2, int y2) const;
+    void WalkGrid(const LineOfSightQuery& query, LineOfSightResult& result) const;
+
+    const Map* WorldMap = nullptr;
+
+    const Raycaster* Viewer = nullptr;
+    int ViewerCellX = -1;
+    int ViewerCellY = -1;
+
+    int WalkCount = 0;
+    std::vector<int> JobWalkCounts;
+
+    std::unique_ptr<WorkerPool> Workers;
+};
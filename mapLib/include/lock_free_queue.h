@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// a queue any number of threads can push to without a lock, with one thread popping
+// each push swaps itself in as the newest node and then links the one before it to itself
+// a pop can miss a push that is halfway done, it is picked up by the next pop
+template<typename T>
+class LockFreeQueue
+{
+public:
+    LockFreeQueue()
+    {
+        Node* empty = new Node();
+        Newest.store(empty, std::memory_order_relaxed);
+        Oldest = empty;
+    }
+
+    ~LockFreeQueue()
+    {
+        while (Oldest)
+        {
+            Node* next = Oldest->Next.load(std::memory_order_relaxed);
+            delete(Oldest);
+            Oldest = next;
+        }
+    }
+
+    // non copyable
+    LockFreeQueue(const LockFreeQueue&) = delete;
+    LockFreeQueue& operator= (const LockFreeQueue&) = delete;
+
+    // safe from any thread
+    void Push(T&& value)
+    {
+        Node* node = new Node();
+        node->Value = std::move(value);
+
+        Node* previous = Newest.exchange(node, std::memory_order_acq_rel);
+        previous->Next.store(node, std::memory_order_release);
+    }
+
+    // only from the one thread that pops
+    bool Pop(T& value)
+    {
+        // the oldest node is always one that has already been popped, its next is the front of the queue
+        Node* front = Oldest->Next.load(std::memory_order_acquire);
+        if (!front)
+            return false;
+
+        value = std::move(front->Value);
+        front->Value = T();
+
+        delete(Oldest);
+        Oldest = front;
+        return true;
+    }
+
+protected:
+    struct Node
+    {
+        T Value = T();
+        std::atomic<Node*> Next = { nullptr };
+    };
+
+    std::atomic<Node*> Newest;
+    Node* Oldest = nullptr;
+};
@@ -1,5 +1,12 @@
 #pragma once
 
+#include "dense_cell_store.h"
+#include "map_cell.h"
+#include "map_chunks.h"
+#include "occupancy_grid.h"
+#include "occupancy_pyramid.h"
+
+#include <memory>
 #include <stdint.h>
 #include <vector>
 
@@ -17,26 +24,20 @@ struct Vector2i
     }
 };
 
-enum class CellState : uint8_t
-{
-	Empty = 0,
-	Solid = 1,
-    Door = 2,
-};
-
-enum class DoorFlags : uint8_t
+// a rectangle of cells changed by one edit, inclusive, a single cell edit has the same min and max
+struct MapEditArea
 {
-    None = 0,
-    YOrient = 0x01,
-    SplitOpen = 0x02,
-    PosOpen = 0x04,
+    int MinX = 0;
+    int MinY = 0;
+    int MaxX = -1;
+    int MaxY = -1;
 };
 
-struct MapCell
+// how a map keeps its cells, dense is one cell after another, chunked is for maps too large for that
+enum class MapStorage : uint8_t
 {
-    CellState State = CellState::Empty;
-    uint8_t Tile = 1;
-    uint8_t Flags = 0;
+    Dense = 0,
+    Chunked = 1,
 };
 
 class Map
@@ -72,13 +73,105 @@ public:
         return Vector2i(int(index / Width), int(index % Width));
     }
 
-    inline std::vector<MapCell>& GetCellsList() { return Cells; }
+    // each part of the dense cells kept in its own array, so a reader that only needs one of them only touches that one
+    // empty when the map is chunked, call UpdateOccupancy after changing states through them
+    inline CellPlane<CellState> GetStatePlane() { return CellPlane<CellState>(Dense.GetStates(), Dense.GetCount()); }
+    inline CellPlane<const CellState> GetStatePlane() const { return CellPlane<const CellState>(Dense.GetStates(), Dense.GetCount()); }
+    inline CellPlane<uint8_t> GetTilePlane() { return CellPlane<uint8_t>(Dense.GetTiles(), Dense.GetCount()); }
+    inline CellPlane<const uint8_t> GetTilePlane() const { return CellPlane<const uint8_t>(Dense.GetTiles(), Dense.GetCount()); }
+    inline CellPlane<uint8_t> GetFlagPlane() { return CellPlane<uint8_t>(Dense.GetFlags(), Dense.GetCount()); }
+    inline CellPlane<const uint8_t> GetFlagPlane() const { return CellPlane<const uint8_t>(Dense.GetFlags(), Dense.GetCount()); }
+
+    // use a mapped image as the map's cells in place, the map becomes dense and its old cells are dropped
+    // the map can be edited as usual, the image's pages are copied as they are written to
+    void UseImage(const std::shared_ptr<MapImage>& image);
+    inline bool IsMapped() const { return Dense.IsMapped(); }
+
+    // switch how the cells are kept, the cells themselves do not change
+    void SetStorage(MapStorage storage);
+    inline MapStorage GetStorage() const { return Storage; }
+    inline const MapChunkStore& GetChunks() const { return Chunks; }
+
+    // bytes used to keep the cells, not counting the occupancy or the pages of a mapped image
+    size_t GetCellMemoryUse() const;
+
+    // read a cell in either storage, the cell must be inside the map
+    inline MapCell GetCell(int x, int y) const
+    {
+        if (Storage == MapStorage::Chunked)
+            return Chunks.GetCell(x, y);
+
+        int index = y * Width + x;
+        MapCell cell;
+        cell.State = Dense.GetStates()[index];
+        cell.Tile = Dense.GetTiles()[index];
+        cell.Flags = Dense.GetFlags()[index];
+        return cell;
+    }
+
+    // for the raycaster's inner loops, with no bounds check and only a chunk lookup when chunked
+    inline uint8_t GetCellTileUnchecked(int x, int y) const
+    {
+        if (Storage == MapStorage::Chunked)
+            return Chunks.GetCell(x, y).Tile;
+
+        return Dense.GetTiles()[y * Width + x];
+    }
+
+    // set a whole cell as one edit, keeping the occupancy up to date
+    void SetCell(int x, int y, const MapCell& cell);
+
+    // set a whole cell without updating the occupancy or recording an edit, for filling a map
+    // call UpdateOccupancy after, the same as when changing cells through the planes
+    void SetCellRaw(int x, int y, const MapCell& cell);
+
+    // call after changing cells directly through the planes or SetCellRaw, the setters keep these up to date on their own
+    void UpdateOccupancy();
+    inline const OccupancyPyramid& GetOccupancy() const { return Occupancy; }
+    inline const OccupancyGrid& GetSolidGrid() const { return SolidGrid; }
 
     void Resize(int newWidth, int newHeight);
 
+    // resize without updating the occupancy, for a map that is about to be filled with SetCellRaw
+    void ResizeRaw(int newWidth, int newHeight);
+
+    // for streamed maps, which are always chunked
+    // start over with every cell unknown, the chunks are then set as they are loaded
+    void ResetUnknown(int width, int height);
+
+    // swap in a loaded chunk, or put an unknown one back, and update the occupancy under it
+    // this is one edit to the map covering the chunk's cells, so anything following the edits only updates that area
+    void SetChunk(int chunkX, int chunkY, MapChunkStore::Chunk&& chunk);
+    void UnloadChunk(int chunkX, int chunkY);
+
+    // changes with every edit and is never reused, so two maps with the same version have the same cells
+    inline uint64_t GetVersion() const { return Version; }
+
+    // the areas edited since a version of this map, false if that version is too old or was not this map's
+    bool GetEditsSince(uint64_t version, std::vector<MapEditArea>& areas) const;
+
 protected:
+    void RecordEdit(int minX, int minY, int maxX, int maxY);
+    void ClearEdits();
+
+    struct MapEdit
+    {
+        uint64_t PreviousVersion = 0;
+        MapEditArea Area;
+    };
+
+    static constexpr size_t RecentEditLimit = 256;
+
+    uint64_t Version = 0;
+    std::vector<MapEdit> RecentEdits;
+    size_t NextEdit = 0;
 
     int Width = 0;
     int Height = 0;
-    std::vector<MapCell> Cells;
+    MapStorage Storage = MapStorage::Dense;
+    DenseCellStore Dense;
+    MapChunkStore Chunks;
+
+    OccupancyPyramid Occupancy;
+    OccupancyGrid SolidGrid;
 };
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum class CellState : uint8_t
+{
+	Empty = 0,
+	Solid = 1,
+    Door = 2,
+};
+
+enum class DoorFlags : uint8_t
+{
+    None = 0,
+    YOrient = 0x01,
+    SplitOpen = 0x02,
+    PosOpen = 0x04,
+};
+
+struct MapCell
+{
+    CellState State = CellState::Empty;
+    uint8_t Tile = 1;
+    uint8_t Flags = 0;
+
+    // a cell of a streamed map that has not been loaded, solid so nothing walks into it or sees past it
+    // its tile is not in the tile texture, so the renderer draws nothing for it
+    static constexpr uint8_t UnknownTile = 255;
+
+    static inline MapCell Unknown()
+    {
+        MapCell cell;
+        cell.State = CellState::Solid;
+        cell.Tile = UnknownTile;
+        return cell;
+    }
+
+    inline bool IsUnknown() const { return State == CellState::Solid && Tile == UnknownTile; }
+
+    inline bool operator==(const MapCell& other) const { return State == other.State && Tile == other.Tile && Flags == other.Flags; }
+    inline bool operator!=(const MapCell& other) const { return !(*this == other); }
+};
+
+// a pointer and a count over one plane of cells
+// the part of std::span the map needs, with the same names so it can be swapped for it once the project is past C++17
+template <typename T>
+class CellPlane
+{
+public:
+    CellPlane() = default;
+    CellPlane(T* data, size_t size) : Data(data), Size(size) {}
+
+    // a writable plane can be read through a const one
+    template <typename U>
+    CellPlane(const CellPlane<U>& other) : Data(other.data()), Size(other.size()) {}
+
+    inline T* data() const { return Data; }
+    inline size_t size() const { return Size; }
+    inline bool empty() const { return Size == 0; }
+
+    inline T& operator[](size_t index) const { return Data[index]; }
+
+    inline T* begin() const { return Data; }
+    inline T* end() const { return Data + Size; }
+
+protected:
+    T* Data = nullptr;
+    size_t Size = 0;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "map_cell.h"
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+// map cells kept in 64x64 chunks, for maps too large to keep every cell
+// a chunk that is all the same cell keeps just that cell, the others keep a palette of their cells and a packed index into it for each cell
+class MapChunkStore
+{
+public:
+    static constexpr int ChunkShift = 6;
+    static constexpr int ChunkSize = 1 << ChunkShift;
+    static constexpr int ChunkMask = ChunkSize - 1;
+    static constexpr int ChunkCells = ChunkSize * ChunkSize;
+
+    struct Chunk
+    {
+        // one entry when the chunk is uniform, cells that are no longer used stay in it until the chunk is compacted
+        std::vector<MapCell> Palette;
+
+        // 0 when the chunk is uniform, otherwise 1, 2, 4, 8 or 16 so an index never spans two words
+        int IndexBits = 0;
+        std::vector<uint64_t> Indices;
+
+        inline const MapCell& GetCell(int localIndex) const
+        {
+            if (IndexBits == 0)
+                return Palette[0];
+
+            int bit = localIndex * IndexBits;
+            return Palette[(Indices[bit >> 6] >> (bit & 63)) & ((uint64_t(1) << IndexBits) - 1)];
+        }
+
+        void SetCell(int localIndex, const MapCell& cell);
+
+        // every cell set to one cell
+        void Fill(const MapCell& cell);
+
+        // drop the palette entries no cell uses, and go back to uniform if only one is left
+        void Compact();
+
+        size_t GetMemoryUse() const;
+
+    protected:
+        void SetIndexBits(int bits);
+        int GetPaletteIndex(int localIndex) const;
+    };
+
+    // every cell is set to the fill cell
+    void Resize(int width, int height, const MapCell& fill = MapCell());
+    void Clear();
+
+    inline int GetWidth() const { return Width; }
+    inline int GetHeight() const { return Height; }
+    inline int GetChunksX() const { return ChunksX; }
+    inline int GetChunksY() const { return ChunksY; }
+
+    // chunks by their own position, for moving whole chunks in and out
+    inline const Chunk& GetChunkAt(int chunkX, int chunkY) const { return Chunks[chunkY * ChunksX + chunkX]; }
+    inline void SetChunkAt(int chunkX, int chunkY, Chunk&& chunk) { Chunks[chunkY * ChunksX + chunkX] = std::move(chunk); }
+
+    // the cell must be inside the map
+    inline const Chunk& GetChunk(int x, int y) const { return Chunks[(y >> ChunkShift) * ChunksX + (x >> ChunkShift)]; }
+    inline const MapCell& GetCell(int x, int y) const { return GetChunk(x, y).GetCell(((y & ChunkMask) << ChunkShift) | (x & ChunkMask)); }
+
+    inline void SetCell(int x, int y, const MapCell& cell)
+    {
+        Chunks[(y >> ChunkShift) * ChunksX + (x >> ChunkShift)].SetCell(((y & ChunkMask) << ChunkShift) | (x & ChunkMask), cell);
+    }
+
+    void Compact();
+
+    // bytes used by the chunks, their palettes and indexes
+    size_t GetMemoryUse() const;
+    int GetUniformChunkCount() const;
+
+protected:
+    int Width = 0;
+    int Height = 0;
+    int ChunksX = 0;
+    int ChunksY = 0;
+    std::vector<Chunk> Chunks;
+};
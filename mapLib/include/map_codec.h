@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// a small byte codec for map planes, runs of one byte are stored as a count and repeats of earlier bytes as a copy from behind
+// maps are mostly long runs of the same cell and rows that repeat the one above, so both are cheap to find and to expand
+class MapCodec
+{
+public:
+    // appends the packed bytes to the output
+    static void Compress(const uint8_t* data, size_t size, std::vector<uint8_t>& packed);
+
+    // false if the packed bytes are damaged or do not expand to exactly the output size
+    static bool Decompress(const uint8_t* packed, size_t packedSize, uint8_t* data, size_t size);
+
+    // CRC-32, the same one zip uses, pass the last result back in to continue it
+    static uint32_t GetChecksum(const uint8_t* data, size_t size, uint32_t checksum = 0);
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "map_mesh.h"
+
+#include <stdint.h>
+#include <vector>
+
+// the faces of every cell built ahead of time, so drawing a cell is a copy of its block of vertices
+// the cells are kept in chunks, each built the first time one of its cells is asked for
+// Update follows the map's edits and only rebuilds the chunks around the cells that changed
+class MapFaceCache
+{
+public:
+    static constexpr int ChunkSize = 32;
+
+    struct Chunk
+    {
+        // the faces of the chunk's cells, one cell after another in rows
+        MapMeshData Data;
+
+        // where each cell's faces start in the data, with one more entry past the last cell
+        std::vector<uint16_t> FirstFaces;
+        std::vector<uint8_t> FaceMasks;
+
+        // the same faces merged by the greedy mesher, made the first time they are asked for after each build
+        MapMeshData Merged;
+        bool MergedBuilt = false;
+
+        // changes each time the chunk is built, 0 when it never was
+        uint64_t Revision = 0;
+        bool Dirty = true;
+    };
+
+    // a cell's block of faces, in its chunk's data
+    struct CellFaces
+    {
+        const MapMeshData* Data = nullptr;
+        int FirstFace = 0;
+        int FaceCount = 0;
+        uint8_t FaceMask = 0;
+    };
+
+    // drops every chunk when the map or the texture is not the one they were built for
+    void SetMap(const Map* map);
+    void SetAtlasSize(int width, int height);
+
+    // marks the chunks holding edited cells and their neighbours, call once a frame before reading cells
+    void Update();
+
+    // a cell outside the map has no faces
+    CellFaces GetCell(int x, int y);
+
+    // built if it is not up to date, null outside the map
+    const Chunk* GetChunk(int chunkX, int chunkY);
+
+    // the chunk's faces with the touching faces that share a plane and a tile merged, null outside the map
+    const MapMeshData* GetMergedChunk(int chunkX, int chunkY);
+
+    // for making more faces the same way as the cached ones
+    inline const MapMeshBuilder& GetBuilder() const { return Builder; }
+
+    inline int GetChunksX() const { return ChunksX; }
+    inline int GetChunksY() const { return ChunksY; }
+
+    void Clear();
+
+protected:
+    void MarkDirty(int minX, int minY, int maxX, int maxY);
+    void BuildChunk(Chunk& chunk, int chunkX, int chunkY);
+
+    const Map* CachedMap = nullptr;
+    MapMeshBuilder Builder;
+
+    std::vector<Chunk> Chunks;
+    int ChunksX = 0;
+    int ChunksY = 0;
+    int MapWidth = 0;
+    int MapHeight = 0;
+    uint64_t MapVersion = 0;
+    std::vector<MapEditArea> EditedAreas;
+    std::vector<CellFace> MergeFaces;
+
+    uint64_t NextRevision = 1;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "map.h"
+
+#include <stdint.h>
+
+enum class MapStyle
+{
+    // one cell wide passages, every open cell reached by exactly one path
+    Maze,
+
+    // smoothed noise, open caverns of all sizes, not all of them joined
+    Cave,
+
+    // a room in each block of the map, joined by corridors
+    Rooms,
+
+    // one big open space with pillars spread over it
+    Arena,
+};
+
+// builds maps for scaling tests, the same seed and size always give the same cells on any machine
+// the random numbers come from the seed and the cell, not from the standard library, whose distributions differ between compilers
+class MapGenerator
+{
+public:
+    static constexpr int MinSize = 64;
+    static constexpr int MaxSize = 16384;
+
+    MapGenerator(uint64_t seed);
+
+    // resizes the map and replaces every cell, in whichever storage the map uses, the sizes are clamped to MinSize and MaxSize
+    void Generate(Map& map, MapStyle style, int width, int height);
+
+    static const char* GetStyleName(MapStyle style);
+    static bool FindStyle(const char* name, MapStyle& style);
+
+protected:
+    uint64_t Random();
+    int RandomRange(int min, int max);
+
+    uint64_t GetCellHash(int x, int y, uint64_t salt) const;
+    uint8_t GetWallTile(int x, int y) const;
+
+    void Fill(Map& map, CellState state);
+    void SetCell(Map& map, int x, int y, CellState state);
+    void SetFlags(Map& map, int x, int y, uint8_t flags);
+    void CarveRect(Map& map, int minX, int minY, int maxX, int maxY);
+
+    void BuildMaze(Map& map);
+    void BuildCave(Map& map);
+    void BuildRooms(Map& map);
+    void BuildArena(Map& map);
+
+    uint64_t Seed = 0;
+    uint64_t State = 0;
+};
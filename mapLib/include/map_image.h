@@ -0,0 +1,55 @@
+#pragma once
+
+#include "map_cell.h"
+
+#include <memory>
+#include <stdint.h>
+#include <string_view>
+
+class Map;
+
+// a map saved the way a dense map keeps its cells, so the file can be mapped into memory and used as the map's planes with no parsing
+// little endian, with a fixed header and each plane starting on its own page
+// the mapping is copy on write, editing a cell copies only the page it is on and the file is never changed
+class MapImage
+{
+public:
+    ~MapImage();
+
+    // non copyable
+    MapImage(const MapImage&) = delete;
+    MapImage& operator= (const MapImage&) = delete;
+
+    // works from either storage
+    static bool Write(const Map& map, std::string_view filepath);
+
+    // true if the first bytes of a file are an image header
+    static bool IsImageHeader(const void* data, size_t size);
+
+    // nullptr if the file can't be mapped or is not a valid image
+    static std::shared_ptr<MapImage> Open(std::string_view filepath);
+
+    inline int GetWidth() const { return Width; }
+    inline int GetHeight() const { return Height; }
+
+    inline CellState* GetStates() { return reinterpret_cast<CellState*>(Data + StateOffset); }
+    inline uint8_t* GetTiles() { return Data + TileOffset; }
+    inline uint8_t* GetFlags() { return Data + FlagOffset; }
+
+protected:
+    MapImage() = default;
+
+    uint8_t* Data = nullptr;
+    size_t Size = 0;
+
+    int Width = 0;
+    int Height = 0;
+    uint64_t StateOffset = 0;
+    uint64_t TileOffset = 0;
+    uint64_t FlagOffset = 0;
+
+#if defined(_WIN32)
+    void* FileHandle = nullptr;
+    void* MappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "map.h"
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// one cell as it was left by an edit
+struct JournalCell
+{
+    uint32_t Index = 0;
+    MapCell Cell;
+};
+
+// an append only log of edited cells kept next to a map file, so a save only writes the cells that changed since the last one
+// each save adds a block of cells with a checksum, loading plays every whole block back over the map in order
+// a journal belongs to the base file it was started on, by the base's stamp, and is ignored once the base is written again
+class MapJournal
+{
+public:
+    // the journal for a map resource, next to it with its own extension
+    static std::string GetJournalPath(std::string_view mapPath);
+
+    // starts the journal when there is none, or one for another base
+    // a block cut short by an earlier failed write, or one that fails its checksum, is dropped first along with everything after it
+    static bool Append(std::string_view filepath, uint32_t baseStamp, const std::vector<JournalCell>& cells);
+
+    // stops at the first damaged block, false if there is no journal for this base
+    // cells are set raw, the occupancy is left for the caller to update
+    static bool Replay(std::string_view filepath, uint32_t baseStamp, Map& map);
+
+    static void Remove(std::string_view filepath);
+};
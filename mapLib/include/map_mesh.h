@@ -0,0 +1,102 @@
+#pragma once
+
+#include "map.h"
+
+#include <stdint.h>
+#include <vector>
+
+// the sides of a wall cell, as bits of a face mask
+enum class WallSide : uint8_t
+{
+    North = 0,
+    South = 1,
+    East = 2,
+    West = 3,
+};
+
+// geometry for a part of the map, in the arrays a GPU mesh is made from
+// every face is a quad of four vertices and two triangles, so the indexes fit in 16 bits for up to 16384 faces
+struct MapMeshData
+{
+    // the size of one face in each array, for copying faces from one mesh to another
+    static constexpr int FaceVertexFloats = 4 * 3;
+    static constexpr int FaceTexCoordFloats = 4 * 2;
+    static constexpr int FaceTileRangeFloats = 4 * 2;
+    static constexpr int FaceColorBytes = 4 * 4;
+    static constexpr int FaceIndexCount = 6;
+
+    std::vector<float> Vertices;    // x, y, z
+    std::vector<float> TexCoords;   // u, v
+    std::vector<float> TileRanges;  // the u where the face's tile starts and the tile's width, to wrap u in a face that repeats its tile
+    std::vector<float> Normals;     // x, y, z
+    std::vector<uint8_t> Colors;    // r, g, b, a
+    std::vector<uint16_t> Indices;
+
+    int FaceCount = 0;
+
+    inline int GetVertexCount() const { return int(Vertices.size() / 3); }
+    inline int GetTriangleCount() const { return int(Indices.size() / 3); }
+
+    void Clear();
+};
+
+// one face of one cell, as the greedy mesher takes them
+struct CellFace
+{
+    // a floor and its ceiling are one face here, they always merge the same way
+    static constexpr uint8_t FloorSide = 4;
+
+    int X = 0;
+    int Y = 0;
+    uint8_t Tile = 0;
+    uint8_t Side = FloorSide;   // a WallSide or FloorSide
+};
+
+// builds the floors, ceilings and exposed walls of map cells on the CPU, the same faces ViewRenderer draws
+// it knows nothing of the GPU, so the geometry it makes can be checked without a window
+class MapMeshBuilder
+{
+public:
+    // the tile texture is one row of square tiles, each as wide as the texture is tall
+    void SetAtlasSize(int width, int height);
+
+    // every face of the cells from min up to but not including max, appended to the mesh
+    void BuildArea(const Map& map, int minX, int minY, int maxX, int maxY, MapMeshData& mesh) const;
+
+    // the faces of one cell, a floor and a ceiling when it is empty, or the walls facing empty cells when it is solid
+    // the walls are added in the order of their sides, returns the cell's face mask
+    uint8_t BuildCell(const Map& map, int x, int y, MapMeshData& mesh) const;
+
+    // greedy meshing, faces in one plane with the same tile that touch are merged into as few quads as it can
+    // walls merge into runs along their row or column and floors into rectangles, the list is sorted in place
+    // the merged quads run u on past the end of their tile, so they need a shader that wraps u with the tile ranges
+    void BuildMerged(std::vector<CellFace>& faces, MapMeshData& mesh) const;
+
+    // the faces BuildCell makes for a cell with this face mask, as a list for BuildMerged
+    static void GetCellFaces(const Map& map, int x, int y, uint8_t faceMask, std::vector<CellFace>& faces);
+
+    // the sides of a solid cell that face an empty cell, 0 for empty and unknown cells
+    static uint8_t GetFaceMask(const Map& map, int x, int y);
+
+    // an area of floor or ceiling, or a run of walls along x for north and south sides and along y for east and west
+    void AddFloor(int x, int y, int width, int height, MapMeshData& mesh) const;
+    void AddCeiling(int x, int y, int width, int height, MapMeshData& mesh) const;
+    void AddWall(int x, int y, int length, uint8_t tile, WallSide side, MapMeshData& mesh) const;
+
+    static constexpr uint8_t FloorTile = 10;
+    static constexpr uint8_t CeilingTile = 9;
+
+protected:
+    void GetTileUs(uint8_t tile, float& uStart, float& uEnd) const;
+
+    struct QuadVertex
+    {
+        float X, Y, Z;
+        float U, V;
+    };
+
+    static void AddQuad(const QuadVertex* vertices, float tileStart, float tileWidth, float normalX, float normalY, float normalZ, uint8_t shade, MapMeshData& mesh);
+
+    int AtlasWidth = 1;
+    int AtlasHeight = 1;
+};
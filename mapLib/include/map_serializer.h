@@ -1,12 +1,52 @@
 #pragma once
 
 #include "map.h"
+#include "map_image.h"
+#include "map_journal.h"
 
+#include <functional>
+#include <stdint.h>
 #include <string_view>
+#include <vector>
+
+// a block of data kept in a map file next to the cells, under a four character id
+// for data that goes with the map, like baked visibility or objects, readers skip the sections they don't know
+struct MapFileSection
+{
+    char Id[4] = { 0 };
+    std::vector<uint8_t> Data;
+};
 
 class MapSerializer
 {
 public:
-    bool WriteResource(Map& map, std::string_view filepath);
-    Map ReadResource(std::string_view filepath);
+    // writes the current version, with every plane of the cells packed and checksummed, and any extra sections after them
+    // this is a new base, so the file's journal is removed
+    // versions 1 and 2 are still read
+    bool WriteResource(Map& map, std::string_view filepath, const std::vector<MapFileSection>& extraSections = {});
+    // an image file is mapped instead of read, when the storage is dense
+    // a current version file has its journal played back over it, see MapJournal
+    Map ReadResource(std::string_view filepath, MapStorage storage = MapStorage::Dense);
+    // the same, false when the file is missing, damaged or the read was cancelled, which leaves the map empty
+    bool ReadResource(std::string_view filepath, Map& map, MapStorage storage = MapStorage::Dense);
+
+    // the stamp of a current version file's contents, which changes whenever it is written with other cells
+    bool ReadStamp(std::string_view filepath, uint32_t& stamp);
+
+    // adds cells to the journal of a current version file, false if the file is not the base with that stamp any more
+    bool WriteJournal(std::string_view filepath, uint32_t baseStamp, const std::vector<JournalCell>& cells);
+
+    // the data of one section of a current version file, false if it has no such section or it is damaged
+    bool ReadSection(std::string_view filepath, const char id[4], std::vector<uint8_t>& data);
+
+    // a map image is the planes of a dense map as they are in memory, see MapImage
+    bool WriteImage(const Map& map, std::string_view filepath);
+    Map ReadImage(std::string_view filepath);
+
+    // called as a read goes with how far along it is, from 0 to 1, on the thread doing the read
+    // returning false cancels the read, which then gives an empty map like a damaged file does
+    std::function<bool(float progress)> OnProgress;
+
+protected:
+    bool ReportProgress(float progress) const;
 };
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "map.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// a map saved as its chunks, with a table of where each chunk is in the file so any one of them can be read on its own
+// chunks are kept with the palette and packed indexes they have in memory, so reading one is a copy and not a rebuild
+class MapStreamFile
+{
+public:
+    MapStreamFile() = default;
+    ~MapStreamFile();
+
+    // non copyable
+    MapStreamFile(const MapStreamFile&) = delete;
+    MapStreamFile& operator= (const MapStreamFile&) = delete;
+
+    // works from either storage
+    static bool Write(const Map& map, std::string_view filepath);
+
+    // the stream file for a map resource, next to it with its own extension
+    static std::string GetStreamPath(std::string_view mapPath);
+
+    // reads the header and the chunk table, the chunks are read when they are asked for
+    bool Open(std::string_view filepath);
+    void Close();
+    inline bool IsOpen() const { return File != nullptr; }
+
+    inline int GetWidth() const { return Width; }
+    inline int GetHeight() const { return Height; }
+    inline int GetChunksX() const { return ChunksX; }
+    inline int GetChunksY() const { return ChunksY; }
+    inline int GetChunkCount() const { return int(Entries.size()); }
+
+    // bytes the chunk takes in the file, close to what it takes in memory once it is read
+    inline size_t GetChunkSize(int chunkIndex) const { return Entries[chunkIndex].Size; }
+
+    // not thread safe, only one thread may read at a time
+    bool ReadChunk(int chunkIndex, MapChunkStore::Chunk& chunk);
+
+protected:
+    struct ChunkEntry
+    {
+        uint64_t Offset = 0;
+        uint32_t Size = 0;
+    };
+
+    FILE* File = nullptr;
+
+    int Width = 0;
+    int Height = 0;
+    int ChunksX = 0;
+    int ChunksY = 0;
+    std::vector<ChunkEntry> Entries;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "map.h"
+#include "map_stream_file.h"
+#include "entity_location.h"
+
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// keeps the chunks of a streamed map loaded around a viewer, reading them from a stream file on a background thread
+// chunks are wanted by their distance from the viewer, with the ones behind the view counted as further away than the ones in front
+// loaded chunks stay until the memory budget is used up, then the ones that have not been wanted for the longest are unloaded first
+// chunks that are not loaded are unknown cells, solid to collision and to rays but never drawn
+class MapStreamer
+{
+public:
+    MapStreamer(Map& map);
+    ~MapStreamer();
+
+    // non copyable
+    MapStreamer(const MapStreamer&) = delete;
+    MapStreamer& operator= (const MapStreamer&) = delete;
+
+    // open a stream file and reset the map to its size with every cell unknown
+    bool Open(std::string_view filepath);
+    void Close();
+    inline bool IsOpen() const { return File.IsOpen(); }
+
+    // bytes the loaded chunks may use, chunks that would go past it are not loaded
+    inline void SetBudget(size_t bytes) { Budget = bytes; }
+    inline size_t GetBudget() const { return Budget; }
+
+    // how far ahead of the view chunks are loaded, in chunks, to the sides and behind it is less
+    inline void SetLoadRadius(float chunks) { LoadRadius = chunks; }
+    inline float GetLoadRadius() const { return LoadRadius; }
+
+    // call once a frame, on the thread that uses the map, before it is cast or collided with
+    // chunks that finished loading are put in the map here, so the map only ever changes on this thread
+    void Update(const EntityLocation& loc);
+
+    // load the chunks around a location before returning, so the first frame does not start inside unknown cells
+    void LoadAround(const EntityLocation& loc, int radius = 1);
+
+    inline int GetLoadedCount() const { return LoadedCount; }
+    inline int GetPendingCount() const { return PendingCount; }
+    inline size_t GetMemoryUse() const { return MemoryUse; }
+
+protected:
+    enum class ChunkState : uint8_t
+    {
+        Unknown = 0,
+        Loaded,
+
+        // the file has the chunk but it could not be read, it stays unknown
+        Failed,
+    };
+
+    void LoaderLoop();
+
+    float GetChunkDistance(int chunkX, int chunkY, const EntityLocation& loc) const;
+
+    void AddChunk(int chunkIndex, MapChunkStore::Chunk&& chunk);
+    void RemoveChunk(int chunkIndex);
+
+    Map& WorldMap;
+    MapStreamFile File;
+
+    size_t Budget = size_t(64) * 1024 * 1024;
+    float LoadRadius = 8;
+
+    // only used on the thread that calls Update
+    std::vector<ChunkState> States;
+    std::vector<size_t> ChunkMemory;
+    std::vector<uint64_t> WantedFrame;
+    std::list<int> RecentChunks;
+    std::vector<std::list<int>::iterator> RecentPositions;
+    std::vector<std::pair<float, int>> Wanted;
+    std::vector<int> NewRequests;
+    uint64_t Frame = 0;
+    size_t MemoryUse = 0;
+    int LoadedCount = 0;
+    int PendingCount = 0;
+
+    // shared with the loader thread
+    std::thread Loader;
+    std::mutex Lock;
+    std::condition_variable WakeLoader;
+
+    // the file is read by the loader and by LoadAround
+    std::mutex FileLock;
+
+    // the next chunk to load is at the back
+    std::vector<int> Requests;
+    int LoadingChunk = -1;
+
+    // chunks that were read, or failed to be read, waiting to be put in the map
+    std::vector<std::pair<int, MapChunkStore::Chunk>> Finished;
+    std::vector<int> FailedChunks;
+    bool Quit = false;
+};
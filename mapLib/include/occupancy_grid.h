@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+class Map;
+
+// one bit per cell, set when the cell is solid
+// stored as 8x8 tiles packed into a uint64_t each, so cells that are near each other on either axis share a cache line
+class OccupancyGrid
+{
+public:
+    void Build(const Map& map);
+    void SetCell(int x, int y, bool solid);
+
+    inline int GetWidth() const { return Width; }
+    inline int GetHeight() const { return Height; }
+
+    // cells outside the map are not solid, the same as Map::GetCellSolid
+    inline bool IsSolid(int x, int y) const
+    {
+        if (x < 0 || x >= Width || y < 0 || y >= Height)
+            return false;
+
+        return IsSolidUnchecked(x, y);
+    }
+
+    // cells outside the map are not passable, the same as Map::GetCellPassable
+    inline bool IsPassable(int x, int y) const
+    {
+        if (x < 0 || x >= Width || y < 0 || y >= Height)
+            return false;
+
+        return !IsSolidUnchecked(x, y);
+    }
+
+    // for callers that have already checked the cell is inside the map
+    inline bool IsSolidUnchecked(int x, int y) const
+    {
+        return (Tiles[(y >> 3) * TilesWide + (x >> 3)] >> (((y & 7) << 3) | (x & 7))) & 1;
+    }
+
+protected:
+    int Width = 0;
+    int Height = 0;
+    int TilesWide = 0;
+
+    std::vector<uint64_t> Tiles;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+class Map;
+
+// levels of 2x2, 4x4, 8x8 and larger blocks of map cells, each flagging if any cell in the block is solid
+// the raycaster uses it to jump over empty space in one step
+class OccupancyPyramid
+{
+public:
+    struct Level
+    {
+        int Width = 0;
+        int Height = 0;
+        std::vector<uint8_t> Solid;
+    };
+
+    void Build(const Map& map);
+    void UpdateCell(const Map& map, int x, int y);
+
+    // the cells are inclusive
+    void UpdateRegion(const Map& map, int minX, int minY, int maxX, int maxY);
+
+    // level 1 is 2x2 blocks, level 2 is 4x4 and so on, the last level covers the whole map
+    inline int GetLevelCount() const { return int(Levels.size()); }
+    inline const Level& GetLevel(int level) const { return Levels[level - 1]; }
+
+    inline bool IsBlockEmpty(int level, int x, int y) const
+    {
+        const Level& blocks = Levels[level - 1];
+        return blocks.Solid[(y >> level) * blocks.Width + (x >> level)] == 0;
+    }
+
+    // the largest level whose block around the cell is completely empty, 0 if the smallest block has a solid cell
+    // kept for each 2x2 block, which all have the same level for their cells, so the raycaster only needs one lookup for each step
+    inline int GetEmptyLevel(int x, int y) const
+    {
+        if (x < 0 || x >= Width || y < 0 || y >= Height)
+            return 0;
+
+        return BlockLevels[(y >> 1) * BlockLevelsWide + (x >> 1)];
+    }
+
+protected:
+    bool IsBlockSolid(const Map& map, int level, int x, int y) const;
+    int FindEmptyLevel(int x, int y) const;
+    void UpdateBlockLevels(int minX, int minY, int size);
+
+    std::vector<Level> Levels;
+
+    int Width = 0;
+    int Height = 0;
+    int BlockLevelsWide = 0;
+    std::vector<uint8_t> BlockLevels;
+};
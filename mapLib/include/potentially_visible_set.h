@@ -0,0 +1,43 @@
+#pragma once
+
+#include "map.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// the cells that can be seen from anywhere inside each empty cell of a static map, baked ahead of time
+// each cell's set is stored as runs of cell indexes, written as varints: the gap since the end of the last run, then the run length
+class PotentiallyVisibleSet
+{
+public:
+    // follow every line out of every empty cell past the walls, spread over the given number of threads
+    // the sets are conservative, a cell any ray from any point in the cell reaches is in its set
+    void Bake(const Map& map, int threads = 1);
+
+    bool Write(std::string_view filepath) const;
+    bool Read(std::string_view filepath);
+
+    // the .pvs file that is stored next to a map file
+    static std::string GetSidecarPath(std::string_view mapPath);
+
+    // the sets only hold for the walls they were baked from, editing the map does not update them
+    static uint64_t GetMapHash(const Map& map);
+    inline bool IsBakedFor(const Map& map) const { return !Offsets.empty() && Width == map.GetWidth() && Height == map.GetHeight() && MapHash == GetMapHash(map); }
+
+    inline int GetWidth() const { return Width; }
+    inline int GetHeight() const { return Height; }
+    inline size_t GetDataSize() const { return Data.size(); }
+
+    // the cell indexes visible from a cell in ascending order, empty for cells that have no set
+    void GetVisibleCells(int cellIndex, std::vector<int>& cells) const;
+
+protected:
+    int Width = 0;
+    int Height = 0;
+    uint64_t MapHash = 0;
+
+    // one more than the number of cells, a cell's set is the data between its offset and the next one
+    std::vector<uint32_t> Offsets;
+    std::vector<uint8_t> Data;
+};
@@ -2,8 +2,14 @@
 
 #include "map.h"
 #include "entity_location.h"
+#include "cell_visit_set.h"
+#include "worker_pool.h"
+#include "potentially_visible_set.h"
+#include "sector_map.h"
 #include "raymath.h"
 
+#include <memory>
+
 // used to know what side of a grid was hit
 enum class HitNormals : uint8_t
 {
@@ -13,6 +19,33 @@ enum class HitNormals : uint8_t
     West
 };
 
+// how the raycaster finds the visible cells
+enum class VisibilityBackend : uint8_t
+{
+    // cast rays at screen columns, bisecting between two rays until they hit the same cell
+    RayBisection = 0,
+
+    // sweep the view as intervals of angles, clipping them against every wall they meet
+    // exact, and the cost follows the number of visible cells instead of the screen width, but no rays are produced
+    // walls are closed, so a diagonal gap between two corners lets nothing through, where a ray exactly on the corner would step past
+    BeamSweep,
+
+    // take the baked set of the viewer's cell and cull it to the view, nothing is cast
+    // the cost only depends on the size of the set, and it falls back to the ray bisection where there is no set
+    PotentiallyVisible,
+
+    // walk the rectangle sectors of the map, narrowing the view through each portal, nothing is cast
+    // suited to maps of rooms and doorways, it falls back to the ray bisection when the walk gets too long
+    SectorPortals,
+};
+
+// a wall face seen by the beam sweep
+struct VisibleFace
+{
+    Vector2i Cell;
+    HitNormals Normal = HitNormals::North;
+};
+
 // a ray that has been cast, with cached info
 struct RayResult
 {
@@ -30,6 +63,50 @@ struct RayResult
 
     int HitCellIndex = -1;
     Vector2i TargetCell;
+
+    // the ray stopped at the max view distance without a hit, the hit cell is the last cell it reached
+    // unlike a ray that left the map, there can be nearer cells between it and the next ray
+    bool PastViewDistance = false;
+};
+
+// an empty block of cells from the map's occupancy pyramid that a ray jumped over, every cell in it is visible floor
+struct VisibleBlock
+{
+    int X = 0;
+    int Y = 0;
+    int Level = 0;
+    int Size = 0;
+};
+
+// the state of the DDA walk for a single ray
+struct RayWalk
+{
+    int MapX = 0;
+    int MapY = 0;
+
+    int StepX = 0;
+    int StepY = 0;
+
+    float SideDistX = 0;
+    float SideDistY = 0;
+
+    float DeltaDistX = 0;
+    float DeltaDistY = 0;
+};
+
+// the working state for one group of casts, so that groups of columns can be cast on different threads
+struct CastContext
+{
+    int CastCount = 0;
+    int ReusedCount = 0;
+
+    // when set, visited cells go straight into the raycaster's cell status, otherwise they are collected in VisitedCells
+    bool SharedStatus = true;
+    CellVisitSet VisitedCells;
+    CellVisitSet VisitedBlocks;
+
+    std::vector<std::pair<int, int>> PendingCasts;
+    std::vector<int> EndPointList;
 };
 
 class Raycaster
@@ -42,32 +119,198 @@ public:
     inline const std::vector<RayResult>& GetResults() const { return RaySet; }
     inline const std::vector<Vector2i>& GetHitCelList() const { return HitCellLocs; }
 
+    // the empty blocks that rays skipped over, their cells are not in the hit cell list
+    inline const std::vector<VisibleBlock>& GetHitBlockList() const { return HitBlocks; }
+
     bool IsCellVis(int x, int y) const;
 
     inline int GetCastCount() const { return CastCount; }
 
+    // the wall faces the beam sweep saw, the ray bisection leaves this empty
+    inline const std::vector<VisibleFace>& GetHitFaceList() const { return HitFaces; }
+
+    // a baked PVS for the map, it has to outlive the raycaster
+    // the ray backends stop at the edge of the viewer cell's set and only report cells in it, and it is what the PotentiallyVisible backend draws from
+    void SetPVS(const PotentiallyVisibleSet* pvs);
+    inline const PotentiallyVisibleSet* GetPVS() const { return PVS; }
+
+    // kept up to date with the map's edits while the SectorPortals backend is used
+    inline const SectorMap& GetSectors() const { return Sectors; }
+
+    void SetVisibilityBackend(VisibilityBackend backend);
+    inline VisibilityBackend GetVisibilityBackend() const { return Backend; }
+
+    // rays that coherent mode filled in from the last frame instead of casting
+    inline int GetReusedCount() const { return ReusedCount; }
+
     void SetMap(const Map* map);
 
+    // jump over empty blocks of the map's occupancy pyramid instead of stepping through every cell
+    // the jump crosses the same sides the cell by cell walk does, so the rays are the same as without it, bit for bit
+    // used by the single and multi threaded casts, the visible cells are whole blocks so they can be more than the walk's
+    void SetEmptySpaceSkipping(bool enabled);
+    inline bool GetEmptySpaceSkipping() const { return EmptySpaceSkipping; }
+
+    // keep the last frame's rays and only cast the columns that could have changed
+    // a frame with the same location on an unchanged map casts nothing, turning in place reuses the old rays around each new column
+    // when they hit the same face of the same cell with no solid cell in the wedge between them, and edited cells only recast the
+    // columns they cover. Moving casts everything
+    void SetCoherentMode(bool enabled);
+    inline bool GetCoherentMode() const { return CoherentMode; }
+
+    // rays stop once they are farther than this from the view, along the facing the same as their distances, 0 for no limit
+    // only the ray casts stop early, the sweep, sector and PVS backends still find everything they can see
+    void SetMaxViewDistance(float distance);
+    inline float GetMaxViewDistance() const { return MaxViewDistance; }
+
+    // split the screen into column ranges that are cast on worker threads, 1 casts everything on the calling thread
+    // the rays and visible cells are the same as the single threaded output
+    void SetThreadCount(int threads);
+    inline int GetThreadCount() const { return Workers ? Workers->GetThreadCount() : 1; }
+
 protected:
-    void CastRay(RayResult& ray, const Vector2& pos);
+    void CastRay(RayResult& ray, const Vector2& pos, CastContext& context);
 
-    bool CastRayPair(int minPixel, int maxPixel, const EntityLocation& loc);
+    void StartRayWalk(RayWalk& walk, float dirX, float dirY, const Vector2& pos) const;
+    bool JumpEmptyBlock(int level, int& mapX, int& mapY, int& crossX, int& crossY, float& sideDistX, float& sideDistY, const RayWalk& walk) const;
+    Vector2 GetRayDirection(int pixel, const EntityLocation& loc) const;
+
+    bool CastRayPair(int minPixel, int maxPixel, const EntityLocation& loc, CastContext& context);
 
     void UpdateRayset(const EntityLocation& loc);
+    void UpdateRaysetParallel(const EntityLocation& loc);
+
+    size_t ProcessPendingCasts(CastContext& context, const EntityLocation& loc, size_t frontierLimit);
+
+    void UpdatePVS(const EntityLocation& loc);
+    void UpdatePVSView(const EntityLocation& loc);
+
+    void UpdateSectors();
+    void UpdateSectorView(const EntityLocation& loc);
+    bool VisitSector(int index, const Vector2& pos, const Vector2& minEdge, const Vector2& maxEdge, float side);
+
+    void UpdateBeams(const EntityLocation& loc);
+    void SweepOctant(const Vector2& pos, int primaryX, int primaryY, int secondaryX, int secondaryY, const Vector2& minEdge, const Vector2& maxEdge);
+
+    bool StartCoherentFrame(const EntityLocation& loc);
+    bool GetRelativeAngles(float minX, float minY, float maxX, float maxY, float& minAngle, float& maxAngle) const;
+    bool IsAngleRangeValid(float minAngle, float maxAngle) const;
+    bool IsWedgeClear(const RayResult& first, const RayResult& second);
+    void KeepPreviousCells();
+    bool ReuseRay(RayResult& ray) const;
+    void CastOrReuseRay(RayResult& ray, const Vector2& pos, CastContext& context);
 
     void SetCellVis(int x, int y);
+    void SetBlockVis(int level, int blockIndex);
+    void ClearBlockStatus();
+
+    inline void VisitCell(CastContext& context, int x, int y, int index)
+    {
+        if (!context.SharedStatus)
+            context.VisitedCells.Insert(index);
+        else if (CellStatus[index] != 1)
+            SetCellVis(x, y);
+    }
+
+    // block keys put the pyramid level above the block index, a 16k map has 2^26 blocks on level 1
+    static constexpr int BlockLevelShift = 26;
+
+    inline void VisitBlock(CastContext& context, int level, int blockIndex)
+    {
+        if (!context.SharedStatus)
+            context.VisitedBlocks.Insert((level << BlockLevelShift) | blockIndex);
+        else if (BlockStatus[level - 1][blockIndex] != 1)
+            SetBlockVis(level, blockIndex);
+    }
 
     const Map* WorldMap = nullptr;
     int RenderWidth;
     float RenderFOVX;
 
     int CastCount = 0;
+    int ReusedCount = 0;
+
+    VisibilityBackend Backend = VisibilityBackend::RayBisection;
+
+    // rays and sweeps stop when they leave these cells, the whole map or the bounds of the viewer cell's PVS
+    int TraceMinX = 0;
+    int TraceMinY = 0;
+    int TraceMaxX = -1;
+    int TraceMaxY = -1;
+
+    const PotentiallyVisibleSet* PVS = nullptr;
+    bool PVSActive = false;
+    int PVSCellIndex = -1;
+    std::vector<int> PVSCells;
+    std::vector<uint8_t> PVSStatus;
+
+    // a map with no rooms to speak of can reach the same sector down many portal paths
+    static constexpr int MaxSectorVisits = 4096;
+
+    SectorMap Sectors;
+    const Map* SectorSource = nullptr;
+    uint64_t SectorVersion = 0;
+    std::vector<MapEditArea> SectorEdits;
+    std::vector<uint8_t> SectorOnPath;
+    int SectorVisits = 0;
 
     std::vector<RayResult> RaySet;
+
+    bool EmptySpaceSkipping = false;
+    float MaxViewDistance = 0;
+
+    CastContext MainContext;
+    std::vector<CastContext> JobContexts;
+    std::unique_ptr<WorkerPool> Workers;
     Vector2 CameraPlane;
     Vector2 NominalCameraPlane;
 
     std::vector<uint8_t> CellStatus;
     std::vector<size_t> HitCells;
     std::vector<Vector2i> HitCellLocs;
+
+    // one status list per pyramid level, starting at level 1
+    std::vector<std::vector<uint8_t>> BlockStatus;
+    std::vector<VisibleBlock> HitBlocks;
+    std::vector<VisibleFace> HitFaces;
+
+    // the open angle intervals of the octant being swept, as slopes
+    std::vector<std::pair<float, float>> OpenSlopes;
+    std::vector<std::pair<float, float>> ClippedSlopes;
+
+    // a ray from the last frame, with its angle from the new facing
+    struct CoherentRay
+    {
+        float Angle = 0;
+        RayResult Ray;
+
+        // the columns between this ray and the next one can copy their hit
+        bool ClearToNext = false;
+    };
+
+    // a pyramid block, or a cell at level 0, still to be tested against a wedge
+    struct WedgeBlock
+    {
+        int Level = 0;
+        int X = 0;
+        int Y = 0;
+    };
+
+    bool CoherentMode = false;
+    bool CoherentValid = false;
+    bool ReuseActive = false;
+
+    const Map* CoherentMap = nullptr;
+    uint64_t CoherentVersion = 0;
+    EntityLocation CoherentLocation;
+
+    // all set up at the start of a coherent frame, and only read while it is cast
+    Vector2 ReuseFacing = { 0 };
+    Vector2 ReusePosition = { 0 };
+    std::vector<CoherentRay> CoherentRays;
+    std::vector<std::pair<float, float>> InvalidAngles;
+    std::vector<MapEditArea> EditedAreas;
+    std::vector<WedgeBlock> WedgeBlocks;
+    std::vector<Vector2i> PreviousCells;
+    std::vector<VisibleBlock> PreviousBlocks;
 };
\ No newline at end of file
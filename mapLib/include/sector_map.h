@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+class Map;
+
+// the open cells of a map split into rectangles, joined by portals where two rectangles touch
+// a rectangle of open cells is convex, so a view that gets through one of its portals sees all of it that is inside the view
+class SectorMap
+{
+public:
+    struct Portal
+    {
+        // the sector on the other side
+        int Sector = -1;
+
+        // the shared edge, in map units
+        float StartX = 0;
+        float StartY = 0;
+        float EndX = 0;
+        float EndY = 0;
+
+        // the direction from this sector to the other one
+        int NormalX = 0;
+        int NormalY = 0;
+    };
+
+    struct Sector
+    {
+        // the cells in the sector, inclusive, a removed sector has no cells
+        int MinX = 0;
+        int MinY = 0;
+        int MaxX = -1;
+        int MaxY = -1;
+
+        std::vector<Portal> Portals;
+
+        inline bool IsValid() const { return MaxX >= MinX; }
+    };
+
+    void Build(const Map& map);
+
+    // split the sectors around an edited cell again, the rest of the map keeps its sectors
+    void UpdateCell(const Map& map, int x, int y);
+
+    // the same for a rectangle of edited cells, inclusive, such as a streamed chunk
+    void UpdateRegion(const Map& map, int minX, int minY, int maxX, int maxY);
+
+    // cells a ray passes through, the same test the raycaster uses for a hit
+    static bool IsOpen(const Map& map, int x, int y);
+
+    // the sector a cell is in, -1 for walls and cells outside the map
+    inline int GetSectorAt(int x, int y) const
+    {
+        if (x < 0 || x >= Width || y < 0 || y >= Height)
+            return -1;
+
+        return CellSectors[y * Width + x];
+    }
+
+    // sector indexes are kept while the sector exists, removed ones are reused
+    inline int GetSectorCount() const { return int(Sectors.size()); }
+    inline const Sector& GetSector(int index) const { return Sectors[index]; }
+    inline int GetLiveSectorCount() const { return int(Sectors.size() - FreeSectors.size()); }
+
+protected:
+    int AddSector(const Map& map, int x, int y);
+    void RemoveSector(int index);
+    void LinkSector(int index);
+    void AddPortal(Sector& sector, int neighbor, int startX, int startY, int endX, int endY, int normalX, int normalY);
+
+    int Width = 0;
+    int Height = 0;
+    std::vector<int> CellSectors;
+
+    std::vector<Sector> Sectors;
+    std::vector<int> FreeSectors;
+
+    std::vector<int> RegionCells;
+    std::vector<int> RelinkSectors;
+};
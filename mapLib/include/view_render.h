@@ -2,6 +2,9 @@
 
 #include "raylib.h"
 #include "raycaster.h"
+#include "map_face_cache.h"
+
+#include <vector>
 
 class ViewRenderer
 {
@@ -17,18 +20,73 @@ public:
     inline void SetFOVY(float fov) { ViewCamera.fovy = fov; }
     inline float GetFOVY() const { return ViewCamera.fovy; }
 
+    // the faces drawn, and the faces of the visible cells before any were culled
     inline int GetFaceCount() const { return FaceCount; }
+    inline int GetUnculledFaceCount() const { return UnculledFaceCount; }
 
     void SetMap(const Map* map);
 
+    // draw the cached meshes of the chunks the raycaster saw into, or copy each visible cell's faces into a stream each frame
+    inline void SetUseChunkMeshes(bool use) { UseChunkMeshes = use; }
+    inline bool GetUseChunkMeshes() const { return UseChunkMeshes; }
+
+    // drop the faces of visible cells that face away from the view, floors and ceilings too close to be in the view,
+    // and anything past the max view distance. Chunk meshes are only culled whole, the GPU drops their back faces
+    inline void SetFaceCulling(bool enabled) { FaceCulling = enabled; }
+    inline bool GetFaceCulling() const { return FaceCulling; }
+
+    // merge the faces that share a plane and a tile into larger quads, in the chunk meshes and in the stream of visible cells
+    // the merged quads repeat their tile with a shader, so there is no merging on OpenGL 1.1
+    inline void SetGreedyMeshing(bool enabled) { GreedyMeshing = enabled; }
+    inline bool GetGreedyMeshing() const { return GreedyMeshing; }
+
+    // 0 for no limit, give the raycaster the same distance so its rays stop there too
+    inline void SetMaxViewDistance(float distance) { MaxViewDistance = distance; }
+    inline float GetMaxViewDistance() const { return MaxViewDistance; }
+
 protected:
+    // a GPU mesh made from a chunk of the face cache, uploaded again when the cache rebuilds the chunk
+    struct ChunkMesh
+    {
+        Mesh GPUMesh = { 0 };
+        uint64_t Revision = 0;
+        bool Merged = false;
+        uint64_t DrawnFrame = 0;
+    };
+
+    void LoadTileShader();
+    inline bool IsMerging() const { return GreedyMeshing && TileShader.id != 0; }
+
+    // the view for the culling stage, depths are measured along the facing like the ray distances
+    struct CullView
+    {
+        Vector2 Position = { 0 };
+        Vector2 Facing = { 0 };
+        float FloorDepth = 0;
+        float MaxDistance = 0;
+
+        inline float GetDepth(float x, float y) const { return (x - Position.x) * Facing.x + (y - Position.y) * Facing.y; }
+    };
+
+    void StartCulling(const EntityLocation& loc);
+    bool IsWallVisible(int x, int y, WallSide side) const;
+    bool IsFloorVisible(int x, int y) const;
+    bool IsAreaVisible(int minX, int minY, int maxX, int maxY) const;
 
-    void DrawCellFloor(int x, int y);
-    void DrawCellCeiling(int x, int y);
-    void DrawCellWall(int x, int y, uint8_t cellType);
+    void DrawChunkMeshes();
+    void AddVisibleChunk(int chunkX, int chunkY);
+    void UnloadChunkMeshes();
+
+    // the faces of the visible cells are copied into one dynamic mesh, which is drawn each time it fills up
+    static constexpr int StreamFaceLimit = 16384;
+
+    void DrawVisibleCells();
+    void StreamCell(int x, int y);
+    void CopyToStream(const MapMeshData& source, int firstFace, int count);
+    void FlushStream();
+
+    static void UnloadSharedMesh(Mesh& mesh);
 
-    void GetCellTypeUs(uint8_t cellType, float& uStart, float& uEnd);
-       
     const Raycaster& Caster;
     const Map* WorldMap;
 
@@ -37,4 +95,29 @@ protected:
     Camera3D ViewCamera = { 0 };
 
     int FaceCount = 0;
+    int UnculledFaceCount = 0;
+
+    bool FaceCulling = true;
+    float MaxViewDistance = 0;
+    CullView Culling;
+
+    bool UseChunkMeshes = true;
+    MapFaceCache FaceCache;
+    Material MeshMaterial = { 0 };
+
+    bool GreedyMeshing = true;
+    Shader TileShader = { 0 };
+    bool TileShaderTried = false;
+
+    std::vector<ChunkMesh> ChunkMeshes;
+    std::vector<int> VisibleChunks;
+    uint64_t Frame = 0;
+
+    Mesh StreamMesh = { 0 };
+    MapMeshData StreamData;
+    int StreamedFaces = 0;
+
+    // the visible faces that made it through culling, gathered to be merged when greedy meshing is on
+    std::vector<CellFace> FrameFaces;
+    MapMeshData FrameMerged;
 };
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a fixed set of worker threads that run batches of indexed jobs
+class WorkerPool
+{
+public:
+    // the thread count includes the calling thread, so a count of 1 runs every job inline
+    WorkerPool(int threadCount);
+    ~WorkerPool();
+
+    // non copyable
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator= (const WorkerPool&) = delete;
+
+    inline int GetThreadCount() const { return int(Workers.size()) + 1; }
+
+    // runs job(i) for every i in [0, count) across the workers and the calling thread, and returns when they are all done
+    // only one thread may call this at a time
+    void ParallelFor(int count, const std::function<void(int)>& job);
+
+    static int GetHardwareThreadCount();
+
+protected:
+    void WorkerLoop();
+    void RunJobs();
+
+    std::vector<std::thread> Workers;
+
+    std::mutex Lock;
+    std::condition_variable WakeWorkers;
+    std::condition_variable BatchDone;
+
+    const std::function<void(int)>* CurrentJob = nullptr;
+    int JobCount = 0;
+    std::atomic<int> NextJob = 0;
+
+    int BusyWorkers = 0;
+    uint64_t BatchId = 0;
+    bool Quit = false;
+};
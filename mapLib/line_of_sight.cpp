@@ -0,0 +1,185 @@
+#include "line_of_sight.h"
+
+#include <algorithm>
+
+// queries per job when a batch is split across threads
+constexpr size_t QueriesPerJob = 64;
+
+LineOfSight::LineOfSight(const Map* map)
+    : WorldMap(map)
+{
+}
+
+void LineOfSight::SetMap(const Map* map)
+{
+    WorldMap = map;
+    Viewer = nullptr;
+}
+
+void LineOfSight::SetThreadCount(int threads)
+{
+    if (threads <= 1)
+        Workers.reset();
+    else if (!Workers || Workers->GetThreadCount() != threads)
+        Workers = std::make_unique<WorkerPool>(threads);
+}
+
+void LineOfSight::SetViewer(const Raycaster* raycaster, const Vector2& viewerPos)
+{
+    Viewer = raycaster;
+    ViewerCellX = int(floorf(viewerPos.x));
+    ViewerCellY = int(floorf(viewerPos.y));
+}
+
+void LineOfSight::Query(const LineOfSightQuery* queries, LineOfSightResult* results, size_t count)
+{
+    size_t jobCount = (count + QueriesPerJob - 1) / QueriesPerJob;
+    JobWalkCounts.assign(jobCount, 0);
+
+    auto runJob = [this, queries, results, count](int job)
+        {
+            size_t end = std::min(count, (job + 1) * QueriesPerJob);
+            for (size_t i = job * QueriesPerJob; i < end; i++)
+            {
+                if (CheckViewerCache(queries[i], results[i]))
+                    continue;
+
+                WalkGrid(queries[i], results[i]);
+                JobWalkCounts[job]++;
+            }
+        };
+
+    if (Workers)
+    {
+        Workers->ParallelFor(int(jobCount), runJob);
+    }
+    else
+    {
+        for (size_t job = 0; job < jobCount; job++)
+            runJob(int(job));
+    }
+
+    WalkCount = 0;
+    for (int walks : JobWalkCounts)
+        WalkCount += walks;
+}
+
+LineOfSightResult LineOfSight::Query(const LineOfSightQuery& query) const
+{
+    LineOfSightResult result;
+    if (!CheckViewerCache(query, result))
+        WalkGrid(query, result);
+
+    return result;
+}
+
+bool LineOfSight::CheckViewerCache(const LineOfSightQuery& query, LineOfSightResult& result) const
+{
+    if (!Viewer)
+        return false;
+
+    if (int(floorf(query.Target.x)) != ViewerCellX || int(floorf(query.Target.y)) != ViewerCellY)
+        return false;
+
+    int originX = int(floorf(query.Origin.x));
+    int originY = int(floorf(query.Origin.y));
+    if (!Viewer->IsCellVis(originX, originY))
+        return false;
+
+    // the raycaster only says some ray reached some part of the origin cell, not that this point sees the target
+    // the answer is kept when both points are also in one empty block of the pyramid, as every line inside it is clear
+    if (!WorldMap || !IsInEmptyBlock(originX, originY, ViewerCellX, ViewerCellY))
+        return false;
+
+    result.Visible = true;
+    result.Distance = Vector2Distance(query.Origin, query.Target);
+    return true;
+}
+
+// the smallest block holding both cells is the only one to check, any larger one holds it and is solid when it is
+bool LineOfSight::IsInEmptyBlock(int x1, int y1, int x2, int y2) const
+{
+    const OccupancyPyramid& occupancy = WorldMap->GetOccupancy();
+
+    for (int level = 1; level <= occupancy.GetLevelCount(); level++)
+    {
+        if ((x1 >> level) == (x2 >> level) && (y1 >> level) == (y2 >> level))
+            return occupancy.IsBlockEmpty(level, x1, y1);
+    }
+
+    return false;
+}
+
+// walk the cells between the origin and the target with a DDA, stopping at the first solid cell or at the target
+void LineOfSight::WalkGrid(const LineOfSightQuery& query, LineOfSightResult& result) const
+{
+    result.Visible = false;
+    result.Distance = 0;
+
+    if (!WorldMap)
+        return;
+
+    Vector2 delta = Vector2Subtract(query.Target, query.Origin);
+    float targetDistance = Vector2Length(delta);
+
+    int mapX = int(floorf(query.Origin.x));
+    int mapY = int(floorf(query.Origin.y));
+
+    int targetX = int(floorf(query.Target.x));
+    int targetY = int(floorf(query.Target.y));
+
+    if (targetDistance <= 0 || (mapX == targetX && mapY == targetY))
+    {
+        result.Visible = true;
+        result.Distance = targetDistance;
+        return;
+    }
+
+    Vector2 dir = Vector2Scale(delta, 1.0f / targetDistance);
+
+    // distance along the line between x and y grid lines
+    float deltaDistX = (dir.x == 0) ? float(1e30) : fabsf(1.0f / dir.x);
+    float deltaDistY = (dir.y == 0) ? float(1e30) : fabsf(1.0f / dir.y);
+
+    int stepX = dir.x < 0 ? -1 : 1;
+    int stepY = dir.y < 0 ? -1 : 1;
+
+    // distance along the line to the next x and y grid lines
+    float sideDistX = (dir.x < 0 ? (query.Origin.x - mapX) : (mapX + 1.0f - query.Origin.x)) * deltaDistX;
+    float sideDistY = (dir.y < 0 ? (query.Origin.y - mapY) : (mapY + 1.0f - query.Origin.y)) * deltaDistY;
+
+    const OccupancyGrid& solidGrid = WorldMap->GetSolidGrid();
+
+    while (true)
+    {
+        float crossing = 0;
+        if (sideDistX < sideDistY)
+        {
+            crossing = sideDistX;
+            sideDistX += deltaDistX;
+            mapX += stepX;
+        }
+        else
+        {
+            crossing = sideDistY;
+            sideDistY += deltaDistY;
+            mapY += stepY;
+        }
+
+        // the target is before the next cell
+        if (crossing >= targetDistance)
+            break;
+
+        if (!solidGrid.IsPassable(mapX, mapY))
+        {
+            result.Distance = crossing;
+            return;
+        }
+
+        if (mapX == targetX && mapY == targetY)
+            break;
+    }
+
+    result.Visible = true;
+    result.Distance = targetDistance;
+}
@@ -1,10 +1,66 @@
 #include "map.h"
+#include "map_image.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+// shared by all maps, so that a version number always means the same set of cells
+static std::atomic<uint64_t> NextMapVersion(1);
 
 Map::Map()
 {
-    Width = 24;
-    Height = 24; 
-    Cells.resize(Width * Height);
+    Resize(24, 24);
+}
+
+void Map::RecordEdit(int minX, int minY, int maxX, int maxY)
+{
+    MapEdit edit;
+    edit.PreviousVersion = Version;
+    edit.Area.MinX = minX;
+    edit.Area.MinY = minY;
+    edit.Area.MaxX = maxX;
+    edit.Area.MaxY = maxY;
+
+    Version = NextMapVersion++;
+
+    if (RecentEdits.size() < RecentEditLimit)
+    {
+        RecentEdits.push_back(edit);
+    }
+    else
+    {
+        RecentEdits[NextEdit] = edit;
+        NextEdit = (NextEdit + 1) % RecentEditLimit;
+    }
+}
+
+void Map::ClearEdits()
+{
+    Version = NextMapVersion++;
+    RecentEdits.clear();
+    NextEdit = 0;
+}
+
+bool Map::GetEditsSince(uint64_t version, std::vector<MapEditArea>& areas) const
+{
+    areas.clear();
+    if (version == Version)
+        return true;
+
+    // walk the ring from the oldest edit, looking for the one that was made on top of the version
+    bool found = false;
+    for (size_t i = 0; i < RecentEdits.size(); i++)
+    {
+        const MapEdit& edit = RecentEdits[(NextEdit + i) % RecentEdits.size()];
+        if (edit.PreviousVersion == version)
+            found = true;
+
+        if (found)
+            areas.push_back(edit.Area);
+    }
+
+    return found;
 }
 
 bool Map::GetCellSolid(int x, int y) const
@@ -12,11 +68,7 @@ bool Map::GetCellSolid(int x, int y) const
     if (x < 0 || x >= Width || y < 0 || y >= Height)
         return false;
 
-    int index = y * (int)Width + x;
-    if (index < 0 || index >= Cells.size())
-        return false;
-
-    return Cells[index].State != CellState::Empty;
+    return GetCell(x, y).State != CellState::Empty;
 }
 
 void Map::SetCellState(int x, int y, CellState state)
@@ -24,18 +76,20 @@ void Map::SetCellState(int x, int y, CellState state)
 	if (x < 0 || x >= Width || y < 0 || y >= Height)
 		return;
 
-	int index = y * (int)Width + x;
-	if (index < 0 || index >= Cells.size())
-		return;
+	MapCell cell = GetCell(x, y);
+	cell.State = state;
+	SetCellRaw(x, y, cell);
 
-	Cells[index].State = state;
+    RecordEdit(x, y, x, y);
+    SolidGrid.SetCell(x, y, state != CellState::Empty);
+    Occupancy.UpdateCell(*this, x, y);
 }
 
 uint8_t Map::GetCellTile(int x, int y) const
 {
     if (x < 0 || x >= Width || y < 0 || y >= Height)
         return 0;
-    return Cells[y * (int)Width + x].Tile;
+    return GetCell(x, y).Tile;
 }
 
 void Map::SetCellTile(int x, int y, uint8_t tile)
@@ -43,19 +97,21 @@ void Map::SetCellTile(int x, int y, uint8_t tile)
 	if (x < 0 || x >= Width || y < 0 || y >= Height)
 		return;
 
-	int index = y * (int)Width + x;
-	if (index < 0 || index >= Cells.size())
-		return;
+	MapCell cell = GetCell(x, y);
+    cell.State = CellState::Solid;
+	cell.Tile = tile;
+	SetCellRaw(x, y, cell);
 
-    Cells[index].State = CellState::Solid;
-	Cells[index].Tile = tile;
+    RecordEdit(x, y, x, y);
+    SolidGrid.SetCell(x, y, true);
+    Occupancy.UpdateCell(*this, x, y);
 }
 
 uint8_t Map::GetCellFlags(int x, int y) const
 {
 	if (x < 0 || x >= Width || y < 0 || y >= Height)
 		return 0;
-	return Cells[y * (int)Width + x].Flags;
+	return GetCell(x, y).Flags;
 }
 
 void Map::SetCellFlags(int x, int y, uint8_t flag)
@@ -63,11 +119,23 @@ void Map::SetCellFlags(int x, int y, uint8_t flag)
 	if (x < 0 || x >= Width || y < 0 || y >= Height)
 		return;
 
-	int index = y * (int)Width + x;
-	if (index < 0 || index >= Cells.size())
+	MapCell cell = GetCell(x, y);
+	cell.Flags = flag;
+	SetCellRaw(x, y, cell);
+
+    RecordEdit(x, y, x, y);
+}
+
+void Map::SetCell(int x, int y, const MapCell& cell)
+{
+	if (x < 0 || x >= Width || y < 0 || y >= Height)
 		return;
 
-	Cells[index].Flags = flag;
+	SetCellRaw(x, y, cell);
+
+    RecordEdit(x, y, x, y);
+    SolidGrid.SetCell(x, y, cell.State != CellState::Empty);
+    Occupancy.UpdateCell(*this, x, y);
 }
 
 bool Map::GetCellPassable(int x, int y) const
@@ -75,16 +143,156 @@ bool Map::GetCellPassable(int x, int y) const
     if (x < 0 || x >= Width || y < 0 || y >= Height)
         return false;
 
-    int index = y * (int)Width + x;
-    if (index < 0 || index >= Cells.size())
-        return false;
+    return GetCell(x, y).State == CellState::Empty;
+}
+
+void Map::SetCellRaw(int x, int y, const MapCell& cell)
+{
+    if (Storage == MapStorage::Chunked)
+        Chunks.SetCell(x, y, cell);
+    else
+    {
+        int index = y * Width + x;
+        Dense.GetStates()[index] = cell.State;
+        Dense.GetTiles()[index] = cell.Tile;
+        Dense.GetFlags()[index] = cell.Flags;
+    }
+}
+
+void Map::SetStorage(MapStorage storage)
+{
+    if (storage == Storage)
+        return;
+
+    if (storage == MapStorage::Chunked)
+    {
+        Chunks.Resize(Width, Height);
+        for (int y = 0; y < Height; y++)
+        {
+            for (int x = 0; x < Width; x++)
+                Chunks.SetCell(x, y, GetCell(x, y));
+        }
+        Chunks.Compact();
+
+        Dense.Clear();
+        Storage = storage;
+    }
+    else
+    {
+        Dense.Resize(size_t(Width) * Height);
+        Storage = storage;
 
-    return Cells[index].State == CellState::Empty;
+        for (int y = 0; y < Height; y++)
+        {
+            for (int x = 0; x < Width; x++)
+                SetCellRaw(x, y, Chunks.GetCell(x, y));
+        }
+
+        Chunks.Clear();
+    }
+}
+
+size_t Map::GetCellMemoryUse() const
+{
+    if (Storage == MapStorage::Chunked)
+        return Chunks.GetMemoryUse();
+
+    return Dense.GetMemoryUse();
 }
 
 void Map::Resize(int newWidth, int newHeight)
 {
-	Cells.resize(newWidth * newHeight);
+    ResizeRaw(newWidth, newHeight);
+    UpdateOccupancy();
+}
+
+// chunked maps keep each cell where it was, dense maps keep the cells in order
+void Map::ResizeRaw(int newWidth, int newHeight)
+{
+    if (Storage == MapStorage::Chunked)
+    {
+        MapChunkStore resized;
+        resized.Resize(newWidth, newHeight);
+
+        for (int y = 0; y < newHeight && y < Height; y++)
+        {
+            for (int x = 0; x < newWidth && x < Width; x++)
+                resized.SetCell(x, y, Chunks.GetCell(x, y));
+        }
+
+        Chunks = std::move(resized);
+    }
+    else
+    {
+        Dense.Resize(size_t(newWidth) * newHeight);
+    }
+
     Width = newWidth;
 	Height = newHeight;
 }
+
+void Map::UseImage(const std::shared_ptr<MapImage>& image)
+{
+    if (!image)
+        return;
+
+    Chunks.Clear();
+    Dense.UseImage(image);
+
+    Storage = MapStorage::Dense;
+    Width = image->GetWidth();
+    Height = image->GetHeight();
+    UpdateOccupancy();
+}
+
+void Map::ResetUnknown(int width, int height)
+{
+    Dense.Clear();
+
+    Storage = MapStorage::Chunked;
+    Chunks.Resize(width, height, MapCell::Unknown());
+
+    Width = width;
+    Height = height;
+    UpdateOccupancy();
+}
+
+void Map::SetChunk(int chunkX, int chunkY, MapChunkStore::Chunk&& chunk)
+{
+    if (Storage != MapStorage::Chunked || chunkX < 0 || chunkX >= Chunks.GetChunksX() || chunkY < 0 || chunkY >= Chunks.GetChunksY())
+        return;
+
+    Chunks.SetChunkAt(chunkX, chunkY, std::move(chunk));
+
+    int minX = chunkX << MapChunkStore::ChunkShift;
+    int minY = chunkY << MapChunkStore::ChunkShift;
+    int maxX = std::min(minX + MapChunkStore::ChunkSize, Width) - 1;
+    int maxY = std::min(minY + MapChunkStore::ChunkSize, Height) - 1;
+
+    for (int y = minY; y <= maxY; y++)
+    {
+        for (int x = minX; x <= maxX; x++)
+            SolidGrid.SetCell(x, y, Chunks.GetCell(x, y).State != CellState::Empty);
+    }
+
+    Occupancy.UpdateRegion(*this, minX, minY, maxX, maxY);
+    RecordEdit(minX, minY, maxX, maxY);
+}
+
+void Map::UnloadChunk(int chunkX, int chunkY)
+{
+    MapChunkStore::Chunk chunk;
+    chunk.Fill(MapCell::Unknown());
+    SetChunk(chunkX, chunkY, std::move(chunk));
+}
+
+void Map::UpdateOccupancy()
+{
+    // cells set one at a time can leave palettes with entries nothing uses
+    if (Storage == MapStorage::Chunked)
+        Chunks.Compact();
+
+    ClearEdits();
+    SolidGrid.Build(*this);
+    Occupancy.Build(*this);
+}
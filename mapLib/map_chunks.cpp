@@ -0,0 +1,172 @@
+#include "map_chunks.h"
+
+int MapChunkStore::Chunk::GetPaletteIndex(int localIndex) const
+{
+    if (IndexBits == 0)
+        return 0;
+
+    int bit = localIndex * IndexBits;
+    return int((Indices[bit >> 6] >> (bit & 63)) & ((uint64_t(1) << IndexBits) - 1));
+}
+
+// repack every index at a new width
+void MapChunkStore::Chunk::SetIndexBits(int bits)
+{
+    std::vector<uint64_t> indices;
+    if (bits > 0)
+        indices.assign((size_t(ChunkCells) * bits + 63) / 64, 0);
+
+    for (int i = 0; i < ChunkCells && bits > 0; i++)
+    {
+        int bit = i * bits;
+        indices[bit >> 6] |= uint64_t(GetPaletteIndex(i)) << (bit & 63);
+    }
+
+    Indices.swap(indices);
+    IndexBits = bits;
+}
+
+void MapChunkStore::Chunk::SetCell(int localIndex, const MapCell& cell)
+{
+    int paletteIndex = -1;
+    for (size_t i = 0; i < Palette.size(); i++)
+    {
+        if (Palette[i] == cell)
+        {
+            paletteIndex = int(i);
+            break;
+        }
+    }
+
+    if (paletteIndex < 0)
+    {
+        // a chunk can only ever use as many entries as it has cells, the rest are left over from old edits
+        if (Palette.size() >= size_t(ChunkCells))
+            Compact();
+
+        Palette.push_back(cell);
+        paletteIndex = int(Palette.size() - 1);
+
+        int bits = IndexBits;
+        while ((size_t(1) << bits) < Palette.size())
+            bits = bits == 0 ? 1 : bits * 2;
+
+        if (bits != IndexBits)
+            SetIndexBits(bits);
+    }
+
+    if (IndexBits == 0)
+        return;
+
+    int bit = localIndex * IndexBits;
+    uint64_t mask = ((uint64_t(1) << IndexBits) - 1) << (bit & 63);
+    uint64_t& word = Indices[bit >> 6];
+    word = (word & ~mask) | (uint64_t(paletteIndex) << (bit & 63));
+}
+
+void MapChunkStore::Chunk::Fill(const MapCell& cell)
+{
+    Palette.assign(1, cell);
+    Palette.shrink_to_fit();
+    Indices.clear();
+    Indices.shrink_to_fit();
+    IndexBits = 0;
+}
+
+void MapChunkStore::Chunk::Compact()
+{
+    if (IndexBits == 0)
+        return;
+
+    std::vector<int> remap(Palette.size(), -1);
+    std::vector<MapCell> palette;
+
+    for (int i = 0; i < ChunkCells; i++)
+    {
+        int index = GetPaletteIndex(i);
+        if (remap[index] < 0)
+        {
+            remap[index] = int(palette.size());
+            palette.push_back(Palette[index]);
+        }
+    }
+
+    if (palette.size() == 1)
+    {
+        Palette.swap(palette);
+        Palette.shrink_to_fit();
+        Indices.clear();
+        Indices.shrink_to_fit();
+        IndexBits = 0;
+        return;
+    }
+
+    int bits = 1;
+    while ((size_t(1) << bits) < palette.size())
+        bits *= 2;
+
+    std::vector<uint64_t> indices((size_t(ChunkCells) * bits + 63) / 64, 0);
+    for (int i = 0; i < ChunkCells; i++)
+    {
+        int bit = i * bits;
+        indices[bit >> 6] |= uint64_t(remap[GetPaletteIndex(i)]) << (bit & 63);
+    }
+
+    Palette.swap(palette);
+    Palette.shrink_to_fit();
+    Indices.swap(indices);
+    IndexBits = bits;
+}
+
+size_t MapChunkStore::Chunk::GetMemoryUse() const
+{
+    return sizeof(Chunk) + Palette.capacity() * sizeof(MapCell) + Indices.capacity() * sizeof(uint64_t);
+}
+
+void MapChunkStore::Resize(int width, int height, const MapCell& fill)
+{
+    Width = width;
+    Height = height;
+    ChunksX = (width + ChunkMask) >> ChunkShift;
+    ChunksY = (height + ChunkMask) >> ChunkShift;
+
+    Chunks.clear();
+    Chunks.resize(size_t(ChunksX) * ChunksY);
+
+    for (auto& chunk : Chunks)
+        chunk.Fill(fill);
+}
+
+void MapChunkStore::Clear()
+{
+    Width = 0;
+    Height = 0;
+    ChunksX = 0;
+    ChunksY = 0;
+    Chunks.clear();
+    Chunks.shrink_to_fit();
+}
+
+void MapChunkStore::Compact()
+{
+    for (auto& chunk : Chunks)
+        chunk.Compact();
+}
+
+size_t MapChunkStore::GetMemoryUse() const
+{
+    size_t bytes = sizeof(MapChunkStore) + (Chunks.capacity() - Chunks.size()) * sizeof(Chunk);
+    for (const auto& chunk : Chunks)
+        bytes += chunk.GetMemoryUse();
+
+    return bytes;
+}
+
+int MapChunkStore::GetUniformChunkCount() const
+{
+    int count = 0;
+    for (const auto& chunk : Chunks)
+        count += chunk.IndexBits == 0 ? 1 : 0;
+
+    return count;
+}
@@ -0,0 +1,236 @@
+#include "map_codec.h"
+
+#include <array>
+#include <cstring>
+
+// every token starts with a control byte, the top bits say what it is and the rest hold the length
+// 0xxxxxxx    x + 1 literal bytes follow
+// 10xxxxxx    the next byte repeated x + MinRun times
+// 11xxxxxx    x + MinMatch bytes copied from a 16 bit offset behind, which follows
+// a length field that is all ones is followed by a varint with the rest of the length
+constexpr int MaxLiterals = 128;
+constexpr size_t MinRun = 3;
+constexpr size_t MinMatch = 4;
+constexpr uint8_t LongLength = 63;
+constexpr size_t MaxOffset = 65535;
+
+constexpr int HashBits = 14;
+
+static uint32_t Read32(const uint8_t* data)
+{
+    uint32_t value = 0;
+    memcpy(&value, data, 4);
+    return value;
+}
+
+static uint32_t HashBytes(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - HashBits);
+}
+
+static void WriteVarint(size_t value, std::vector<uint8_t>& packed)
+{
+    while (value >= 0x80)
+    {
+        packed.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    packed.push_back(uint8_t(value));
+}
+
+static bool ReadVarint(const uint8_t*& packed, const uint8_t* end, size_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (packed >= end)
+            return false;
+
+        uint8_t byte = *packed++;
+        value |= size_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static void WriteLength(uint8_t tag, size_t length, size_t minLength, std::vector<uint8_t>& packed)
+{
+    size_t code = length - minLength;
+    if (code < LongLength)
+    {
+        packed.push_back(uint8_t(tag | code));
+        return;
+    }
+
+    packed.push_back(uint8_t(tag | LongLength));
+    WriteVarint(code - LongLength, packed);
+}
+
+static void WriteLiterals(const uint8_t* data, size_t count, std::vector<uint8_t>& packed)
+{
+    while (count > 0)
+    {
+        size_t chunk = count < size_t(MaxLiterals) ? count : size_t(MaxLiterals);
+        packed.push_back(uint8_t(chunk - 1));
+        packed.insert(packed.end(), data, data + chunk);
+
+        data += chunk;
+        count -= chunk;
+    }
+}
+
+// greedy, a run is taken when there is one, then the longest match the hash remembers, otherwise a literal
+void MapCodec::Compress(const uint8_t* data, size_t size, std::vector<uint8_t>& packed)
+{
+    std::vector<uint32_t> lastSeen(size_t(1) << HashBits, UINT32_MAX);
+
+    size_t literalStart = 0;
+    size_t i = 0;
+
+    while (i < size)
+    {
+        size_t run = 1;
+        while (i + run < size && data[i + run] == data[i])
+            run++;
+
+        if (run >= MinRun)
+        {
+            WriteLiterals(data + literalStart, i - literalStart, packed);
+            WriteLength(0x80, run, MinRun, packed);
+            packed.push_back(data[i]);
+
+            i += run;
+            literalStart = i;
+            continue;
+        }
+
+        if (i + MinMatch <= size)
+        {
+            uint32_t bytes = Read32(data + i);
+            uint32_t& slot = lastSeen[HashBytes(bytes)];
+            size_t candidate = slot;
+            slot = uint32_t(i);
+
+            if (candidate != UINT32_MAX && i - candidate <= MaxOffset && Read32(data + candidate) == bytes)
+            {
+                size_t length = MinMatch;
+                while (i + length < size && data[candidate + length] == data[i + length])
+                    length++;
+
+                WriteLiterals(data + literalStart, i - literalStart, packed);
+                WriteLength(0xc0, length, MinMatch, packed);
+                packed.push_back(uint8_t((i - candidate) & 0xff));
+                packed.push_back(uint8_t((i - candidate) >> 8));
+
+                i += length;
+                literalStart = i;
+                continue;
+            }
+        }
+
+        i++;
+    }
+
+    WriteLiterals(data + literalStart, size - literalStart, packed);
+}
+
+bool MapCodec::Decompress(const uint8_t* packed, size_t packedSize, uint8_t* data, size_t size)
+{
+    const uint8_t* end = packed + packedSize;
+    size_t written = 0;
+
+    while (packed < end)
+    {
+        uint8_t control = *packed++;
+
+        if ((control & 0x80) == 0)
+        {
+            size_t count = size_t(control) + 1;
+            if (size_t(end - packed) < count || size - written < count)
+                return false;
+
+            memcpy(data + written, packed, count);
+            packed += count;
+            written += count;
+            continue;
+        }
+
+        bool match = (control & 0x40) != 0;
+        size_t length = (control & LongLength) + (match ? MinMatch : MinRun);
+        if ((control & LongLength) == LongLength)
+        {
+            size_t extra = 0;
+            if (!ReadVarint(packed, end, extra) || extra > size)
+                return false;
+
+            length += extra;
+        }
+
+        if (size - written < length)
+            return false;
+
+        if (!match)
+        {
+            if (packed >= end)
+                return false;
+
+            memset(data + written, *packed++, length);
+            written += length;
+            continue;
+        }
+
+        if (end - packed < 2)
+            return false;
+
+        size_t offset = size_t(packed[0]) | (size_t(packed[1]) << 8);
+        packed += 2;
+
+        if (offset == 0 || offset > written)
+            return false;
+
+        // the copy can overlap what it is writing, so it goes a byte at a time when it does
+        uint8_t* target = data + written;
+        const uint8_t* source = target - offset;
+        if (offset >= length)
+        {
+            memcpy(target, source, length);
+        }
+        else
+        {
+            for (size_t i = 0; i < length; i++)
+                target[i] = source[i];
+        }
+
+        written += length;
+    }
+
+    return written == size;
+}
+
+static std::array<uint32_t, 256> BuildChecksumTable()
+{
+    std::array<uint32_t, 256> table = { 0 };
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t value = i;
+        for (int bit = 0; bit < 8; bit++)
+            value = (value & 1) ? (value >> 1) ^ 0xedb88320u : value >> 1;
+
+        table[i] = value;
+    }
+
+    return table;
+}
+
+uint32_t MapCodec::GetChecksum(const uint8_t* data, size_t size, uint32_t checksum)
+{
+    static const std::array<uint32_t, 256> table = BuildChecksumTable();
+
+    checksum = ~checksum;
+    for (size_t i = 0; i < size; i++)
+        checksum = table[(checksum ^ data[i]) & 0xff] ^ (checksum >> 8);
+
+    return ~checksum;
+}
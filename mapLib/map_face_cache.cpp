@@ -0,0 +1,161 @@
+#include "map_face_cache.h"
+
+#include <algorithm>
+
+void MapFaceCache::SetMap(const Map* map)
+{
+    if (map != CachedMap)
+        Clear();
+
+    CachedMap = map;
+}
+
+void MapFaceCache::SetAtlasSize(int width, int height)
+{
+    Builder.SetAtlasSize(width, height);
+
+    for (auto& chunk : Chunks)
+        chunk.Dirty = true;
+}
+
+void MapFaceCache::Clear()
+{
+    Chunks.clear();
+    ChunksX = 0;
+    ChunksY = 0;
+    MapWidth = 0;
+    MapHeight = 0;
+}
+
+// the chunks with any cell in the area, inclusive and clipped to the map
+void MapFaceCache::MarkDirty(int minX, int minY, int maxX, int maxY)
+{
+    minX = std::max(minX, 0);
+    minY = std::max(minY, 0);
+    maxX = std::min(maxX, MapWidth - 1);
+    maxY = std::min(maxY, MapHeight - 1);
+    if (minX > maxX || minY > maxY)
+        return;
+
+    for (int chunkY = minY / ChunkSize; chunkY <= maxY / ChunkSize; chunkY++)
+    {
+        for (int chunkX = minX / ChunkSize; chunkX <= maxX / ChunkSize; chunkX++)
+            Chunks[chunkY * ChunksX + chunkX].Dirty = true;
+    }
+}
+
+// a new size or more edits than the map keeps a record of marks every chunk
+void MapFaceCache::Update()
+{
+    if (!CachedMap)
+        return;
+
+    if (CachedMap->GetWidth() != MapWidth || CachedMap->GetHeight() != MapHeight)
+    {
+        Clear();
+
+        MapWidth = CachedMap->GetWidth();
+        MapHeight = CachedMap->GetHeight();
+        ChunksX = (MapWidth + ChunkSize - 1) / ChunkSize;
+        ChunksY = (MapHeight + ChunkSize - 1) / ChunkSize;
+        Chunks.resize(size_t(ChunksX) * ChunksY);
+    }
+    else if (!CachedMap->GetEditsSince(MapVersion, EditedAreas))
+    {
+        for (auto& chunk : Chunks)
+            chunk.Dirty = true;
+    }
+    else
+    {
+        // the cells around an area lose or gain the walls that face it
+        for (const MapEditArea& area : EditedAreas)
+            MarkDirty(area.MinX - 1, area.MinY - 1, area.MaxX + 1, area.MaxY + 1);
+    }
+
+    MapVersion = CachedMap->GetVersion();
+}
+
+void MapFaceCache::BuildChunk(Chunk& chunk, int chunkX, int chunkY)
+{
+    chunk.Data.Clear();
+    chunk.FirstFaces.resize(ChunkSize * ChunkSize + 1);
+    chunk.FaceMasks.assign(ChunkSize * ChunkSize, 0);
+
+    int minX = chunkX * ChunkSize;
+    int minY = chunkY * ChunkSize;
+
+    for (int localY = 0; localY < ChunkSize; localY++)
+    {
+        for (int localX = 0; localX < ChunkSize; localX++)
+        {
+            int local = localY * ChunkSize + localX;
+            int x = minX + localX;
+            int y = minY + localY;
+
+            chunk.FirstFaces[local] = uint16_t(chunk.Data.FaceCount);
+            if (x < MapWidth && y < MapHeight)
+                chunk.FaceMasks[local] = Builder.BuildCell(*CachedMap, x, y, chunk.Data);
+        }
+    }
+
+    chunk.FirstFaces[ChunkSize * ChunkSize] = uint16_t(chunk.Data.FaceCount);
+    chunk.Merged.Clear();
+    chunk.MergedBuilt = false;
+    chunk.Revision = NextRevision++;
+    chunk.Dirty = false;
+}
+
+const MapFaceCache::Chunk* MapFaceCache::GetChunk(int chunkX, int chunkY)
+{
+    if (chunkX < 0 || chunkY < 0 || chunkX >= ChunksX || chunkY >= ChunksY)
+        return nullptr;
+
+    Chunk& chunk = Chunks[chunkY * ChunksX + chunkX];
+    if (chunk.Dirty)
+        BuildChunk(chunk, chunkX, chunkY);
+
+    return &chunk;
+}
+
+const MapMeshData* MapFaceCache::GetMergedChunk(int chunkX, int chunkY)
+{
+    if (!GetChunk(chunkX, chunkY))
+        return nullptr;
+
+    Chunk& chunk = Chunks[chunkY * ChunksX + chunkX];
+    if (chunk.MergedBuilt)
+        return &chunk.Merged;
+
+    MergeFaces.clear();
+    for (int local = 0; local < ChunkSize * ChunkSize; local++)
+    {
+        if (chunk.FirstFaces[local + 1] == chunk.FirstFaces[local])
+            continue;
+
+        int x = chunkX * ChunkSize + local % ChunkSize;
+        int y = chunkY * ChunkSize + local / ChunkSize;
+        MapMeshBuilder::GetCellFaces(*CachedMap, x, y, chunk.FaceMasks[local], MergeFaces);
+    }
+
+    Builder.BuildMerged(MergeFaces, chunk.Merged);
+    chunk.MergedBuilt = true;
+
+    return &chunk.Merged;
+}
+
+MapFaceCache::CellFaces MapFaceCache::GetCell(int x, int y)
+{
+    CellFaces faces;
+    if (x < 0 || y < 0 || x >= MapWidth || y >= MapHeight)
+        return faces;
+
+    const Chunk* chunk = GetChunk(x / ChunkSize, y / ChunkSize);
+
+    int local = (y % ChunkSize) * ChunkSize + x % ChunkSize;
+    faces.Data = &chunk->Data;
+    faces.FirstFace = chunk->FirstFaces[local];
+    faces.FaceCount = chunk->FirstFaces[local + 1] - faces.FirstFace;
+    faces.FaceMask = chunk->FaceMasks[local];
+
+    return faces;
+}
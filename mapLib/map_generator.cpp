@@ -0,0 +1,343 @@
+#include "map_generator.h"
+
+#include <algorithm>
+#include <cstring>
+
+// the percent of cells that start as walls in a cave, and how many times the cave is smoothed
+static constexpr int CaveFillPercent = 45;
+static constexpr int CaveSmoothPasses = 4;
+
+// each block of this many cells gets one room
+static constexpr int RoomBlockSize = 16;
+static constexpr int MinRoomSize = 4;
+
+// each block of this many cells may get one pillar
+static constexpr int PillarBlockSize = 8;
+static constexpr int PillarPercent = 30;
+
+// walls share a tile in patches of this many cells, using tiles 1 to WallTileCount
+static constexpr int WallPatchSize = 8;
+static constexpr int WallTileCount = 8;
+
+static const char* StyleNames[] = { "maze", "cave", "rooms", "arena" };
+
+// splitmix64, small, fast and the same everywhere
+static uint64_t MixBits(uint64_t value)
+{
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+MapGenerator::MapGenerator(uint64_t seed)
+    : Seed(seed)
+    , State(seed)
+{
+}
+
+uint64_t MapGenerator::Random()
+{
+    State = MixBits(State);
+    return State;
+}
+
+// inclusive of both ends
+int MapGenerator::RandomRange(int min, int max)
+{
+    if (max <= min)
+        return min;
+
+    return min + int(Random() % uint64_t(max - min + 1));
+}
+
+uint64_t MapGenerator::GetCellHash(int x, int y, uint64_t salt) const
+{
+    return MixBits(Seed ^ MixBits((uint64_t(uint32_t(x)) << 32 | uint32_t(y)) ^ MixBits(salt)));
+}
+
+uint8_t MapGenerator::GetWallTile(int x, int y) const
+{
+    return uint8_t(1 + GetCellHash(x / WallPatchSize, y / WallPatchSize, 1) % WallTileCount);
+}
+
+const char* MapGenerator::GetStyleName(MapStyle style)
+{
+    return StyleNames[int(style)];
+}
+
+bool MapGenerator::FindStyle(const char* name, MapStyle& style)
+{
+    for (int i = 0; i < int(sizeof(StyleNames) / sizeof(StyleNames[0])); i++)
+    {
+        if (strcmp(name, StyleNames[i]) == 0)
+        {
+            style = MapStyle(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// the cells are written raw and the occupancy is built once at the end, the setters update it for every cell, which is far too slow for the large sizes
+void MapGenerator::Generate(Map& map, MapStyle style, int width, int height)
+{
+    width = std::min(std::max(width, MinSize), MaxSize);
+    height = std::min(std::max(height, MinSize), MaxSize);
+
+    State = Seed;
+
+    map.Resize(width, height);
+
+    switch (style)
+    {
+    case MapStyle::Maze:
+        BuildMaze(map);
+        break;
+    case MapStyle::Cave:
+        BuildCave(map);
+        break;
+    case MapStyle::Rooms:
+        BuildRooms(map);
+        break;
+    case MapStyle::Arena:
+        BuildArena(map);
+        break;
+    }
+
+    // the outside edge is always wall, so nothing walks or looks off the map
+    for (int x = 0; x < width; x++)
+    {
+        SetCell(map, x, 0, CellState::Solid);
+        SetCell(map, x, height - 1, CellState::Solid);
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        SetCell(map, 0, y, CellState::Solid);
+        SetCell(map, width - 1, y, CellState::Solid);
+    }
+
+    map.UpdateOccupancy();
+}
+
+void MapGenerator::Fill(Map& map, CellState state)
+{
+    for (int y = 0; y < map.GetHeight(); y++)
+    {
+        for (int x = 0; x < map.GetWidth(); x++)
+            SetCell(map, x, y, state);
+    }
+}
+
+void MapGenerator::SetCell(Map& map, int x, int y, CellState state)
+{
+    MapCell cell;
+    cell.State = state;
+    cell.Tile = state == CellState::Empty ? 0 : GetWallTile(x, y);
+    map.SetCellRaw(x, y, cell);
+}
+
+void MapGenerator::SetFlags(Map& map, int x, int y, uint8_t flags)
+{
+    MapCell cell = map.GetCell(x, y);
+    cell.Flags = flags;
+    map.SetCellRaw(x, y, cell);
+}
+
+// inclusive, clipped to the inside of the border
+void MapGenerator::CarveRect(Map& map, int minX, int minY, int maxX, int maxY)
+{
+    minX = std::max(minX, 1);
+    minY = std::max(minY, 1);
+    maxX = std::min(maxX, map.GetWidth() - 2);
+    maxY = std::min(maxY, map.GetHeight() - 2);
+
+    for (int y = minY; y <= maxY; y++)
+    {
+        for (int x = minX; x <= maxX; x++)
+            SetCell(map, x, y, CellState::Empty);
+    }
+}
+
+// a depth first maze on the odd cells, the walls between them are knocked out as it goes
+// the way back from each cell is kept in its flags, so even the largest maze needs no stack
+void MapGenerator::BuildMaze(Map& map)
+{
+    Fill(map, CellState::Solid);
+
+    const int offsets[4][2] = { {2, 0}, {0, 2}, {-2, 0}, {0, -2} };
+    constexpr uint8_t startFlag = 0xFF;
+
+    int x = 1;
+    int y = 1;
+    SetCell(map, x, y, CellState::Empty);
+    SetFlags(map, x, y, startFlag);
+
+    while (true)
+    {
+        int options[4];
+        int optionCount = 0;
+
+        for (int i = 0; i < 4; i++)
+        {
+            int nextX = x + offsets[i][0];
+            int nextY = y + offsets[i][1];
+            if (nextX > 0 && nextX < map.GetWidth() - 1 && nextY > 0 && nextY < map.GetHeight() - 1
+                && map.GetCell(nextX, nextY).State == CellState::Solid)
+                options[optionCount++] = i;
+        }
+
+        if (optionCount > 0)
+        {
+            int direction = options[Random() % optionCount];
+            int nextX = x + offsets[direction][0];
+            int nextY = y + offsets[direction][1];
+
+            SetCell(map, x + offsets[direction][0] / 2, y + offsets[direction][1] / 2, CellState::Empty);
+            SetCell(map, nextX, nextY, CellState::Empty);
+
+            // the direction that leads back
+            SetFlags(map, nextX, nextY, uint8_t((direction + 2) % 4 + 1));
+
+            x = nextX;
+            y = nextY;
+            continue;
+        }
+
+        uint8_t back = map.GetCell(x, y).Flags;
+        SetFlags(map, x, y, 0);
+        if (back == startFlag)
+            break;
+
+        int direction = back - 1;
+        x += offsets[direction][0];
+        y += offsets[direction][1];
+    }
+}
+
+// noise smoothed a few times, a cell becomes wall when most of its neighbors are
+// the rows are smoothed in place, keeping the old copy of the two rows above the one being written
+void MapGenerator::BuildCave(Map& map)
+{
+    const int width = map.GetWidth();
+    const int height = map.GetHeight();
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            bool wall = x == 0 || y == 0 || x == width - 1 || y == height - 1 || int(GetCellHash(x, y, 2) % 100) < CaveFillPercent;
+            SetCell(map, x, y, wall ? CellState::Solid : CellState::Empty);
+        }
+    }
+
+    std::vector<uint8_t> above(width);
+    std::vector<uint8_t> current(width);
+
+    for (int pass = 0; pass < CaveSmoothPasses; pass++)
+    {
+        std::fill(above.begin(), above.end(), uint8_t(1));
+
+        for (int y = 1; y < height - 1; y++)
+        {
+            for (int x = 0; x < width; x++)
+                current[x] = map.GetCell(x, y).State != CellState::Empty ? 1 : 0;
+
+            for (int x = 1; x < width - 1; x++)
+            {
+                int walls = above[x - 1] + above[x] + above[x + 1] + current[x - 1] + current[x + 1];
+                for (int i = -1; i <= 1; i++)
+                    walls += map.GetCell(x + i, y + 1).State != CellState::Empty ? 1 : 0;
+
+                bool wall = current[x] != 0;
+                if (walls >= 5)
+                    wall = true;
+                else if (walls <= 3)
+                    wall = false;
+
+                SetCell(map, x, y, wall ? CellState::Solid : CellState::Empty);
+            }
+
+            above.swap(current);
+        }
+    }
+}
+
+// split the map into blocks, put a room somewhere in each one and join the rooms with bent corridors
+// every room joins the one to its right, and the rooms down the first column join the one below, so all of them are reachable
+void MapGenerator::BuildRooms(Map& map)
+{
+    Fill(map, CellState::Solid);
+
+    const int blocksX = std::max(1, (map.GetWidth() - 2) / RoomBlockSize);
+    const int blocksY = std::max(1, (map.GetHeight() - 2) / RoomBlockSize);
+
+    std::vector<Vector2i> centers(size_t(blocksX) * blocksY);
+
+    for (int blockY = 0; blockY < blocksY; blockY++)
+    {
+        for (int blockX = 0; blockX < blocksX; blockX++)
+        {
+            int roomWidth = RandomRange(MinRoomSize, RoomBlockSize - 3);
+            int roomHeight = RandomRange(MinRoomSize, RoomBlockSize - 3);
+            int minX = 1 + blockX * RoomBlockSize + RandomRange(1, RoomBlockSize - roomWidth - 1);
+            int minY = 1 + blockY * RoomBlockSize + RandomRange(1, RoomBlockSize - roomHeight - 1);
+
+            CarveRect(map, minX, minY, minX + roomWidth - 1, minY + roomHeight - 1);
+            centers[blockY * blocksX + blockX] = Vector2i(minX + roomWidth / 2, minY + roomHeight / 2);
+        }
+    }
+
+    for (int blockY = 0; blockY < blocksY; blockY++)
+    {
+        for (int blockX = 0; blockX < blocksX; blockX++)
+        {
+            const Vector2i& center = centers[blockY * blocksX + blockX];
+
+            bool joinRight = blockX + 1 < blocksX;
+            bool joinDown = blockY + 1 < blocksY && (blockX == 0 || RandomRange(0, 2) == 0);
+
+            if (joinRight)
+            {
+                const Vector2i& right = centers[blockY * blocksX + blockX + 1];
+                CarveRect(map, center.x, center.y, right.x, center.y);
+                CarveRect(map, right.x, std::min(center.y, right.y), right.x, std::max(center.y, right.y));
+            }
+
+            if (joinDown)
+            {
+                const Vector2i& down = centers[(blockY + 1) * blocksX + blockX];
+                CarveRect(map, center.x, center.y, center.x, down.y);
+                CarveRect(map, std::min(center.x, down.x), down.y, std::max(center.x, down.x), down.y);
+            }
+        }
+    }
+}
+
+// open floor with a pillar of one to three cells across in some of the blocks
+void MapGenerator::BuildArena(Map& map)
+{
+    Fill(map, CellState::Empty);
+
+    for (int blockY = 0; blockY < map.GetHeight() / PillarBlockSize; blockY++)
+    {
+        for (int blockX = 0; blockX < map.GetWidth() / PillarBlockSize; blockX++)
+        {
+            uint64_t hash = GetCellHash(blockX, blockY, 3);
+            if (int(hash % 100) >= PillarPercent)
+                continue;
+
+            int size = 1 + int((hash >> 8) % 3);
+            int minX = blockX * PillarBlockSize + 1 + int((hash >> 16) % (PillarBlockSize - size - 1));
+            int minY = blockY * PillarBlockSize + 1 + int((hash >> 24) % (PillarBlockSize - size - 1));
+
+            for (int y = minY; y < minY + size; y++)
+            {
+                for (int x = minX; x < minX + size; x++)
+                    SetCell(map, x, y, CellState::Solid);
+            }
+        }
+    }
+}
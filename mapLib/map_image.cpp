@@ -0,0 +1,212 @@
+#include "map_image.h"
+#include "map.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr char ImageMagic[4] = { 'R', 'M', 'I', 'M' };
+constexpr uint32_t CurrentImageVersion = 1;
+
+// read back as something else on a big endian machine, which can't use the planes in place
+constexpr uint32_t ImageByteOrder = 0x01020304;
+
+constexpr size_t ImageHeaderSize = 64;
+constexpr uint64_t ImagePageSize = 4096;
+
+static uint64_t AlignToPage(uint64_t offset)
+{
+    return (offset + ImagePageSize - 1) & ~(ImagePageSize - 1);
+}
+
+MapImage::~MapImage()
+{
+#if defined(_WIN32)
+    if (Data)
+        UnmapViewOfFile(Data);
+    if (MappingHandle)
+        CloseHandle(MappingHandle);
+    if (FileHandle)
+        CloseHandle(FileHandle);
+#else
+    if (Data)
+        munmap(Data, Size);
+#endif
+}
+
+bool MapImage::IsImageHeader(const void* data, size_t size)
+{
+    return size >= 4 && memcmp(data, ImageMagic, 4) == 0;
+}
+
+bool MapImage::Write(const Map& map, std::string_view filepath)
+{
+    int width = map.GetWidth();
+    int height = map.GetHeight();
+    if (width <= 0 || height <= 0)
+        return false;
+
+    uint64_t count = uint64_t(width) * height;
+    uint64_t stateOffset = AlignToPage(ImageHeaderSize);
+    uint64_t tileOffset = AlignToPage(stateOffset + count);
+    uint64_t flagOffset = AlignToPage(tileOffset + count);
+
+    uint8_t header[ImageHeaderSize] = { 0 };
+    uint32_t version = CurrentImageVersion;
+    uint32_t byteOrder = ImageByteOrder;
+    uint32_t pageSize = uint32_t(ImagePageSize);
+
+    memcpy(header, ImageMagic, 4);
+    memcpy(header + 4, &version, 4);
+    memcpy(header + 8, &byteOrder, 4);
+    memcpy(header + 12, &width, 4);
+    memcpy(header + 16, &height, 4);
+    memcpy(header + 20, &pageSize, 4);
+    memcpy(header + 24, &stateOffset, 8);
+    memcpy(header + 32, &tileOffset, 8);
+    memcpy(header + 40, &flagOffset, 8);
+
+    FILE* fp = fopen(std::string(filepath).c_str(), "wb");
+    if (!fp)
+        return false;
+
+    std::vector<uint8_t> padding(ImagePageSize, 0);
+    uint64_t written = 0;
+
+    auto writeBytes = [&](const void* data, size_t size)
+    {
+        written += size;
+        return size == 0 || fwrite(data, 1, size, fp) == size;
+    };
+
+    auto padTo = [&](uint64_t offset)
+    {
+        return writeBytes(padding.data(), size_t(offset - written));
+    };
+
+    bool valid = writeBytes(header, ImageHeaderSize);
+
+    // dense maps write their planes as they are, chunked ones a row at a time
+    CellPlane<const CellState> states = map.GetStatePlane();
+    CellPlane<const uint8_t> tiles = map.GetTilePlane();
+    CellPlane<const uint8_t> flags = map.GetFlagPlane();
+
+    std::vector<uint8_t> row(width);
+    for (int plane = 0; plane < 3 && valid; plane++)
+    {
+        valid = padTo(plane == 0 ? stateOffset : plane == 1 ? tileOffset : flagOffset);
+
+        if (!states.empty())
+        {
+            const void* data = plane == 0 ? (const void*)states.data() : plane == 1 ? (const void*)tiles.data() : (const void*)flags.data();
+            valid = valid && writeBytes(data, size_t(count));
+            continue;
+        }
+
+        for (int y = 0; y < height && valid; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                MapCell cell = map.GetCell(x, y);
+                row[x] = plane == 0 ? uint8_t(cell.State) : plane == 1 ? cell.Tile : cell.Flags;
+            }
+
+            valid = writeBytes(row.data(), row.size());
+        }
+    }
+
+    fclose(fp);
+    return valid;
+}
+
+std::shared_ptr<MapImage> MapImage::Open(std::string_view filepath)
+{
+    std::shared_ptr<MapImage> image(new MapImage());
+    std::string path(filepath);
+
+#if defined(_WIN32)
+    image->FileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (image->FileHandle == INVALID_HANDLE_VALUE)
+    {
+        image->FileHandle = nullptr;
+        return nullptr;
+    }
+
+    LARGE_INTEGER fileSize = { 0 };
+    if (!GetFileSizeEx(image->FileHandle, &fileSize) || fileSize.QuadPart < LONGLONG(ImageHeaderSize))
+        return nullptr;
+
+    // a copy on write view, written pages become private to the process
+    image->MappingHandle = CreateFileMappingA(image->FileHandle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (!image->MappingHandle)
+        return nullptr;
+
+    image->Data = static_cast<uint8_t*>(MapViewOfFile(image->MappingHandle, FILE_MAP_COPY, 0, 0, 0));
+    image->Size = size_t(fileSize.QuadPart);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < off_t(ImageHeaderSize))
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    // private and writable, written pages are copied and never reach the file
+    void* data = mmap(nullptr, size_t(info.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    image->Data = static_cast<uint8_t*>(data);
+    image->Size = size_t(info.st_size);
+#endif
+
+    if (!image->Data)
+        return nullptr;
+
+    const uint8_t* header = image->Data;
+    uint32_t version = 0;
+    uint32_t byteOrder = 0;
+    uint32_t pageSize = 0;
+
+    memcpy(&version, header + 4, 4);
+    memcpy(&byteOrder, header + 8, 4);
+    memcpy(&image->Width, header + 12, 4);
+    memcpy(&image->Height, header + 16, 4);
+    memcpy(&pageSize, header + 20, 4);
+    memcpy(&image->StateOffset, header + 24, 8);
+    memcpy(&image->TileOffset, header + 32, 8);
+    memcpy(&image->FlagOffset, header + 40, 8);
+
+    if (!IsImageHeader(header, image->Size) || version != CurrentImageVersion || byteOrder != ImageByteOrder || pageSize != ImagePageSize)
+        return nullptr;
+
+    if (image->Width <= 0 || image->Height <= 0)
+        return nullptr;
+
+    // every plane has to fit in the file
+    uint64_t count = uint64_t(image->Width) * image->Height;
+    for (uint64_t offset : { image->StateOffset, image->TileOffset, image->FlagOffset })
+    {
+        if (offset < ImageHeaderSize || offset > image->Size || image->Size - offset < count)
+            return nullptr;
+    }
+
+    return image;
+}
@@ -0,0 +1,206 @@
+#include "map_journal.h"
+#include "map_codec.h"
+
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+static constexpr char JournalMagic[4] = { 'R', 'M', 'J', 'N' };
+constexpr uint32_t CurrentJournalVersion = 1;
+
+// the magic, the version and the stamp of the base the journal was started on
+constexpr size_t JournalHeaderSize = 12;
+
+// a block is its cell count, each cell's index, state, tile and flags, then a checksum of all of it
+constexpr size_t JournalCellSize = 7;
+
+static size_t GetBlockSize(uint32_t count)
+{
+    return 4 + size_t(count) * JournalCellSize + 4;
+}
+
+static bool ReadHeader(FILE* fp, uint32_t baseStamp)
+{
+    uint8_t header[JournalHeaderSize] = { 0 };
+    if (fread(header, 1, JournalHeaderSize, fp) != JournalHeaderSize)
+        return false;
+
+    uint32_t version = 0;
+    uint32_t stamp = 0;
+    memcpy(&version, header + 4, 4);
+    memcpy(&stamp, header + 8, 4);
+
+    return memcmp(header, JournalMagic, 4) == 0 && version == CurrentJournalVersion && stamp == baseStamp;
+}
+
+// reads the block at the file position, false if it is cut short, fails its checksum or is bigger than the bytes left
+// the count is not trusted until the checksum is, so a damaged one can't ask for more memory than the file holds
+static bool ReadBlock(FILE* fp, long bytesLeft, std::vector<uint8_t>& block)
+{
+    uint32_t count = 0;
+    if (bytesLeft < 4 || fread(&count, 4, 1, fp) != 1)
+        return false;
+
+    size_t blockSize = GetBlockSize(count);
+    if (blockSize > size_t(bytesLeft))
+        return false;
+
+    block.resize(blockSize);
+    memcpy(block.data(), &count, 4);
+    if (fread(block.data() + 4, 1, blockSize - 4, fp) != blockSize - 4)
+        return false;
+
+    uint32_t checksum = 0;
+    memcpy(&checksum, block.data() + blockSize - 4, 4);
+    return MapCodec::GetChecksum(block.data(), blockSize - 4) == checksum;
+}
+
+// where the last good block ends, a replay stops at the first bad one so nothing past it can be kept
+static long FindEnd(FILE* fp, long fileSize)
+{
+    long end = long(JournalHeaderSize);
+    std::vector<uint8_t> block;
+
+    while (fseek(fp, end, SEEK_SET) == 0 && ReadBlock(fp, fileSize - end, block))
+        end += long(block.size());
+
+    return end;
+}
+
+std::string MapJournal::GetJournalPath(std::string_view mapPath)
+{
+    std::string path(mapPath);
+
+    size_t extension = path.find_last_of('.');
+    size_t folder = path.find_last_of("/\\");
+    if (extension != std::string::npos && (folder == std::string::npos || extension > folder))
+        path.resize(extension);
+
+    return path + ".mjournal";
+}
+
+bool MapJournal::Append(std::string_view filepath, uint32_t baseStamp, const std::vector<JournalCell>& cells)
+{
+    std::string path(filepath);
+    long end = 0;
+
+    FILE* fp = fopen(path.c_str(), "r+b");
+    if (fp && ReadHeader(fp, baseStamp) && fseek(fp, 0, SEEK_END) == 0)
+    {
+        long fileSize = ftell(fp);
+        end = FindEnd(fp, fileSize);
+
+        // whatever is past the last good block would hide the blocks after it from a replay
+        if (end < fileSize)
+        {
+            fclose(fp);
+
+            std::error_code error;
+            std::filesystem::resize_file(path, uintmax_t(end), error);
+            fp = error ? nullptr : fopen(path.c_str(), "r+b");
+        }
+    }
+    else if (fp)
+    {
+        fclose(fp);
+        fp = nullptr;
+    }
+
+    if (!fp)
+    {
+        fp = fopen(path.c_str(), "wb");
+        if (!fp)
+            return false;
+
+        uint8_t header[JournalHeaderSize] = { 0 };
+        uint32_t version = CurrentJournalVersion;
+        memcpy(header, JournalMagic, 4);
+        memcpy(header + 4, &version, 4);
+        memcpy(header + 8, &baseStamp, 4);
+
+        end = long(JournalHeaderSize);
+        if (fwrite(header, 1, JournalHeaderSize, fp) != JournalHeaderSize)
+        {
+            fclose(fp);
+            return false;
+        }
+    }
+
+    uint32_t count = uint32_t(cells.size());
+    std::vector<uint8_t> block(GetBlockSize(count));
+    memcpy(block.data(), &count, 4);
+
+    uint8_t* cellData = block.data() + 4;
+    for (const auto& cell : cells)
+    {
+        memcpy(cellData, &cell.Index, 4);
+        cellData[4] = uint8_t(cell.Cell.State);
+        cellData[5] = cell.Cell.Tile;
+        cellData[6] = cell.Cell.Flags;
+        cellData += JournalCellSize;
+    }
+
+    uint32_t checksum = MapCodec::GetChecksum(block.data(), block.size() - 4);
+    memcpy(cellData, &checksum, 4);
+
+    bool valid = fseek(fp, end, SEEK_SET) == 0 && fwrite(block.data(), 1, block.size(), fp) == block.size();
+    valid = fflush(fp) == 0 && valid;
+
+    fclose(fp);
+    return valid;
+}
+
+bool MapJournal::Replay(std::string_view filepath, uint32_t baseStamp, Map& map)
+{
+    FILE* fp = fopen(std::string(filepath).c_str(), "rb");
+    if (!fp)
+        return false;
+
+    if (!ReadHeader(fp, baseStamp))
+    {
+        fclose(fp);
+        return false;
+    }
+
+    long fileSize = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1;
+    long end = long(JournalHeaderSize);
+
+    size_t cellCount = size_t(map.GetWidth()) * map.GetHeight();
+    std::vector<uint8_t> block;
+
+    while (fileSize > end && fseek(fp, end, SEEK_SET) == 0 && ReadBlock(fp, fileSize - end, block))
+    {
+        end += long(block.size());
+
+        uint32_t count = 0;
+        memcpy(&count, block.data(), 4);
+
+        const uint8_t* cellData = block.data() + 4;
+        for (uint32_t i = 0; i < count; i++, cellData += JournalCellSize)
+        {
+            uint32_t index = 0;
+            memcpy(&index, cellData, 4);
+            if (index >= cellCount)
+                continue;
+
+            MapCell cell;
+            cell.State = CellState(cellData[4]);
+            cell.Tile = cellData[5];
+            cell.Flags = cellData[6];
+
+            int x = 0;
+            int y = 0;
+            map.GetCellXY(index, x, y);
+            map.SetCellRaw(x, y, cell);
+        }
+    }
+
+    fclose(fp);
+    return true;
+}
+
+void MapJournal::Remove(std::string_view filepath)
+{
+    std::error_code error;
+    std::filesystem::remove(std::string(filepath), error);
+}
@@ -0,0 +1,354 @@
+#include "map_mesh.h"
+
+#include <algorithm>
+
+void MapMeshData::Clear()
+{
+    Vertices.clear();
+    TexCoords.clear();
+    TileRanges.clear();
+    Normals.clear();
+    Colors.clear();
+    Indices.clear();
+    FaceCount = 0;
+}
+
+void MapMeshBuilder::SetAtlasSize(int width, int height)
+{
+    AtlasWidth = std::max(width, 1);
+    AtlasHeight = std::max(height, 1);
+}
+
+void MapMeshBuilder::GetTileUs(uint8_t tile, float& uStart, float& uEnd) const
+{
+    uStart = float(AtlasHeight * (tile - 1));
+    uEnd = uStart + AtlasHeight - 1;
+
+    uStart /= AtlasWidth;
+    uEnd /= AtlasWidth;
+}
+
+void MapMeshBuilder::AddQuad(const QuadVertex* vertices, float tileStart, float tileWidth, float normalX, float normalY, float normalZ, uint8_t shade, MapMeshData& mesh)
+{
+    uint16_t first = uint16_t(mesh.GetVertexCount());
+
+    for (int i = 0; i < 4; i++)
+    {
+        const QuadVertex& vertex = vertices[i];
+        mesh.Vertices.insert(mesh.Vertices.end(), { vertex.X, vertex.Y, vertex.Z });
+        mesh.TexCoords.insert(mesh.TexCoords.end(), { vertex.U, vertex.V });
+        mesh.TileRanges.insert(mesh.TileRanges.end(), { tileStart, tileWidth });
+        mesh.Normals.insert(mesh.Normals.end(), { normalX, normalY, normalZ });
+        mesh.Colors.insert(mesh.Colors.end(), { shade, shade, shade, 255 });
+    }
+
+    // the same two triangles rlgl makes of a quad, so the faces wind the way they always have
+    mesh.Indices.insert(mesh.Indices.end(), { first, uint16_t(first + 1), uint16_t(first + 2), first, uint16_t(first + 2), uint16_t(first + 3) });
+    mesh.FaceCount++;
+}
+
+// u goes one tile width for each cell along a face, so a single cell's face spans its tile exactly
+void MapMeshBuilder::AddFloor(int x, int y, int width, int height, MapMeshData& mesh) const
+{
+    float uStart = 0;
+    float uEnd = 1;
+    GetTileUs(FloorTile, uStart, uEnd);
+
+    float tileWidth = uEnd - uStart;
+    float uFar = uStart + tileWidth * width;
+
+    float minX = float(x);
+    float minY = float(y);
+    float maxX = float(x + width);
+    float maxY = float(y + height);
+
+    QuadVertex vertices[4] =
+    {
+        { minX, minY, 0, uStart, 0 },
+        { maxX, minY, 0, uFar, 0 },
+        { maxX, maxY, 0, uFar, float(height) },
+        { minX, maxY, 0, uStart, float(height) },
+    };
+
+    AddQuad(vertices, uStart, tileWidth, 0, 0, 1, 255, mesh);
+}
+
+void MapMeshBuilder::AddCeiling(int x, int y, int width, int height, MapMeshData& mesh) const
+{
+    float uStart = 0;
+    float uEnd = 1;
+    GetTileUs(CeilingTile, uStart, uEnd);
+
+    float tileWidth = uEnd - uStart;
+    float uFar = uStart + tileWidth * width;
+
+    float minX = float(x);
+    float minY = float(y);
+    float maxX = float(x + width);
+    float maxY = float(y + height);
+
+    QuadVertex vertices[4] =
+    {
+        { minX, minY, 1, uStart, 0 },
+        { minX, maxY, 1, uStart, float(height) },
+        { maxX, maxY, 1, uFar, float(height) },
+        { maxX, minY, 1, uFar, 0 },
+    };
+
+    AddQuad(vertices, uStart, tileWidth, 0, 0, -1, 255, mesh);
+}
+
+void MapMeshBuilder::AddWall(int x, int y, int length, uint8_t tile, WallSide side, MapMeshData& mesh) const
+{
+    float uStart = 0;
+    float uEnd = 1;
+    GetTileUs(tile, uStart, uEnd);
+
+    float tileWidth = uEnd - uStart;
+    float uFar = uStart + tileWidth * length;
+
+    float fx = float(x);
+    float fy = float(y);
+    float run = float(length);
+
+    switch (side)
+    {
+    case WallSide::North:
+    {
+        QuadVertex vertices[4] =
+        {
+            { fx + run, fy + 1, 0, uStart, 1 },
+            { fx, fy + 1, 0, uFar, 1 },
+            { fx, fy + 1, 1, uFar, 0 },
+            { fx + run, fy + 1, 1, uStart, 0 },
+        };
+        AddQuad(vertices, uStart, tileWidth, 0, 1, 0, 255, mesh);
+        break;
+    }
+
+    case WallSide::South:
+    {
+        QuadVertex vertices[4] =
+        {
+            { fx + run, fy, 0, uStart, 1 },
+            { fx + run, fy, 1, uStart, 0 },
+            { fx, fy, 1, uFar, 0 },
+            { fx, fy, 0, uFar, 1 },
+        };
+        AddQuad(vertices, uStart, tileWidth, 0, -1, 0, 128, mesh);
+        break;
+    }
+
+    case WallSide::East:
+    {
+        QuadVertex vertices[4] =
+        {
+            { fx + 1, fy, 0, uStart, 1 },
+            { fx + 1, fy + run, 0, uFar, 1 },
+            { fx + 1, fy + run, 1, uFar, 0 },
+            { fx + 1, fy, 1, uStart, 0 },
+        };
+        AddQuad(vertices, uStart, tileWidth, 1, 0, 0, 196, mesh);
+        break;
+    }
+
+    case WallSide::West:
+    {
+        QuadVertex vertices[4] =
+        {
+            { fx, fy, 0, uStart, 1 },
+            { fx, fy, 1, uStart, 0 },
+            { fx, fy + run, 1, uFar, 0 },
+            { fx, fy + run, 0, uFar, 1 },
+        };
+        AddQuad(vertices, uStart, tileWidth, -1, 0, 0, 200, mesh);
+        break;
+    }
+    }
+}
+
+uint8_t MapMeshBuilder::GetFaceMask(const Map& map, int x, int y)
+{
+    MapCell cell = map.GetCell(x, y);
+    if (cell.State == CellState::Empty || cell.IsUnknown())
+        return 0;
+
+    uint8_t mask = 0;
+    if (!map.GetCellSolid(x, y + 1))
+        mask |= 1 << uint8_t(WallSide::North);
+    if (!map.GetCellSolid(x, y - 1))
+        mask |= 1 << uint8_t(WallSide::South);
+    if (!map.GetCellSolid(x + 1, y))
+        mask |= 1 << uint8_t(WallSide::East);
+    if (!map.GetCellSolid(x - 1, y))
+        mask |= 1 << uint8_t(WallSide::West);
+
+    return mask;
+}
+
+uint8_t MapMeshBuilder::BuildCell(const Map& map, int x, int y, MapMeshData& mesh) const
+{
+    if (!map.GetCellSolid(x, y))
+    {
+        AddFloor(x, y, 1, 1, mesh);
+        AddCeiling(x, y, 1, 1, mesh);
+        return 0;
+    }
+
+    // unknown cells of a streamed map have a mask of 0, so nothing is built for them
+    uint8_t mask = GetFaceMask(map, x, y);
+    if (mask == 0)
+        return 0;
+
+    uint8_t tile = map.GetCellTile(x, y);
+    for (uint8_t side = 0; side < 4; side++)
+    {
+        if (mask & (1 << side))
+            AddWall(x, y, 1, tile, WallSide(side), mesh);
+    }
+
+    return mask;
+}
+
+void MapMeshBuilder::BuildArea(const Map& map, int minX, int minY, int maxX, int maxY, MapMeshData& mesh) const
+{
+    minX = std::max(minX, 0);
+    minY = std::max(minY, 0);
+    maxX = std::min(maxX, map.GetWidth());
+    maxY = std::min(maxY, map.GetHeight());
+
+    for (int y = minY; y < maxY; y++)
+    {
+        for (int x = minX; x < maxX; x++)
+            BuildCell(map, x, y, mesh);
+    }
+}
+
+void MapMeshBuilder::GetCellFaces(const Map& map, int x, int y, uint8_t faceMask, std::vector<CellFace>& faces)
+{
+    if (!map.GetCellSolid(x, y))
+    {
+        faces.push_back(CellFace{ x, y, 0, CellFace::FloorSide });
+        return;
+    }
+
+    uint8_t tile = map.GetCellTile(x, y);
+    for (uint8_t side = 0; side < 4; side++)
+    {
+        if (faceMask & (1 << side))
+            faces.push_back(CellFace{ x, y, tile, side });
+    }
+}
+
+// the plane a face is in and where it is along it, north and south walls lie in rows and east and west walls in columns
+// floors are sorted by row then column, which is the order the rectangles are grown in
+static void GetFacePlane(const CellFace& face, int& plane, int& along)
+{
+    bool inColumn = face.Side == uint8_t(WallSide::East) || face.Side == uint8_t(WallSide::West);
+    plane = inColumn ? face.X : face.Y;
+    along = inColumn ? face.Y : face.X;
+}
+
+void MapMeshBuilder::BuildMerged(std::vector<CellFace>& faces, MapMeshData& mesh) const
+{
+    std::sort(faces.begin(), faces.end(), [](const CellFace& a, const CellFace& b)
+        {
+            int planeA = 0;
+            int alongA = 0;
+            int planeB = 0;
+            int alongB = 0;
+            GetFacePlane(a, planeA, alongA);
+            GetFacePlane(b, planeB, alongB);
+
+            if (a.Side != b.Side)
+                return a.Side < b.Side;
+            if (planeA != planeB)
+                return planeA < planeB;
+            if (a.Tile != b.Tile)
+                return a.Tile < b.Tile;
+            return alongA < alongB;
+        });
+
+    // walls, each run of touching faces in one plane with one tile becomes a quad
+    size_t index = 0;
+    while (index < faces.size() && faces[index].Side != CellFace::FloorSide)
+    {
+        const CellFace& first = faces[index];
+        int plane = 0;
+        int along = 0;
+        GetFacePlane(first, plane, along);
+
+        size_t end = index + 1;
+        while (end < faces.size())
+        {
+            int nextPlane = 0;
+            int nextAlong = 0;
+            GetFacePlane(faces[end], nextPlane, nextAlong);
+
+            if (faces[end].Side != first.Side || faces[end].Tile != first.Tile || nextPlane != plane || nextAlong != along + int(end - index))
+                break;
+            end++;
+        }
+
+        AddWall(first.X, first.Y, int(end - index), first.Tile, WallSide(first.Side), mesh);
+        index = end;
+    }
+
+    // floors, runs along each row are grown down into the rows below while the next row has a run with the same ends
+    struct FloorArea
+    {
+        int X = 0;
+        int Y = 0;
+        int Width = 0;
+        int Height = 0;
+    };
+
+    std::vector<FloorArea> open;
+    std::vector<FloorArea> growing;
+
+    auto addArea = [this, &mesh](const FloorArea& area)
+    {
+        AddFloor(area.X, area.Y, area.Width, area.Height, mesh);
+        AddCeiling(area.X, area.Y, area.Width, area.Height, mesh);
+    };
+
+    while (index < faces.size())
+    {
+        int row = faces[index].Y;
+        growing.clear();
+
+        size_t openIndex = 0;
+        while (index < faces.size() && faces[index].Y == row)
+        {
+            int start = faces[index].X;
+            size_t end = index + 1;
+            while (end < faces.size() && faces[end].Y == row && faces[end].X == start + int(end - index))
+                end++;
+
+            int width = int(end - index);
+            index = end;
+
+            // the open areas are in order along the row, as the runs are
+            while (openIndex < open.size() && open[openIndex].X < start)
+                addArea(open[openIndex++]);
+
+            if (openIndex < open.size() && open[openIndex].X == start && open[openIndex].Width == width && open[openIndex].Y + open[openIndex].Height == row)
+            {
+                growing.push_back(open[openIndex++]);
+                growing.back().Height++;
+            }
+            else
+            {
+                growing.push_back(FloorArea{ start, row, width, 1 });
+            }
+        }
+
+        while (openIndex < open.size())
+            addArea(open[openIndex++]);
+
+        std::swap(open, growing);
+    }
+
+    for (const auto& area : open)
+        addArea(area);
+}
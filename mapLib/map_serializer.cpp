@@ -1,54 +1,447 @@
 #include "map_serializer.h"
+#include "map_codec.h"
+#include "map_journal.h"
 
-constexpr int CurrentMapVersion = 2;
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <string>
 
-bool MapSerializer::WriteResource(Map& map, std::string_view filepath)
+constexpr int CurrentMapVersion = 3;
+
+// version 3 is a header, a table of sections and then the sections, each packed on its own
+// the header is the version, the size and the section count, followed by the table and a checksum of both
+constexpr size_t HeaderSize = 16;
+constexpr size_t SectionEntrySize = 32;
+
+static constexpr char StateSectionId[4] = { 'S', 'T', 'A', 'T' };
+static constexpr char TileSectionId[4] = { 'T', 'I', 'L', 'E' };
+static constexpr char FlagSectionId[4] = { 'F', 'L', 'A', 'G' };
+
+// sections are packed in frames, so a chunked map never needs a whole plane in one buffer
+// each frame is its size, its packed size, and the packed bytes, a packed size of 0 means the bytes are stored as they are
+constexpr size_t PackFrameSize = size_t(1) << 20;
+
+struct SectionEntry
 {
-    FILE* fp = fopen(filepath.data(), "w");
+    char Id[4] = { 0 };
+    uint32_t Codec = 0;
+    uint64_t Offset = 0;
+    uint64_t Size = 0;
+    uint32_t Checksum = 0;
+};
 
-    if (!fp)
+constexpr uint32_t PackedFramesCodec = 1;
+
+static void Put32(uint8_t* target, uint32_t value)
+{
+    memcpy(target, &value, 4);
+}
+
+static uint32_t Get32(const uint8_t* source)
+{
+    uint32_t value = 0;
+    memcpy(&value, source, 4);
+    return value;
+}
+
+static void PackFrames(size_t count, const std::function<const uint8_t*(size_t start, size_t size)>& getFrame, std::vector<uint8_t>& section)
+{
+    for (size_t start = 0; start < count; start += PackFrameSize)
+    {
+        size_t size = count - start < PackFrameSize ? count - start : PackFrameSize;
+        const uint8_t* bytes = getFrame(start, size);
+
+        size_t frameStart = section.size();
+        section.resize(frameStart + 8);
+        MapCodec::Compress(bytes, size, section);
+
+        size_t packedSize = section.size() - frameStart - 8;
+        if (packedSize >= size)
+        {
+            section.resize(frameStart + 8);
+            section.insert(section.end(), bytes, bytes + size);
+            packedSize = 0;
+        }
+
+        Put32(section.data() + frameStart, uint32_t(size));
+        Put32(section.data() + frameStart + 4, uint32_t(packedSize));
+    }
+}
+
+// each frame goes straight into the output when there is one, otherwise through a scratch buffer to setBytes
+static bool UnpackFrames(const std::vector<uint8_t>& section, size_t count, uint8_t* output, const std::function<void(size_t start, const uint8_t* bytes, size_t size)>& setBytes)
+{
+    std::vector<uint8_t> scratch;
+    size_t read = 0;
+    size_t start = 0;
+
+    while (start < count)
+    {
+        if (section.size() - read < 8)
+            return false;
+
+        size_t size = Get32(section.data() + read);
+        size_t packedSize = Get32(section.data() + read + 4);
+        read += 8;
+
+        size_t storedSize = packedSize == 0 ? size : packedSize;
+        if (size == 0 || size > count - start || section.size() - read < storedSize)
+            return false;
+
+        uint8_t* target = output ? output + start : nullptr;
+        if (!target)
+        {
+            scratch.resize(size);
+            target = scratch.data();
+        }
+
+        if (packedSize == 0)
+            memcpy(target, section.data() + read, size);
+        else if (!MapCodec::Decompress(section.data() + read, packedSize, target, size))
+            return false;
+
+        if (!output)
+            setBytes(start, target, size);
+
+        read += storedSize;
+        start += size;
+    }
+
+    return read == section.size();
+}
+
+// dense maps pack their planes in place, chunked ones gather each frame from their cells
+static void PackPlane(const Map& map, int plane, std::vector<uint8_t>& section)
+{
+    const uint8_t* dense = nullptr;
+    if (map.GetStorage() == MapStorage::Dense)
+    {
+        dense = plane == 0 ? reinterpret_cast<const uint8_t*>(map.GetStatePlane().data())
+            : plane == 1 ? map.GetTilePlane().data()
+            : map.GetFlagPlane().data();
+    }
+
+    std::vector<uint8_t> frame;
+    auto getFrame = [&](size_t start, size_t size) -> const uint8_t*
+    {
+        if (dense)
+            return dense + start;
+
+        frame.resize(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            int x = 0;
+            int y = 0;
+            map.GetCellXY(start + i, x, y);
+
+            MapCell cell = map.GetCell(x, y);
+            frame[i] = plane == 0 ? uint8_t(cell.State) : plane == 1 ? cell.Tile : cell.Flags;
+        }
+        return frame.data();
+    };
+
+    PackFrames(size_t(map.GetWidth()) * map.GetHeight(), getFrame, section);
+}
+
+static bool UnpackPlane(Map& map, int plane, const std::vector<uint8_t>& section)
+{
+    uint8_t* dense = nullptr;
+    if (map.GetStorage() == MapStorage::Dense)
+    {
+        dense = plane == 0 ? reinterpret_cast<uint8_t*>(map.GetStatePlane().data())
+            : plane == 1 ? map.GetTilePlane().data()
+            : map.GetFlagPlane().data();
+    }
+
+    auto setBytes = [&](size_t start, const uint8_t* bytes, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            int x = 0;
+            int y = 0;
+            map.GetCellXY(start + i, x, y);
+
+            MapCell cell = map.GetCell(x, y);
+            if (plane == 0)
+                cell.State = CellState(bytes[i]);
+            else if (plane == 1)
+                cell.Tile = bytes[i];
+            else
+                cell.Flags = bytes[i];
+
+            map.SetCellRaw(x, y, cell);
+        }
+    };
+
+    return UnpackFrames(section, size_t(map.GetWidth()) * map.GetHeight(), dense, setBytes);
+}
+
+// the section table, checked against the checksum after it
+// that checksum covers every section's checksum too, so it is kept as the stamp of the file's contents
+static bool ReadSectionTable(FILE* fp, int& width, int& height, std::vector<SectionEntry>& sections, uint32_t& stamp)
+{
+    uint8_t header[HeaderSize] = { 0 };
+    if (fseek(fp, 0, SEEK_SET) != 0 || fread(header, 1, HeaderSize, fp) != HeaderSize)
         return false;
 
-    bool valid = true;
+    width = int(Get32(header + 4));
+    height = int(Get32(header + 8));
+    uint32_t sectionCount = Get32(header + 12);
 
-    int version = CurrentMapVersion;
-    fwrite(&version, 4, 1, fp);
-  
-    int xSize = int(map.GetWidth());
-    int ySize = int(map.GetHeight());
+    if (int(Get32(header)) != CurrentMapVersion || width <= 0 || height <= 0 || sectionCount > 1024)
+        return false;
 
-    if (fwrite(&xSize, 4, 1, fp) != 1 || fwrite(&ySize, 4, 1, fp) != 1)
-        valid = false;
+    std::vector<uint8_t> table(sectionCount * SectionEntrySize + 4);
+    if (fread(table.data(), 1, table.size(), fp) != table.size())
+        return false;
 
-    if (xSize == 0 || ySize == 0)
-        valid = false;
+    uint32_t checksum = MapCodec::GetChecksum(header, HeaderSize);
+    checksum = MapCodec::GetChecksum(table.data(), table.size() - 4, checksum);
+    if (checksum != Get32(table.data() + table.size() - 4))
+        return false;
 
-    if (valid)
+    stamp = checksum;
+
+    sections.resize(sectionCount);
+    for (uint32_t i = 0; i < sectionCount; i++)
+    {
+        const uint8_t* entry = table.data() + i * SectionEntrySize;
+        memcpy(sections[i].Id, entry, 4);
+        sections[i].Codec = Get32(entry + 4);
+        memcpy(&sections[i].Offset, entry + 8, 8);
+        memcpy(&sections[i].Size, entry + 16, 8);
+        sections[i].Checksum = Get32(entry + 24);
+    }
+
+    return true;
+}
+
+// one read for the whole section, then its checksum
+static bool ReadSectionData(FILE* fp, const SectionEntry& section, std::vector<uint8_t>& data)
+{
+    if (section.Codec != PackedFramesCodec || section.Offset > uint64_t(LONG_MAX))
+        return false;
+
+    data.resize(size_t(section.Size));
+    if (fseek(fp, long(section.Offset), SEEK_SET) != 0 || (!data.empty() && fread(data.data(), 1, data.size(), fp) != data.size()))
+        return false;
+
+    return MapCodec::GetChecksum(data.data(), data.size()) == section.Checksum;
+}
+
+static const SectionEntry* FindSection(const std::vector<SectionEntry>& sections, const char id[4])
+{
+    for (const auto& section : sections)
     {
-        for (auto& cell : map.GetCellsList())
+        if (memcmp(section.Id, id, 4) == 0)
+            return &section;
+    }
+
+    return nullptr;
+}
+
+// the planes are read and unpacked in turn, each step reports its share of the progress
+static bool ReadVersion3(FILE* fp, Map& map, const std::function<bool(float)>& progress, uint32_t& stamp)
+{
+    int width = 0;
+    int height = 0;
+    std::vector<SectionEntry> sections;
+    if (!ReadSectionTable(fp, width, height, sections, stamp))
+        return false;
+
+    map.ResizeRaw(width, height);
+
+    const char* planeIds[3] = { StateSectionId, TileSectionId, FlagSectionId };
+    std::vector<uint8_t> data;
+
+    for (int plane = 0; plane < 3; plane++)
+    {
+        // a file without flags has none set
+        const SectionEntry* section = FindSection(sections, planeIds[plane]);
+        if (!section)
         {
-            fwrite(&cell.State, 1, 1, fp);
-            fwrite(&cell.Tile, 1, 1, fp);
+            if (plane != 2)
+                return false;
+            continue;
         }
+
+        if (!ReadSectionData(fp, *section, data) || !progress((plane + 0.5f) / 3))
+            return false;
+
+        if (!UnpackPlane(map, plane, data) || !progress((plane + 1.0f) / 3))
+            return false;
     }
 
+    return true;
+}
+
+bool MapSerializer::WriteResource(Map& map, std::string_view filepath, const std::vector<MapFileSection>& extraSections)
+{
+    int width = map.GetWidth();
+    int height = map.GetHeight();
+    if (width <= 0 || height <= 0)
+        return false;
+
+    // every section is packed before anything is written, so the table can be written first
+    std::vector<std::vector<uint8_t>> sectionData(3 + extraSections.size());
+    std::vector<SectionEntry> sections(sectionData.size());
+
+    const char* planeIds[3] = { StateSectionId, TileSectionId, FlagSectionId };
+    for (int plane = 0; plane < 3; plane++)
+    {
+        memcpy(sections[plane].Id, planeIds[plane], 4);
+        PackPlane(map, plane, sectionData[plane]);
+    }
+
+    for (size_t i = 0; i < extraSections.size(); i++)
+    {
+        const std::vector<uint8_t>& bytes = extraSections[i].Data;
+        memcpy(sections[3 + i].Id, extraSections[i].Id, 4);
+        PackFrames(bytes.size(), [&](size_t start, size_t) { return bytes.data() + start; }, sectionData[3 + i]);
+    }
+
+    std::vector<uint8_t> header(HeaderSize + sections.size() * SectionEntrySize + 4, 0);
+    Put32(header.data(), uint32_t(CurrentMapVersion));
+    Put32(header.data() + 4, uint32_t(width));
+    Put32(header.data() + 8, uint32_t(height));
+    Put32(header.data() + 12, uint32_t(sections.size()));
+
+    uint64_t offset = header.size();
+    for (size_t i = 0; i < sections.size(); i++)
+    {
+        sections[i].Codec = PackedFramesCodec;
+        sections[i].Offset = offset;
+        sections[i].Size = sectionData[i].size();
+        sections[i].Checksum = MapCodec::GetChecksum(sectionData[i].data(), sectionData[i].size());
+        offset += sections[i].Size;
+
+        uint8_t* entry = header.data() + HeaderSize + i * SectionEntrySize;
+        memcpy(entry, sections[i].Id, 4);
+        Put32(entry + 4, sections[i].Codec);
+        memcpy(entry + 8, &sections[i].Offset, 8);
+        memcpy(entry + 16, &sections[i].Size, 8);
+        Put32(entry + 24, sections[i].Checksum);
+    }
+
+    Put32(header.data() + header.size() - 4, MapCodec::GetChecksum(header.data(), header.size() - 4));
+
+    FILE* fp = fopen(std::string(filepath).c_str(), "wb");
+    if (!fp)
+        return false;
+
+    bool valid = fwrite(header.data(), 1, header.size(), fp) == header.size();
+    for (const auto& data : sectionData)
+        valid = valid && (data.empty() || fwrite(data.data(), 1, data.size(), fp) == data.size());
+
+    fclose(fp);
+
+    // the cells in the journal are in the new base now
+    if (valid)
+        MapJournal::Remove(MapJournal::GetJournalPath(filepath));
+
+    return valid;
+}
+
+bool MapSerializer::ReadStamp(std::string_view filepath, uint32_t& stamp)
+{
+    FILE* fp = fopen(std::string(filepath).c_str(), "rb");
+    if (!fp)
+        return false;
+
+    int width = 0;
+    int height = 0;
+    std::vector<SectionEntry> sections;
+    bool valid = ReadSectionTable(fp, width, height, sections, stamp);
+
     fclose(fp);
     return valid;
 }
 
-Map MapSerializer::ReadResource(std::string_view filepath)
+bool MapSerializer::WriteJournal(std::string_view filepath, uint32_t baseStamp, const std::vector<JournalCell>& cells)
+{
+    uint32_t stamp = 0;
+    if (!ReadStamp(filepath, stamp) || stamp != baseStamp)
+        return false;
+
+    return MapJournal::Append(MapJournal::GetJournalPath(filepath), baseStamp, cells);
+}
+
+bool MapSerializer::ReadSection(std::string_view filepath, const char id[4], std::vector<uint8_t>& data)
+{
+    data.clear();
+
+    FILE* fp = fopen(std::string(filepath).c_str(), "rb");
+    if (!fp)
+        return false;
+
+    int width = 0;
+    int height = 0;
+    std::vector<SectionEntry> sections;
+    std::vector<uint8_t> packed;
+    uint32_t stamp = 0;
+
+    const SectionEntry* section = nullptr;
+    bool valid = ReadSectionTable(fp, width, height, sections, stamp)
+        && (section = FindSection(sections, id)) != nullptr
+        && ReadSectionData(fp, *section, packed);
+
+    fclose(fp);
+
+    if (!valid)
+        return false;
+
+    // the frames carry their own sizes
+    size_t size = 0;
+    for (size_t read = 0; read + 8 <= packed.size();)
+    {
+        size_t frameSize = Get32(packed.data() + read);
+        size_t packedSize = Get32(packed.data() + read + 4);
+        size += frameSize;
+        read += 8 + (packedSize == 0 ? frameSize : packedSize);
+    }
+
+    data.resize(size);
+    return UnpackFrames(packed, size, data.data(), nullptr);
+}
+
+bool MapSerializer::ReportProgress(float progress) const
+{
+    return !OnProgress || OnProgress(progress);
+}
+
+Map MapSerializer::ReadResource(std::string_view filepath, MapStorage storage)
 {
     Map map;
+    ReadResource(filepath, map, storage);
+    return map;
+}
+
+bool MapSerializer::ReadResource(std::string_view filepath, Map& map, MapStorage storage)
+{
+    map = Map();
+    map.SetStorage(storage);
 
-    FILE* fp = fopen(filepath.data(), "r");
+    FILE* fp = fopen(std::string(filepath).c_str(), "rb");
 
     if (!fp)
-        return map;
+        return false;
 
     bool valid = true;
 
     int version = 0;
     fread(&version, 4, 1, fp);
+
+    if (MapImage::IsImageHeader(&version, sizeof(version)))
+    {
+        fclose(fp);
+
+        std::shared_ptr<MapImage> image = MapImage::Open(filepath);
+        map.UseImage(image);
+        map.SetStorage(storage);
+        return image != nullptr;
+    }
+
     switch (version)
     {
 		default:
@@ -68,20 +461,50 @@ Map MapSerializer::ReadResource(std::string_view filepath)
 			if (xSize == 0 || ySize == 0)
 				valid = false;
 
-			std::vector<uint8_t> cells;
+			std::vector<uint8_t> row;
 			if (valid)
 			{
-				map.GetCellsList().resize(xSize * ySize);
-				for (auto& cell : map.GetCellsList())
+				map.ResizeRaw(xSize, ySize);
+				CellPlane<CellState> states = map.GetStatePlane();
+				CellPlane<uint8_t> tiles = map.GetTilePlane();
+
+				row.resize(size_t(xSize));
+				for (int y = 0; y < ySize; y++)
 				{
-					fread(&cell.Tile, 1, 1, fp);
-                    cell.State = cell.Tile == 0 ? CellState::Empty : CellState::Solid;
+					if (fread(row.data(), 1, row.size(), fp) != row.size())
+					{
+						valid = false;
+						break;
+					}
+
+					if ((y & 255) == 0 && !ReportProgress(float(y) / ySize))
+					{
+						valid = false;
+						break;
+					}
+
+					for (int x = 0; x < xSize; x++)
+					{
+						CellState state = row[x] == 0 ? CellState::Empty : CellState::Solid;
+						if (!states.empty())
+						{
+							states[size_t(y) * xSize + x] = state;
+							tiles[size_t(y) * xSize + x] = row[x];
+						}
+						else
+						{
+							MapCell cell;
+							cell.State = state;
+							cell.Tile = row[x];
+							map.SetCellRaw(x, y, cell);
+						}
+					}
 				}
 			}
         }
 		break;
 
-        case CurrentMapVersion:
+        case 2:
         {
 			int xSize = 0;
 			int ySize = 0;
@@ -92,21 +515,82 @@ Map MapSerializer::ReadResource(std::string_view filepath)
 			if (xSize == 0 || ySize == 0)
 				valid = false;
 
-			std::vector<uint8_t> cells;
+			std::vector<uint8_t> row;
 			if (valid)
 			{
-				map.GetCellsList().resize(xSize * ySize);
-				for (auto& cell : map.GetCellsList())
+				map.ResizeRaw(xSize, ySize);
+				CellPlane<CellState> states = map.GetStatePlane();
+				CellPlane<uint8_t> tiles = map.GetTilePlane();
+
+				// read a row at a time and split it into the planes
+				row.resize(size_t(xSize) * 2);
+				for (int y = 0; y < ySize; y++)
 				{
-					fread(&cell.State, 1, 1, fp);
-					fread(&cell.Tile, 1, 1, fp);
+					if (fread(row.data(), 1, row.size(), fp) != row.size())
+					{
+						valid = false;
+						break;
+					}
+
+					if ((y & 255) == 0 && !ReportProgress(float(y) / ySize))
+					{
+						valid = false;
+						break;
+					}
+
+					for (int x = 0; x < xSize; x++)
+					{
+						if (!states.empty())
+						{
+							states[size_t(y) * xSize + x] = CellState(row[x * 2]);
+							tiles[size_t(y) * xSize + x] = row[x * 2 + 1];
+						}
+						else
+						{
+							MapCell cell;
+							cell.State = CellState(row[x * 2]);
+							cell.Tile = row[x * 2 + 1];
+							map.SetCellRaw(x, y, cell);
+						}
+					}
 				}
 			}
         }
         break;
+
+        case CurrentMapVersion:
+        {
+            auto progress = [this](float value) { return ReportProgress(value); };
+
+            uint32_t stamp = 0;
+            valid = ReadVersion3(fp, map, progress, stamp);
+            if (valid)
+                MapJournal::Replay(MapJournal::GetJournalPath(filepath), stamp, map);
+        }
+        break;
     }
     
     fclose(fp);
 
+    // a damaged or cancelled read gives an empty map, not a partly filled one
+    if (!valid)
+    {
+        map = Map();
+        map.SetStorage(storage);
+    }
+
+    map.UpdateOccupancy();
+    return valid;
+}
+
+bool MapSerializer::WriteImage(const Map& map, std::string_view filepath)
+{
+    return MapImage::Write(map, filepath);
+}
+
+Map MapSerializer::ReadImage(std::string_view filepath)
+{
+    Map map;
+    map.UseImage(MapImage::Open(filepath));
     return map;
 }
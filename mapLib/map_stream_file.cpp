@@ -0,0 +1,244 @@
+#include "map_stream_file.h"
+
+#include <cstring>
+
+static constexpr char StreamMagic[4] = { 'R', 'M', 'S', 'F' };
+constexpr int CurrentStreamVersion = 1;
+
+// offsets past 2GB need the 64 bit seek
+static bool SeekTo(FILE* fp, uint64_t offset)
+{
+#if defined(_WIN32)
+    return _fseeki64(fp, int64_t(offset), SEEK_SET) == 0;
+#else
+    return fseeko(fp, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+// the palette count, the index width, and three bytes per palette cell ahead of the packed indexes
+static uint32_t GetRecordSize(const MapChunkStore::Chunk& chunk)
+{
+    size_t words = (size_t(MapChunkStore::ChunkCells) * chunk.IndexBits + 63) / 64;
+    return uint32_t(4 + chunk.Palette.size() * 3 + words * 8);
+}
+
+static bool WriteChunk(FILE* fp, const MapChunkStore::Chunk& chunk)
+{
+    uint16_t paletteCount = uint16_t(chunk.Palette.size());
+    uint8_t header[4] = { uint8_t(paletteCount & 0xff), uint8_t(paletteCount >> 8), uint8_t(chunk.IndexBits), 0 };
+
+    std::vector<uint8_t> palette;
+    palette.reserve(chunk.Palette.size() * 3);
+    for (const auto& cell : chunk.Palette)
+    {
+        palette.push_back(uint8_t(cell.State));
+        palette.push_back(cell.Tile);
+        palette.push_back(cell.Flags);
+    }
+
+    return fwrite(header, 1, 4, fp) == 4
+        && fwrite(palette.data(), 1, palette.size(), fp) == palette.size()
+        && (chunk.Indices.empty() || fwrite(chunk.Indices.data(), 8, chunk.Indices.size(), fp) == chunk.Indices.size());
+}
+
+MapStreamFile::~MapStreamFile()
+{
+    Close();
+}
+
+std::string MapStreamFile::GetStreamPath(std::string_view mapPath)
+{
+    std::string path(mapPath);
+
+    size_t extension = path.find_last_of('.');
+    size_t folder = path.find_last_of("/\\");
+    if (extension != std::string::npos && (folder == std::string::npos || extension > folder))
+        path.resize(extension);
+
+    return path + ".mstream";
+}
+
+// the table is written empty first and filled in once every chunk's offset is known
+bool MapStreamFile::Write(const Map& map, std::string_view filepath)
+{
+    if (map.GetWidth() <= 0 || map.GetHeight() <= 0)
+        return false;
+
+    FILE* fp = fopen(std::string(filepath).c_str(), "wb");
+    if (!fp)
+        return false;
+
+    int version = CurrentStreamVersion;
+    int width = map.GetWidth();
+    int height = map.GetHeight();
+    int chunkShift = MapChunkStore::ChunkShift;
+
+    int chunksX = (width + MapChunkStore::ChunkMask) >> MapChunkStore::ChunkShift;
+    int chunksY = (height + MapChunkStore::ChunkMask) >> MapChunkStore::ChunkShift;
+
+    bool valid = fwrite(StreamMagic, 4, 1, fp) == 1
+        && fwrite(&version, 4, 1, fp) == 1
+        && fwrite(&width, 4, 1, fp) == 1
+        && fwrite(&height, 4, 1, fp) == 1
+        && fwrite(&chunkShift, 4, 1, fp) == 1;
+
+    uint64_t tableOffset = 20;
+    std::vector<uint8_t> table(size_t(chunksX) * chunksY * 12, 0);
+    valid = valid && fwrite(table.data(), 1, table.size(), fp) == table.size();
+
+    uint64_t offset = tableOffset + table.size();
+
+    for (int chunkY = 0; chunkY < chunksY && valid; chunkY++)
+    {
+        for (int chunkX = 0; chunkX < chunksX && valid; chunkX++)
+        {
+            MapChunkStore::Chunk chunk;
+            if (map.GetStorage() == MapStorage::Chunked)
+            {
+                chunk = map.GetChunks().GetChunkAt(chunkX, chunkY);
+            }
+            else
+            {
+                int minX = chunkX << MapChunkStore::ChunkShift;
+                int minY = chunkY << MapChunkStore::ChunkShift;
+
+                // the cells past the edge of the map are never read, they only need to not add to the palette
+                chunk.Fill(map.GetCell(minX, minY));
+                for (int y = minY; y < minY + MapChunkStore::ChunkSize && y < height; y++)
+                {
+                    for (int x = minX; x < minX + MapChunkStore::ChunkSize && x < width; x++)
+                        chunk.SetCell(((y & MapChunkStore::ChunkMask) << MapChunkStore::ChunkShift) | (x & MapChunkStore::ChunkMask), map.GetCell(x, y));
+                }
+            }
+            chunk.Compact();
+
+            uint32_t size = GetRecordSize(chunk);
+            uint8_t* entry = table.data() + (size_t(chunkY) * chunksX + chunkX) * 12;
+            memcpy(entry, &offset, 8);
+            memcpy(entry + 8, &size, 4);
+
+            valid = WriteChunk(fp, chunk);
+            offset += size;
+        }
+    }
+
+    valid = valid && SeekTo(fp, tableOffset) && fwrite(table.data(), 1, table.size(), fp) == table.size();
+
+    fclose(fp);
+    return valid;
+}
+
+bool MapStreamFile::Open(std::string_view filepath)
+{
+    Close();
+
+    FILE* fp = fopen(std::string(filepath).c_str(), "rb");
+    if (!fp)
+        return false;
+
+    char magic[4] = { 0 };
+    int version = 0;
+    int chunkShift = 0;
+
+    bool valid = fread(magic, 4, 1, fp) == 1 && memcmp(magic, StreamMagic, 4) == 0
+        && fread(&version, 4, 1, fp) == 1 && version == CurrentStreamVersion
+        && fread(&Width, 4, 1, fp) == 1
+        && fread(&Height, 4, 1, fp) == 1
+        && fread(&chunkShift, 4, 1, fp) == 1
+        && Width > 0 && Height > 0 && chunkShift == MapChunkStore::ChunkShift;
+
+    if (valid)
+    {
+        ChunksX = (Width + MapChunkStore::ChunkMask) >> MapChunkStore::ChunkShift;
+        ChunksY = (Height + MapChunkStore::ChunkMask) >> MapChunkStore::ChunkShift;
+
+        std::vector<uint8_t> table(size_t(ChunksX) * ChunksY * 12);
+        valid = fread(table.data(), 1, table.size(), fp) == table.size();
+
+        Entries.resize(size_t(ChunksX) * ChunksY);
+        for (size_t i = 0; valid && i < Entries.size(); i++)
+        {
+            memcpy(&Entries[i].Offset, table.data() + i * 12, 8);
+            memcpy(&Entries[i].Size, table.data() + i * 12 + 8, 4);
+        }
+    }
+
+    if (!valid)
+    {
+        fclose(fp);
+        Width = 0;
+        Height = 0;
+        ChunksX = 0;
+        ChunksY = 0;
+        Entries.clear();
+        return false;
+    }
+
+    File = fp;
+    return true;
+}
+
+void MapStreamFile::Close()
+{
+    if (File)
+        fclose(File);
+
+    File = nullptr;
+}
+
+// a chunk that does not read back exactly as it was written is rejected, it is never half loaded
+bool MapStreamFile::ReadChunk(int chunkIndex, MapChunkStore::Chunk& chunk)
+{
+    if (!File || chunkIndex < 0 || chunkIndex >= int(Entries.size()))
+        return false;
+
+    const ChunkEntry& entry = Entries[chunkIndex];
+    if (entry.Size < 4 || !SeekTo(File, entry.Offset))
+        return false;
+
+    std::vector<uint8_t> record(entry.Size);
+    if (fread(record.data(), 1, record.size(), File) != record.size())
+        return false;
+
+    int paletteCount = record[0] | (record[1] << 8);
+    int indexBits = record[2];
+
+    if (paletteCount < 1 || paletteCount > MapChunkStore::ChunkCells)
+        return false;
+
+    if (indexBits != 0 && indexBits != 1 && indexBits != 2 && indexBits != 4 && indexBits != 8 && indexBits != 16)
+        return false;
+
+    if ((indexBits == 0) != (paletteCount == 1) || (indexBits > 0 && (1 << indexBits) < paletteCount))
+        return false;
+
+    size_t words = (size_t(MapChunkStore::ChunkCells) * indexBits + 63) / 64;
+    if (record.size() != 4 + size_t(paletteCount) * 3 + words * 8)
+        return false;
+
+    MapChunkStore::Chunk loaded;
+    loaded.Palette.resize(paletteCount);
+    for (int i = 0; i < paletteCount; i++)
+    {
+        const uint8_t* cell = record.data() + 4 + i * 3;
+        loaded.Palette[i].State = CellState(cell[0]);
+        loaded.Palette[i].Tile = cell[1];
+        loaded.Palette[i].Flags = cell[2];
+    }
+
+    loaded.IndexBits = indexBits;
+    loaded.Indices.resize(words);
+    if (words > 0)
+        memcpy(loaded.Indices.data(), record.data() + 4 + size_t(paletteCount) * 3, words * 8);
+
+    // every index has to land in the palette
+    for (int i = 0; i < MapChunkStore::ChunkCells && indexBits > 0; i++)
+    {
+        int bit = i * indexBits;
+        if (int((loaded.Indices[bit >> 6] >> (bit & 63)) & ((uint64_t(1) << indexBits) - 1)) >= paletteCount)
+            return false;
+    }
+
+    chunk = std::move(loaded);
+    return true;
+}
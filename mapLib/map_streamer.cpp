@@ -0,0 +1,262 @@
+#include "map_streamer.h"
+
+#include <algorithm>
+#include <cmath>
+
+MapStreamer::MapStreamer(Map& map)
+    : WorldMap(map)
+{
+}
+
+MapStreamer::~MapStreamer()
+{
+    Close();
+}
+
+bool MapStreamer::Open(std::string_view filepath)
+{
+    Close();
+
+    if (!File.Open(filepath))
+        return false;
+
+    WorldMap.ResetUnknown(File.GetWidth(), File.GetHeight());
+
+    size_t count = size_t(File.GetChunkCount());
+    States.assign(count, ChunkState::Unknown);
+    ChunkMemory.assign(count, 0);
+    WantedFrame.assign(count, 0);
+    RecentChunks.clear();
+    RecentPositions.assign(count, RecentChunks.end());
+
+    Frame = 0;
+    MemoryUse = 0;
+    LoadedCount = 0;
+    PendingCount = 0;
+
+    Quit = false;
+    Loader = std::thread(&MapStreamer::LoaderLoop, this);
+    return true;
+}
+
+// the map keeps whatever chunks are loaded, it is the caller's to reset
+void MapStreamer::Close()
+{
+    if (Loader.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> guard(Lock);
+            Quit = true;
+        }
+        WakeLoader.notify_all();
+        Loader.join();
+    }
+
+    Requests.clear();
+    Finished.clear();
+    FailedChunks.clear();
+    LoadingChunk = -1;
+
+    File.Close();
+}
+
+void MapStreamer::LoaderLoop()
+{
+    while (true)
+    {
+        int chunkIndex = -1;
+        {
+            std::unique_lock<std::mutex> lock(Lock);
+            WakeLoader.wait(lock, [this]() { return Quit || !Requests.empty(); });
+
+            if (Quit)
+                return;
+
+            chunkIndex = Requests.back();
+            Requests.pop_back();
+            LoadingChunk = chunkIndex;
+        }
+
+        MapChunkStore::Chunk chunk;
+        bool loaded = false;
+        {
+            std::lock_guard<std::mutex> guard(FileLock);
+            loaded = File.ReadChunk(chunkIndex, chunk);
+        }
+
+        std::lock_guard<std::mutex> guard(Lock);
+        if (loaded)
+            Finished.emplace_back(chunkIndex, std::move(chunk));
+        else
+            FailedChunks.push_back(chunkIndex);
+
+        LoadingChunk = -1;
+    }
+}
+
+// distance between the viewer and the middle of a chunk, in chunks
+// stretched up to twice as far behind the view, so the loader spends its time on what is about to be seen
+float MapStreamer::GetChunkDistance(int chunkX, int chunkY, const EntityLocation& loc) const
+{
+    float dx = (chunkX + 0.5f) - loc.Position.x / MapChunkStore::ChunkSize;
+    float dy = (chunkY + 0.5f) - loc.Position.y / MapChunkStore::ChunkSize;
+
+    float distance = sqrtf(dx * dx + dy * dy);
+    float facing = sqrtf(loc.Facing.x * loc.Facing.x + loc.Facing.y * loc.Facing.y);
+    if (distance <= 0 || facing <= 0)
+        return distance;
+
+    float ahead = (dx * loc.Facing.x + dy * loc.Facing.y) / (distance * facing);
+    return distance * (1.5f - 0.5f * ahead);
+}
+
+void MapStreamer::AddChunk(int chunkIndex, MapChunkStore::Chunk&& chunk)
+{
+    if (States[chunkIndex] == ChunkState::Loaded)
+        return;
+
+    size_t memory = chunk.GetMemoryUse();
+    WorldMap.SetChunk(chunkIndex % File.GetChunksX(), chunkIndex / File.GetChunksX(), std::move(chunk));
+
+    States[chunkIndex] = ChunkState::Loaded;
+    ChunkMemory[chunkIndex] = memory;
+    MemoryUse += memory;
+    LoadedCount++;
+
+    RecentChunks.push_front(chunkIndex);
+    RecentPositions[chunkIndex] = RecentChunks.begin();
+}
+
+void MapStreamer::RemoveChunk(int chunkIndex)
+{
+    WorldMap.UnloadChunk(chunkIndex % File.GetChunksX(), chunkIndex / File.GetChunksX());
+
+    States[chunkIndex] = ChunkState::Unknown;
+    MemoryUse -= ChunkMemory[chunkIndex];
+    ChunkMemory[chunkIndex] = 0;
+    LoadedCount--;
+
+    RecentChunks.erase(RecentPositions[chunkIndex]);
+    RecentPositions[chunkIndex] = RecentChunks.end();
+}
+
+void MapStreamer::Update(const EntityLocation& loc)
+{
+    if (!File.IsOpen())
+        return;
+
+    Frame++;
+
+    std::vector<std::pair<int, MapChunkStore::Chunk>> finished;
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        finished.swap(Finished);
+
+        for (int chunkIndex : FailedChunks)
+            States[chunkIndex] = ChunkState::Failed;
+        FailedChunks.clear();
+    }
+
+    for (auto& loaded : finished)
+        AddChunk(loaded.first, std::move(loaded.second));
+
+    // every chunk in range, nearest first
+    Wanted.clear();
+
+    int centerX = int(floorf(loc.Position.x)) >> MapChunkStore::ChunkShift;
+    int centerY = int(floorf(loc.Position.y)) >> MapChunkStore::ChunkShift;
+    int range = int(ceilf(LoadRadius));
+
+    for (int chunkY = std::max(centerY - range, 0); chunkY <= std::min(centerY + range, File.GetChunksY() - 1); chunkY++)
+    {
+        for (int chunkX = std::max(centerX - range, 0); chunkX <= std::min(centerX + range, File.GetChunksX() - 1); chunkX++)
+        {
+            float distance = GetChunkDistance(chunkX, chunkY, loc);
+            if (distance <= LoadRadius)
+                Wanted.emplace_back(distance, chunkY * File.GetChunksX() + chunkX);
+        }
+    }
+
+    std::sort(Wanted.begin(), Wanted.end());
+
+    // wanted chunks move to the front of the recent list, and the budget goes to them nearest first
+    size_t wantedMemory = 0;
+    for (const auto& wanted : Wanted)
+    {
+        int chunkIndex = wanted.second;
+        WantedFrame[chunkIndex] = Frame;
+
+        if (States[chunkIndex] == ChunkState::Loaded)
+        {
+            RecentChunks.splice(RecentChunks.begin(), RecentChunks, RecentPositions[chunkIndex]);
+            wantedMemory += ChunkMemory[chunkIndex];
+        }
+    }
+
+    NewRequests.clear();
+    for (const auto& wanted : Wanted)
+    {
+        int chunkIndex = wanted.second;
+        if (States[chunkIndex] != ChunkState::Unknown)
+            continue;
+
+        size_t estimate = sizeof(MapChunkStore::Chunk) + File.GetChunkSize(chunkIndex);
+        if (wantedMemory + estimate > Budget)
+            break;
+
+        wantedMemory += estimate;
+        NewRequests.push_back(chunkIndex);
+    }
+
+    // the least recently wanted chunks make room, chunks wanted this frame are never unloaded
+    while (MemoryUse > Budget && !RecentChunks.empty() && WantedFrame[RecentChunks.back()] != Frame)
+        RemoveChunk(RecentChunks.back());
+
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+
+        // the old requests are dropped, the view may have moved away from them
+        Requests.clear();
+        for (auto chunk = NewRequests.rbegin(); chunk != NewRequests.rend(); ++chunk)
+        {
+            if (*chunk != LoadingChunk)
+                Requests.push_back(*chunk);
+        }
+
+        PendingCount = int(Requests.size()) + (LoadingChunk >= 0 ? 1 : 0) + int(Finished.size());
+    }
+
+    if (!NewRequests.empty())
+        WakeLoader.notify_one();
+}
+
+void MapStreamer::LoadAround(const EntityLocation& loc, int radius)
+{
+    if (!File.IsOpen())
+        return;
+
+    int centerX = int(floorf(loc.Position.x)) >> MapChunkStore::ChunkShift;
+    int centerY = int(floorf(loc.Position.y)) >> MapChunkStore::ChunkShift;
+
+    for (int chunkY = std::max(centerY - radius, 0); chunkY <= std::min(centerY + radius, File.GetChunksY() - 1); chunkY++)
+    {
+        for (int chunkX = std::max(centerX - radius, 0); chunkX <= std::min(centerX + radius, File.GetChunksX() - 1); chunkX++)
+        {
+            int chunkIndex = chunkY * File.GetChunksX() + chunkX;
+            if (States[chunkIndex] != ChunkState::Unknown)
+                continue;
+
+            MapChunkStore::Chunk chunk;
+            bool loaded = false;
+            {
+                std::lock_guard<std::mutex> guard(FileLock);
+                loaded = File.ReadChunk(chunkIndex, chunk);
+            }
+
+            if (loaded)
+                AddChunk(chunkIndex, std::move(chunk));
+            else
+                States[chunkIndex] = ChunkState::Failed;
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#include "occupancy_grid.h"
+#include "map.h"
+
+void OccupancyGrid::Build(const Map& map)
+{
+    Width = map.GetWidth();
+    Height = map.GetHeight();
+    TilesWide = (Width + 7) / 8;
+
+    Tiles.assign(size_t(TilesWide) * ((Height + 7) / 8), 0);
+
+    // dense maps are scanned straight from the state plane
+    CellPlane<const CellState> states = map.GetStatePlane();
+
+    for (int y = 0; y < Height; y++)
+    {
+        const CellState* row = states.empty() ? nullptr : states.data() + size_t(y) * Width;
+
+        for (int x = 0; x < Width; x++)
+        {
+            bool solid = row ? row[x] != CellState::Empty : map.GetCellSolid(x, y);
+            if (solid)
+                Tiles[(y >> 3) * TilesWide + (x >> 3)] |= uint64_t(1) << (((y & 7) << 3) | (x & 7));
+        }
+    }
+}
+
+void OccupancyGrid::SetCell(int x, int y, bool solid)
+{
+    if (x < 0 || x >= Width || y < 0 || y >= Height)
+        return;
+
+    uint64_t bit = uint64_t(1) << (((y & 7) << 3) | (x & 7));
+    uint64_t& tile = Tiles[(y >> 3) * TilesWide + (x >> 3)];
+
+    if (solid)
+        tile |= bit;
+    else
+        tile &= ~bit;
+}
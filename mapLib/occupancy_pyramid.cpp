@@ -0,0 +1,160 @@
+#include "occupancy_pyramid.h"
+#include "map.h"
+
+void OccupancyPyramid::Build(const Map& map)
+{
+    Levels.clear();
+
+    Width = map.GetWidth();
+    Height = map.GetHeight();
+    BlockLevelsWide = (Width + 1) / 2;
+    BlockLevels.assign(size_t(BlockLevelsWide) * ((Height + 1) / 2), 0);
+
+    int size = map.GetWidth() > map.GetHeight() ? map.GetWidth() : map.GetHeight();
+
+    for (int level = 1; size > (1 << (level - 1)); level++)
+    {
+        Levels.emplace_back();
+        Level& blocks = Levels.back();
+
+        int blockSize = 1 << level;
+        blocks.Width = (map.GetWidth() + blockSize - 1) / blockSize;
+        blocks.Height = (map.GetHeight() + blockSize - 1) / blockSize;
+        blocks.Solid.assign(size_t(blocks.Width) * blocks.Height, 0);
+
+        for (int y = 0; y < blocks.Height; y++)
+        {
+            for (int x = 0; x < blocks.Width; x++)
+            {
+                blocks.Solid[y * blocks.Width + x] = IsBlockSolid(map, level, x, y) ? 1 : 0;
+            }
+        }
+    }
+
+    UpdateBlockLevels(0, 0, Width > Height ? Width : Height);
+}
+
+// recompute the blocks above one cell, stopping as soon as a level does not change
+void OccupancyPyramid::UpdateCell(const Map& map, int x, int y)
+{
+    if (x < 0 || x >= map.GetWidth() || y < 0 || y >= map.GetHeight())
+        return;
+
+    int changedLevel = 0;
+
+    for (int level = 1; level <= GetLevelCount(); level++)
+    {
+        Level& blocks = Levels[level - 1];
+        int blockX = x >> level;
+        int blockY = y >> level;
+
+        bool solid = IsBlockSolid(map, level, blockX, blockY);
+
+        uint8_t& value = blocks.Solid[blockY * blocks.Width + blockX];
+        if (value == (solid ? 1 : 0))
+            break;
+
+        value = solid ? 1 : 0;
+        changedLevel = level;
+    }
+
+    // only the blocks under the largest block that changed can have a different empty level
+    if (changedLevel > 0)
+        UpdateBlockLevels((x >> changedLevel) << changedLevel, (y >> changedLevel) << changedLevel, 1 << changedLevel);
+}
+
+// recompute the blocks over a rectangle of cells, for when a whole region changes at once
+// the same as updating each cell, but each block is only looked at once
+void OccupancyPyramid::UpdateRegion(const Map& map, int minX, int minY, int maxX, int maxY)
+{
+    minX = minX > 0 ? minX : 0;
+    minY = minY > 0 ? minY : 0;
+    maxX = maxX < Width - 1 ? maxX : Width - 1;
+    maxY = maxY < Height - 1 ? maxY : Height - 1;
+
+    if (minX > maxX || minY > maxY)
+        return;
+
+    int changedLevel = 0;
+
+    for (int level = 1; level <= GetLevelCount(); level++)
+    {
+        Level& blocks = Levels[level - 1];
+        bool changed = false;
+
+        for (int blockY = minY >> level; blockY <= maxY >> level; blockY++)
+        {
+            for (int blockX = minX >> level; blockX <= maxX >> level; blockX++)
+            {
+                uint8_t solid = IsBlockSolid(map, level, blockX, blockY) ? 1 : 0;
+                uint8_t& value = blocks.Solid[blockY * blocks.Width + blockX];
+
+                changed |= value != solid;
+                value = solid;
+            }
+        }
+
+        if (!changed)
+            break;
+
+        changedLevel = level;
+    }
+
+    if (changedLevel == 0)
+        return;
+
+    int size = 1 << changedLevel;
+    for (int y = (minY >> changedLevel) << changedLevel; y <= maxY; y += size)
+    {
+        for (int x = (minX >> changedLevel) << changedLevel; x <= maxX; x += size)
+            UpdateBlockLevels(x, y, size);
+    }
+}
+
+// a block is solid when any of its cells, or any of the blocks below it, is
+// the map keeps its solid grid up to date before the pyramid, and it is much smaller to read than the cells
+bool OccupancyPyramid::IsBlockSolid(const Map& map, int level, int x, int y) const
+{
+    bool solid = false;
+
+    if (level == 1)
+    {
+        for (int i = 0; i < 4 && !solid; i++)
+            solid = map.GetSolidGrid().IsSolid(x * 2 + (i & 1), y * 2 + (i >> 1));
+    }
+    else
+    {
+        const Level& children = Levels[level - 2];
+        for (int i = 0; i < 4 && !solid; i++)
+        {
+            int childX = x * 2 + (i & 1);
+            int childY = y * 2 + (i >> 1);
+            if (childX < children.Width && childY < children.Height)
+                solid = children.Solid[childY * children.Width + childX] != 0;
+        }
+    }
+
+    return solid;
+}
+
+int OccupancyPyramid::FindEmptyLevel(int x, int y) const
+{
+    int level = 0;
+    while (level < GetLevelCount() && IsBlockEmpty(level + 1, x, y))
+        level++;
+
+    return level;
+}
+
+// the empty levels of the 2x2 blocks over a square of cells, minX and minY are even
+void OccupancyPyramid::UpdateBlockLevels(int minX, int minY, int size)
+{
+    int maxX = minX + size < Width ? minX + size : Width;
+    int maxY = minY + size < Height ? minY + size : Height;
+
+    for (int y = minY; y < maxY; y += 2)
+    {
+        for (int x = minX; x < maxX; x += 2)
+            BlockLevels[(y >> 1) * BlockLevelsWide + (x >> 1)] = uint8_t(FindEmptyLevel(x, y));
+    }
+}
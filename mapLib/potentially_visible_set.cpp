@@ -0,0 +1,570 @@
+#include "potentially_visible_set.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+static constexpr char PVSMagic[4] = { 'R', 'P', 'V', 'S' };
+constexpr int CurrentPVSVersion = 1;
+
+// slack on every clip, so lines that only graze a corner stay in and the sets only ever grow from rounding
+constexpr double LineSlack = 1e-5;
+
+// a line v = Slope * u + Offset in a sweep's own axes, the lines still clear of walls are a convex polygon of these
+struct LinePoint
+{
+    double Slope = 0;
+    double Offset = 0;
+};
+
+typedef std::vector<LinePoint> LinePolygon;
+
+// keeps the lines whose v at u is at least the limit, or at most it when below is set
+static void ClipLines(LinePolygon& polygon, double u, double limit, bool below, LinePolygon& scratch)
+{
+    auto outside = [u, limit, below](const LinePoint& point)
+    {
+        double v = point.Slope * u + point.Offset;
+        return below ? v - limit - LineSlack : limit - LineSlack - v;
+    };
+
+    scratch.clear();
+    for (size_t i = 0; i < polygon.size(); i++)
+    {
+        const LinePoint& from = polygon[i];
+        const LinePoint& to = polygon[(i + 1) % polygon.size()];
+        double fromOut = outside(from);
+        double toOut = outside(to);
+
+        if (fromOut <= 0)
+            scratch.push_back(from);
+
+        if ((fromOut < 0 && toOut > 0) || (fromOut > 0 && toOut < 0))
+        {
+            double t = fromOut / (fromOut - toOut);
+            scratch.push_back(LinePoint{ from.Slope + (to.Slope - from.Slope) * t, from.Offset + (to.Offset - from.Offset) * t });
+        }
+    }
+
+    std::swap(polygon, scratch);
+}
+
+// the range of v the lines cover at u
+static void GetLineRange(const LinePolygon& polygon, double u, double& minV, double& maxV)
+{
+    minV = std::numeric_limits<double>::max();
+    maxV = -std::numeric_limits<double>::max();
+    for (const auto& point : polygon)
+    {
+        double v = point.Slope * u + point.Offset;
+        minV = std::min(minV, v);
+        maxV = std::max(maxV, v);
+    }
+}
+
+// the lines that reach a run from different runs before it are joined into the hull of them all, which only adds lines
+static void GetHull(std::vector<LinePoint>& points, LinePolygon& hull)
+{
+    std::sort(points.begin(), points.end(), [](const LinePoint& a, const LinePoint& b)
+        {
+            return a.Slope < b.Slope || (a.Slope == b.Slope && a.Offset < b.Offset);
+        });
+
+    auto cross = [](const LinePoint& o, const LinePoint& a, const LinePoint& b)
+    {
+        return (a.Slope - o.Slope) * (b.Offset - o.Offset) - (a.Offset - o.Offset) * (b.Slope - o.Slope);
+    };
+
+    hull.assign(points.size() * 2, LinePoint());
+    size_t count = 0;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        while (count >= 2 && cross(hull[count - 2], hull[count - 1], points[i]) <= 0)
+            count--;
+        hull[count++] = points[i];
+    }
+
+    for (size_t i = points.size() - 1, lower = count + 1; i-- > 0;)
+    {
+        while (count >= lower && cross(hull[count - 2], hull[count - 1], points[i]) <= 0)
+            count--;
+        hull[count++] = points[i];
+    }
+
+    // a hull of a single line or of lines along one edge is kept as it is, the clips handle flat polygons
+    hull.resize(count > 1 ? count - 1 : count);
+}
+
+// the cells that block a line, and for each cell the free run along v it is part of, for columns along x and along y
+// a cell only blocks when the rays stop at it, solid with a tile
+class BakeGrid
+{
+public:
+    BakeGrid(const Map& map)
+        : Width(map.GetWidth())
+        , Height(map.GetHeight())
+    {
+        Blocking.resize(size_t(Width) * Height);
+        for (int y = 0; y < Height; y++)
+        {
+            for (int x = 0; x < Width; x++)
+                Blocking[size_t(y) * Width + x] = map.GetCellSolid(x, y) && map.GetCellTile(x, y) != 0;
+        }
+
+        for (int axis = 0; axis < 2; axis++)
+        {
+            RunStarts[axis].resize(Blocking.size());
+            RunEnds[axis].resize(Blocking.size());
+
+            int columns = axis == 0 ? Width : Height;
+            int rows = axis == 0 ? Height : Width;
+            for (int u = 0; u < columns; u++)
+            {
+                for (int v = 0; v < rows;)
+                {
+                    int end = v;
+                    while (end < rows && IsBlocking(axis, u, end) == IsBlocking(axis, u, v))
+                        end++;
+
+                    for (int i = v; i < end; i++)
+                    {
+                        RunStarts[axis][GetIndex(axis, u, i)] = v;
+                        RunEnds[axis][GetIndex(axis, u, i)] = end;
+                    }
+                    v = end;
+                }
+            }
+        }
+    }
+
+    // axis 0 has the columns along x and v along y, axis 1 has them swapped
+    inline size_t GetIndex(int axis, int u, int v) const { return axis == 0 ? size_t(v) * Width + u : size_t(u) * Width + v; }
+    inline bool IsBlocking(int axis, int u, int v) const { return Blocking[GetIndex(axis, u, v)] != 0; }
+
+    int Width = 0;
+    int Height = 0;
+    std::vector<uint8_t> Blocking;
+    std::vector<int> RunStarts[2];
+    std::vector<int> RunEnds[2];
+};
+
+// every line that leaves a cell through one side, with a slope of at most one, followed a column at a time
+// the lines are kept while they stay inside the free runs of each column, so the cells found are every one a line
+// from any point in the cell reaches, and a few around corners that are only grazed
+// the four sweeps cover every line, the ones steeper than one are the shallow ones of the swapped axis
+class CellSweep
+{
+public:
+    CellSweep(const BakeGrid& grid, std::vector<uint8_t>& seen, std::vector<int>& cells)
+        : Grid(grid)
+        , Seen(seen)
+        , Cells(cells)
+    {
+    }
+
+    void Sweep(int axis, bool flip, int cellX, int cellY)
+    {
+        Axis = axis;
+        Flip = flip;
+        Columns = axis == 0 ? Grid.Width : Grid.Height;
+        Rows = axis == 0 ? Grid.Height : Grid.Width;
+
+        int u = GetU(axis == 0 ? cellX : cellY);
+        int v = axis == 0 ? cellY : cellX;
+        int runStart = GetRunStart(u, v);
+        int runEnd = GetRunEnd(u, v);
+
+        // the lines through the cell, in two halves by the sign of the slope so each is convex
+        double minU = u;
+        double maxU = u + 1.0;
+        double minV = v;
+        double maxV = v + 1.0;
+
+        States.clear();
+        States.push_back(LinePolygon{ { 0, minV }, { 1, minV - maxU }, { 1, maxV - minU }, { 0, maxV } });
+        States.push_back(LinePolygon{ { -1, minV + minU }, { 0, minV }, { 0, maxV }, { -1, maxV + maxU } });
+
+        // leaving the cell's own column inside its run
+        for (auto& state : States)
+        {
+            ClipLines(state, maxU, runStart, false, Scratch);
+            ClipLines(state, maxU, runEnd, true, Scratch);
+        }
+
+        for (int column = u + 1; column < Columns && !States.empty(); column++)
+            SweepColumn(column);
+    }
+
+protected:
+    struct RunLines
+    {
+        int Start = 0;
+        int End = 0;
+        std::vector<LinePoint> Points;
+    };
+
+    inline int GetU(int coordinate) const { return Flip ? Columns - 1 - coordinate : coordinate; }
+    inline int GetRunStart(int u, int v) const { return Grid.RunStarts[Axis][Grid.GetIndex(Axis, GetU(u), v)]; }
+    inline int GetRunEnd(int u, int v) const { return Grid.RunEnds[Axis][Grid.GetIndex(Axis, GetU(u), v)]; }
+    inline bool IsBlocking(int u, int v) const { return Grid.IsBlocking(Axis, GetU(u), v); }
+
+    void MarkCell(int u, int v)
+    {
+        size_t index = Grid.GetIndex(Axis, GetU(u), v);
+        if (Seen[index] == 0)
+        {
+            Seen[index] = 1;
+            Cells.push_back(int(index));
+        }
+    }
+
+    RunLines& GetRunLines(int start, int end)
+    {
+        for (size_t i = 0; i < RunCount; i++)
+        {
+            if (Runs[i].Start == start)
+                return Runs[i];
+        }
+
+        if (RunCount == Runs.size())
+            Runs.emplace_back();
+
+        RunLines& run = Runs[RunCount++];
+        run.Start = start;
+        run.End = end;
+        run.Points.clear();
+        return run;
+    }
+
+    void SweepColumn(int column)
+    {
+        RunCount = 0;
+
+        // split the lines coming in by the free run they enter the column in
+        for (const auto& state : States)
+        {
+            double minV = 0;
+            double maxV = 0;
+            GetLineRange(state, column, minV, maxV);
+
+            int first = std::max(0, int(floor(minV - LineSlack)));
+            int last = std::min(Rows - 1, int(floor(maxV + LineSlack)));
+            for (int v = first; v <= last; v++)
+            {
+                // a wall the lines run into at the edge of the column
+                if (IsBlocking(column, v))
+                {
+                    MarkCell(column, v);
+                    continue;
+                }
+
+                int start = GetRunStart(column, v);
+                int end = GetRunEnd(column, v);
+                v = end - 1;
+
+                Clipped = state;
+                ClipLines(Clipped, column, start, false, Scratch);
+                ClipLines(Clipped, column, end, true, Scratch);
+                if (Clipped.empty())
+                    continue;
+
+                RunLines& run = GetRunLines(start, end);
+                run.Points.insert(run.Points.end(), Clipped.begin(), Clipped.end());
+            }
+        }
+
+        States.clear();
+        for (size_t i = 0; i < RunCount; i++)
+        {
+            RunLines& run = Runs[i];
+            GetHull(run.Points, Clipped);
+            if (Clipped.empty())
+                continue;
+
+            // every cell the lines touch in the column, up to the walls at either end of the run
+            double entryMin = 0;
+            double entryMax = 0;
+            double exitMin = 0;
+            double exitMax = 0;
+            GetLineRange(Clipped, column, entryMin, entryMax);
+            GetLineRange(Clipped, column + 1.0, exitMin, exitMax);
+
+            int first = std::max({ 0, run.Start - 1, int(floor(std::min(entryMin, exitMin) - LineSlack)) });
+            int last = std::min({ Rows - 1, run.End, int(floor(std::max(entryMax, exitMax) + LineSlack)) });
+            for (int v = first; v <= last; v++)
+                MarkCell(column, v);
+
+            // the lines that get through to the next column
+            ClipLines(Clipped, column + 1.0, run.Start, false, Scratch);
+            ClipLines(Clipped, column + 1.0, run.End, true, Scratch);
+            if (!Clipped.empty())
+                States.push_back(Clipped);
+        }
+    }
+
+    const BakeGrid& Grid;
+    std::vector<uint8_t>& Seen;
+    std::vector<int>& Cells;
+
+    int Axis = 0;
+    bool Flip = false;
+    int Columns = 0;
+    int Rows = 0;
+
+    std::vector<LinePolygon> States;
+    std::vector<RunLines> Runs;
+    size_t RunCount = 0;
+    LinePolygon Clipped;
+    LinePolygon Scratch;
+};
+
+static void WriteVarint(std::vector<uint8_t>& data, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        data.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    data.push_back(uint8_t(value));
+}
+
+static uint32_t ReadVarint(const uint8_t*& data, const uint8_t* end)
+{
+    uint32_t value = 0;
+    for (int shift = 0; data < end && shift < 32; shift += 7)
+    {
+        uint8_t byte = *data++;
+        value |= uint32_t(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            break;
+    }
+    return value;
+}
+
+// the cells are sorted and unique
+static void EncodeRuns(const std::vector<int>& cells, std::vector<uint8_t>& data)
+{
+    uint32_t lastEnd = 0;
+
+    for (size_t i = 0; i < cells.size();)
+    {
+        size_t runEnd = i + 1;
+        while (runEnd < cells.size() && cells[runEnd] == cells[runEnd - 1] + 1)
+            runEnd++;
+
+        WriteVarint(data, uint32_t(cells[i]) - lastEnd);
+        WriteVarint(data, uint32_t(runEnd - i));
+
+        lastEnd = uint32_t(cells[runEnd - 1]) + 1;
+        i = runEnd;
+    }
+}
+
+void PotentiallyVisibleSet::Bake(const Map& map, int threads)
+{
+    Width = map.GetWidth();
+    Height = map.GetHeight();
+    MapHash = GetMapHash(map);
+
+    std::vector<std::vector<uint8_t>> cellData(size_t(Width) * Height);
+
+    // groups of rows, each with its own raycaster
+    int jobCount = std::max(1, std::min(Height, threads * 4));
+
+    BakeGrid grid(map);
+
+    auto bakeRows = [&](int job)
+    {
+        std::vector<uint8_t> seen(cellData.size(), 0);
+        std::vector<int> cells;
+        CellSweep sweep(grid, seen, cells);
+
+        for (int y = (job * Height) / jobCount; y < ((job + 1) * Height) / jobCount; y++)
+        {
+            for (int x = 0; x < Width; x++)
+            {
+                if (!map.GetCellPassable(x, y))
+                    continue;
+
+                int cellIndex = map.GetCellIndex(x, y);
+                cells.clear();
+                seen[cellIndex] = 1;
+                cells.push_back(cellIndex);
+
+                for (int axis = 0; axis < 2; axis++)
+                {
+                    sweep.Sweep(axis, false, x, y);
+                    sweep.Sweep(axis, true, x, y);
+                }
+
+                for (int index : cells)
+                    seen[index] = 0;
+
+                std::sort(cells.begin(), cells.end());
+                EncodeRuns(cells, cellData[cellIndex]);
+            }
+        }
+    };
+
+    if (threads > 1)
+    {
+        WorkerPool workers(threads);
+        workers.ParallelFor(jobCount, bakeRows);
+    }
+    else
+    {
+        for (int job = 0; job < jobCount; job++)
+            bakeRows(job);
+    }
+
+    Offsets.resize(cellData.size() + 1);
+    Data.clear();
+
+    for (size_t i = 0; i < cellData.size(); i++)
+    {
+        Offsets[i] = uint32_t(Data.size());
+        Data.insert(Data.end(), cellData[i].begin(), cellData[i].end());
+    }
+    Offsets.back() = uint32_t(Data.size());
+}
+
+void PotentiallyVisibleSet::GetVisibleCells(int cellIndex, std::vector<int>& cells) const
+{
+    cells.clear();
+
+    if (cellIndex < 0 || size_t(cellIndex) + 1 >= Offsets.size())
+        return;
+
+    const uint8_t* data = Data.data() + Offsets[cellIndex];
+    const uint8_t* end = Data.data() + Offsets[cellIndex + 1];
+
+    uint32_t lastEnd = 0;
+    while (data < end)
+    {
+        uint32_t start = lastEnd + ReadVarint(data, end);
+        uint32_t length = ReadVarint(data, end);
+
+        // a damaged set can not point past the map
+        if (size_t(start) + length + 1 > Offsets.size())
+            break;
+
+        for (uint32_t i = 0; i < length; i++)
+            cells.push_back(int(start + i));
+
+        lastEnd = start + length;
+    }
+}
+
+std::string PotentiallyVisibleSet::GetSidecarPath(std::string_view mapPath)
+{
+    std::string path(mapPath);
+
+    size_t extension = path.find_last_of('.');
+    size_t folder = path.find_last_of("/\\");
+    if (extension != std::string::npos && (folder == std::string::npos || extension > folder))
+        path.resize(extension);
+
+    return path + ".pvs";
+}
+
+// FNV-1a over the size and every cell's state and tile
+uint64_t PotentiallyVisibleSet::GetMapHash(const Map& map)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    auto add = [&hash](uint8_t value)
+    {
+        hash ^= value;
+        hash *= 1099511628211ull;
+    };
+
+    for (int i = 0; i < 4; i++)
+    {
+        add(uint8_t(map.GetWidth() >> (i * 8)));
+        add(uint8_t(map.GetHeight() >> (i * 8)));
+    }
+
+    for (int y = 0; y < map.GetHeight(); y++)
+    {
+        for (int x = 0; x < map.GetWidth(); x++)
+        {
+            MapCell cell = map.GetCell(x, y);
+            add(uint8_t(cell.State));
+            add(cell.Tile);
+        }
+    }
+
+    return hash;
+}
+
+bool PotentiallyVisibleSet::Write(std::string_view filepath) const
+{
+    if (Offsets.empty())
+        return false;
+
+    FILE* fp = fopen(std::string(filepath).c_str(), "wb");
+    if (!fp)
+        return false;
+
+    int version = CurrentPVSVersion;
+    uint32_t dataSize = uint32_t(Data.size());
+
+    bool valid = fwrite(PVSMagic, 4, 1, fp) == 1
+        && fwrite(&version, 4, 1, fp) == 1
+        && fwrite(&Width, 4, 1, fp) == 1
+        && fwrite(&Height, 4, 1, fp) == 1
+        && fwrite(&MapHash, 8, 1, fp) == 1
+        && fwrite(&dataSize, 4, 1, fp) == 1
+        && fwrite(Offsets.data(), 4, Offsets.size(), fp) == Offsets.size()
+        && (Data.empty() || fwrite(Data.data(), 1, Data.size(), fp) == Data.size());
+
+    fclose(fp);
+    return valid;
+}
+
+bool PotentiallyVisibleSet::Read(std::string_view filepath)
+{
+    Offsets.clear();
+    Data.clear();
+
+    FILE* fp = fopen(std::string(filepath).c_str(), "rb");
+    if (!fp)
+        return false;
+
+    char magic[4] = { 0 };
+    int version = 0;
+    uint32_t dataSize = 0;
+
+    bool valid = fread(magic, 4, 1, fp) == 1 && memcmp(magic, PVSMagic, 4) == 0
+        && fread(&version, 4, 1, fp) == 1 && version == CurrentPVSVersion
+        && fread(&Width, 4, 1, fp) == 1
+        && fread(&Height, 4, 1, fp) == 1
+        && fread(&MapHash, 8, 1, fp) == 1
+        && fread(&dataSize, 4, 1, fp) == 1
+        && Width > 0 && Height > 0;
+
+    if (valid)
+    {
+        Offsets.resize(size_t(Width) * Height + 1);
+        Data.resize(dataSize);
+
+        valid = fread(Offsets.data(), 4, Offsets.size(), fp) == Offsets.size()
+            && (Data.empty() || fread(Data.data(), 1, Data.size(), fp) == Data.size())
+            && Offsets.back() == dataSize;
+
+        for (size_t i = 1; valid && i < Offsets.size(); i++)
+            valid = Offsets[i - 1] <= Offsets[i];
+    }
+
+    fclose(fp);
+
+    if (!valid)
+    {
+        Offsets.clear();
+        Data.clear();
+    }
+
+    return valid;
+}
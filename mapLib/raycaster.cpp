@@ -1,5 +1,7 @@
 #include "raycaster.h"
 
+#include <algorithm>
+
 Raycaster::Raycaster(const Map* map, int renderWidth, float renderFOV)
     : WorldMap(map)
     , RenderWidth(renderWidth)
@@ -15,16 +17,61 @@ Raycaster::Raycaster(const Map* map, int renderWidth, float renderFOV)
 
 void Raycaster::SetMap(const Map* map)
 {
+    // the status lists are still right for the map that is already set
+    if (map && map == WorldMap && CellStatus.size() == size_t(map->GetWidth()) * map->GetHeight())
+        return;
+
     if (map)
     {
         WorldMap = map;
+        CoherentValid = false;
+        HitCells.clear();
+        HitCellLocs.clear();
         CellStatus.resize(WorldMap->GetWidth() * WorldMap->GetHeight());
         CellStatus.assign(CellStatus.size(), 0);
+
+        BlockStatus.clear();
+        ClearBlockStatus();
+    }
+}
+
+// the map can be resized after it was set, so the block status is rebuilt when it no longer matches the pyramid
+void Raycaster::ClearBlockStatus()
+{
+    if (!WorldMap)
+        return;
+
+    const OccupancyPyramid& occupancy = WorldMap->GetOccupancy();
+
+    bool matches = int(BlockStatus.size()) == occupancy.GetLevelCount();
+    for (int level = 1; matches && level <= occupancy.GetLevelCount(); level++)
+        matches = BlockStatus[level - 1].size() == occupancy.GetLevel(level).Solid.size();
+
+    if (matches)
+    {
+        for (const auto& block : HitBlocks)
+            BlockStatus[block.Level - 1][(block.Y >> block.Level) * occupancy.GetLevel(block.Level).Width + (block.X >> block.Level)] = 0;
+    }
+    else
+    {
+        BlockStatus.resize(occupancy.GetLevelCount());
+        for (int level = 1; level <= occupancy.GetLevelCount(); level++)
+            BlockStatus[level - 1].assign(occupancy.GetLevel(level).Solid.size(), 0);
     }
+
+    HitBlocks.clear();
 }
 
 void Raycaster::StartFrame(const EntityLocation& loc)
 {
+    // the view and map have not changed, so last frame's results still stand
+    if (CoherentMode && StartCoherentFrame(loc))
+    {
+        CastCount = 0;
+        ReusedCount = 0;
+        return;
+    }
+
     // set the camera plane for this view
     float angle = atan2f(loc.Facing.y, loc.Facing.x);
     CameraPlane = Vector2Rotate(NominalCameraPlane, angle);
@@ -36,30 +83,46 @@ void Raycaster::StartFrame(const EntityLocation& loc)
     HitCells.clear();
     HitCellLocs.clear();
 
+    ClearBlockStatus();
+
     CastCount = 0;
+    ReusedCount = 0;
 
-    // cast this frame
-    UpdateRayset(loc);
-}
+    HitFaces.clear();
 
-// cast a ray and find out what it hits
-void Raycaster::CastRay(RayResult& ray, const Vector2& pos)
-{
-    ray.Distance = -1;
-    if (!WorldMap)
-        return;
+    UpdatePVS(loc);
 
-    CastCount++;
+    // cast this frame
+    if (Backend == VisibilityBackend::BeamSweep)
+        UpdateBeams(loc);
+    else if (Backend == VisibilityBackend::PotentiallyVisible)
+        UpdatePVSView(loc);
+    else if (Backend == VisibilityBackend::SectorPortals)
+        UpdateSectorView(loc);
+    else
+        UpdateRayset(loc);
 
-    // The current grid point we are in
-    int mapX = int(floor(pos.x));
-    int mapY = int(floor(pos.y));
+    if (ReuseActive)
+    {
+        KeepPreviousCells();
+        ReuseActive = false;
+    }
 
-    ray.HitGridType = WorldMap->GetCellTile(mapX, mapY);
+    if (CoherentMode && WorldMap)
+    {
+        CoherentValid = true;
+        CoherentMap = WorldMap;
+        CoherentVersion = WorldMap->GetVersion();
+        CoherentLocation = loc;
+    }
+}
 
-    //length of ray from current position to next x or y-side
-    float sideDistX = 0;
-    float sideDistY = 0;
+// set up the DDA walk for a ray
+void Raycaster::StartRayWalk(RayWalk& walk, float dirX, float dirY, const Vector2& pos) const
+{
+    // The current grid point we are in
+    walk.MapX = int(floor(pos.x));
+    walk.MapY = int(floor(pos.y));
 
     // length of ray from one x or y-side to next x or y-side
     // these are derived as:
@@ -72,64 +135,204 @@ void Raycaster::CastRay(RayResult& ray, const Vector2& pos)
     // stepping further below works. So the values can be computed as below.
     // Division through zero is prevented, even though technically that's not
     // needed in C++ with IEEE 754 floating point values.
-    float deltaDistX = (ray.Directon.x == 0) ? float(1e30) : float(fabs(1.0f / ray.Directon.x));
-    float deltaDistY = (ray.Directon.y == 0) ? float(1e30) : float(fabs(1.0f / ray.Directon.y));
-
-    float perpWallDist = 0;
-
-    // what direction to step in x or y-direction (either +1 or -1)
-    int stepX = 0;
-    int stepY = 0;
-
-    bool hit = false; //was there a wall hit?
-    bool side = false; //was a NS or a EW wall hit?
+    walk.DeltaDistX = (dirX == 0) ? float(1e30) : float(fabs(1.0f / dirX));
+    walk.DeltaDistY = (dirY == 0) ? float(1e30) : float(fabs(1.0f / dirY));
 
     // calculate step and initial sideDist
-    if (ray.Directon.x < 0)
+    if (dirX < 0)
     {
-        stepX = -1;
-        sideDistX = (pos.x - mapX) * deltaDistX;
+        walk.StepX = -1;
+        walk.SideDistX = (pos.x - walk.MapX) * walk.DeltaDistX;
     }
     else
     {
-        stepX = 1;
-        sideDistX = (mapX + 1.0f - pos.x) * deltaDistX;
+        walk.StepX = 1;
+        walk.SideDistX = (walk.MapX + 1.0f - pos.x) * walk.DeltaDistX;
     }
 
-    if (ray.Directon.y < 0)
+    if (dirY < 0)
     {
-        stepY = -1;
-        sideDistY = (pos.y - mapY) * deltaDistY;
+        walk.StepY = -1;
+        walk.SideDistY = (pos.y - walk.MapY) * walk.DeltaDistY;
     }
     else
     {
-        stepY = 1;
-        sideDistY = (mapY + 1.0f - pos.y) * deltaDistY;
+        walk.StepY = 1;
+        walk.SideDistY = (walk.MapY + 1.0f - pos.y) * walk.DeltaDistY;
+    }
+}
+
+// the distance along the ray to a side, after crossing this many sides on its axis
+// the single steps and the block jumps both get their distances from here, so they compare exactly the same values
+static inline float GetSideDist(float start, int crossings, float delta)
+{
+    return start + crossings * delta;
+}
+
+// how many of the next sides on an axis come before the limit, up to maxCount, a side at the limit counts when inclusive is set
+// estimated by dividing, then corrected against the sums themselves so it matches the single steps
+static int CountCrossings(float start, int crossed, float delta, float limit, bool inclusive, int maxCount)
+{
+    auto before = [&](int count)
+    {
+        float dist = GetSideDist(start, crossed + count, delta);
+        return inclusive ? dist <= limit : dist < limit;
+    };
+
+    float estimate = (limit - start) / delta - crossed + 1;
+    int count = estimate <= 0 ? 0 : estimate >= float(maxCount) ? maxCount : int(estimate);
+
+    while (count < maxCount && before(count))
+        count++;
+    while (count > 0 && !before(count - 1))
+        count--;
+
+    return count;
+}
+
+// jump the ray across an empty block, to the last cell the single steps would reach in it, and cross the same sides they would
+// the sides of both axes are crossed in order of distance, a tie crossing y first, so the sides crossed before the ray leaves
+// are the ones nearer than the side it leaves through. The jump stays inside the trace bounds and the view distance,
+// and leaves the step out of the block to the single step. Returns false when the ray could not move
+inline bool Raycaster::JumpEmptyBlock(int level, int& mapX, int& mapY, int& crossX, int& crossY, float& sideDistX, float& sideDistY, const RayWalk& walk) const
+{
+    int blockX = (mapX >> level) << level;
+    int blockY = (mapY >> level) << level;
+    int blockEnd = (1 << level) - 1;
+
+    // the last cell on each axis the ray can reach, inside the block and the trace bounds
+    int lastX = walk.StepX > 0 ? std::min(blockX + blockEnd, TraceMaxX) : std::max(blockX, TraceMinX);
+    int lastY = walk.StepY > 0 ? std::min(blockY + blockEnd, TraceMaxY) : std::max(blockY, TraceMinY);
+
+    // the sides to cross on each axis to leave, and the distance of the last one
+    int stepsX = (lastX - mapX) * walk.StepX + 1;
+    int stepsY = (lastY - mapY) * walk.StepY + 1;
+    if (stepsX <= 0 || stepsY <= 0)
+        return false;
+
+    float exitX = GetSideDist(walk.SideDistX, crossX + stepsX - 1, walk.DeltaDistX);
+    float exitY = GetSideDist(walk.SideDistY, crossY + stepsY - 1, walk.DeltaDistY);
+
+    int movesX = stepsX - 1;
+    int movesY = stepsY - 1;
+    if (exitX < exitY)
+        movesY = CountCrossings(walk.SideDistY, crossY, walk.DeltaDistY, exitX, true, movesY);
+    else
+        movesX = CountCrossings(walk.SideDistX, crossX, walk.DeltaDistX, exitY, false, movesX);
+
+    if (movesX == 0 && movesY == 0)
+        return false;
+
+    // every side crossed has to be within the view distance, the single steps stop at the first that is not
+    if (MaxViewDistance > 0)
+    {
+        if (movesX > 0 && GetSideDist(walk.SideDistX, crossX + movesX - 1, walk.DeltaDistX) > MaxViewDistance)
+            return false;
+        if (movesY > 0 && GetSideDist(walk.SideDistY, crossY + movesY - 1, walk.DeltaDistY) > MaxViewDistance)
+            return false;
     }
 
+    mapX += walk.StepX * movesX;
+    mapY += walk.StepY * movesY;
+    crossX += movesX;
+    crossY += movesY;
+    sideDistX = GetSideDist(walk.SideDistX, crossX, walk.DeltaDistX);
+    sideDistY = GetSideDist(walk.SideDistY, crossY, walk.DeltaDistY);
+    return true;
+}
+
+// cast a ray and find out what it hits
+void Raycaster::CastRay(RayResult& ray, const Vector2& pos, CastContext& context)
+{
+    ray.Distance = -1;
+    ray.PastViewDistance = false;
+    if (!WorldMap)
+        return;
+
+    context.CastCount++;
+
+    RayWalk walk;
+    StartRayWalk(walk, ray.Directon.x, ray.Directon.y, pos);
+
+    // The current grid point we are in
+    int mapX = walk.MapX;
+    int mapY = walk.MapY;
+
+    ray.HitGridType = WorldMap->GetCellTile(mapX, mapY);
+
+    //length of ray from current position to next x or y-side
+    float sideDistX = walk.SideDistX;
+    float sideDistY = walk.SideDistY;
+
+    // length of ray from one x or y-side to next x or y-side
+    float deltaDistX = walk.DeltaDistX;
+    float deltaDistY = walk.DeltaDistY;
+
+    float perpWallDist = 0;
+
+    // what direction to step in x or y-direction (either +1 or -1)
+    int stepX = walk.StepX;
+    int stepY = walk.StepY;
+
+    bool hit = false; //was there a wall hit?
+    bool side = false; //was a NS or a EW wall hit?
+
+    const OccupancyPyramid& occupancy = WorldMap->GetOccupancy();
+    const OccupancyGrid& solidGrid = WorldMap->GetSolidGrid();
+
+    // the sides crossed on each axis so far, and the distance to the side the last step crossed
+    int crossX = 0;
+    int crossY = 0;
+    float entry = 0;
+
     // perform DDA Digital Differential Analyzer to walk the line
     while (!hit)
     {
+        // the whole block around the current cell is empty, so mark all of it as seen and jump to its edge without looking at the cells
+        // the ray is left on the last cell it reaches in the block, which is where it stops if the next step leaves the bounds
+        int emptyLevel = EmptySpaceSkipping ? occupancy.GetEmptyLevel(mapX, mapY) : 0;
+        if (emptyLevel > 0)
+        {
+            VisitBlock(context, emptyLevel, (mapY >> emptyLevel) * occupancy.GetLevel(emptyLevel).Width + (mapX >> emptyLevel));
+
+            if (JumpEmptyBlock(emptyLevel, mapX, mapY, crossX, crossY, sideDistX, sideDistY, walk))
+            {
+                ray.HitGridType = 0;
+                ray.HitCellIndex = WorldMap->GetCellIndex(mapX, mapY);
+                ray.TargetCell.x = mapX;
+                ray.TargetCell.y = mapY;
+            }
+        }
+
         //jump to next map square, either in x-direction, or in y-direction
         if (sideDistX < sideDistY)
         {
-            sideDistX += deltaDistX;
+            entry = sideDistX;
+            sideDistX = GetSideDist(walk.SideDistX, ++crossX, deltaDistX);
             mapX += stepX;
             side = false;
         }
         else
         {
-            sideDistY += deltaDistY;
+            entry = sideDistY;
+            sideDistY = GetSideDist(walk.SideDistY, ++crossY, deltaDistY);
             mapY += stepY;
             side = true;
         }
 
-        if (mapX >= WorldMap->GetWidth() || mapX < 0 || mapY >= WorldMap->GetHeight() || mapY < 0)
+        if (mapX > TraceMaxX || mapX < TraceMinX || mapY > TraceMaxY || mapY < TraceMinY)
             break;
 
+        // the cell starts past the view distance, so nothing in it or behind it is drawn
+        if (MaxViewDistance > 0 && entry > MaxViewDistance)
+        {
+            ray.PastViewDistance = true;
+            break;
+        }
+
         ray.HitGridType = 0;
-        if (WorldMap->GetCellSolid(mapX,mapY))
-            ray.HitGridType = WorldMap->GetCellTile(mapX, mapY);
+        if (solidGrid.IsSolidUnchecked(mapX, mapY))
+            ray.HitGridType = WorldMap->GetCellTileUnchecked(mapX, mapY);
 
         ray.HitCellIndex = WorldMap->GetCellIndex(mapX, mapY);
         ray.TargetCell.x = mapX;
@@ -139,7 +342,7 @@ void Raycaster::CastRay(RayResult& ray, const Vector2& pos)
         if (ray.HitGridType != 0)
             hit = true;
 
-        SetCellVis(mapX, mapY);
+        VisitCell(context, mapX, mapY, ray.HitCellIndex);
     }
 
     if (!hit)
@@ -153,26 +356,44 @@ void Raycaster::CastRay(RayResult& ray, const Vector2& pos)
     // hit to the camera plane. Euclidean to center camera point would give fisheye effect!
     // This can be computed as (mapX - posX + (1 - stepX) / 2) / rayDirX for side == 0, or same formula with Y
     // for size == 1, but can be simplified to the code below thanks to how sideDist and deltaDist are computed:
-    // because they were left scaled to |rayDir|. sideDist is the entire length of the ray above after the multiple
-    // steps, but we subtract deltaDist once because one step more into the wall was taken above.
+    // because they were left scaled to |rayDir|. The side the last step crossed into the wall is the entry distance.
+    perpWallDist = entry;
     if (!side)
-    {
-        perpWallDist = (sideDistX - deltaDistX);
         ray.Normal = stepX < 0 ? HitNormals::East : HitNormals::West;
-    }
     else
-    {
-        perpWallDist = (sideDistY - deltaDistY);
         ray.Normal = stepY < 0 ? HitNormals::North : HitNormals::South;
-    }
 
     ray.Distance = perpWallDist;
 }
 
-bool Raycaster::CastRayPair(int minPixel, int maxPixel, const EntityLocation& loc)
+void Raycaster::SetEmptySpaceSkipping(bool enabled)
+{
+    if (enabled == EmptySpaceSkipping)
+        return;
+
+    EmptySpaceSkipping = enabled;
+    CoherentValid = false;
+}
+
+void Raycaster::SetMaxViewDistance(float distance)
+{
+    distance = std::max(distance, 0.0f);
+    if (distance == MaxViewDistance)
+        return;
+
+    MaxViewDistance = distance;
+    CoherentValid = false;
+}
+
+// the direction of the ray for a screen column
+Vector2 Raycaster::GetRayDirection(int pixel, const EntityLocation& loc) const
 {
-    float cameraX = 0;
+    float cameraX = 2 * pixel / (float)RenderWidth - 1; //x-coordinate in camera space
+    return Vector2{ loc.Facing.x + CameraPlane.x * cameraX, loc.Facing.y + CameraPlane.y * cameraX };
+}
 
+bool Raycaster::CastRayPair(int minPixel, int maxPixel, const EntityLocation& loc, CastContext& context)
+{
     RayResult& minRay = RaySet[minPixel];
     RayResult& maxRay = RaySet[maxPixel];
 
@@ -182,22 +403,18 @@ bool Raycaster::CastRayPair(int minPixel, int maxPixel, const EntityLocation& lo
 
     if (minRay.HitCellIndex < 0)
     {
-        cameraX = 2 * minPixel / (float)RenderWidth - 1; //x-coordinate in camera space
-        minRay.Directon.x = loc.Facing.x + CameraPlane.x * cameraX;
-        minRay.Directon.y = loc.Facing.y + CameraPlane.y * cameraX;
-        CastRay(minRay, loc.Position);
+        minRay.Directon = GetRayDirection(minPixel, loc);
+        CastOrReuseRay(minRay, loc.Position, context);
     }
 
     if (maxRay.HitCellIndex < 0)
     {
-        cameraX = 2 * maxPixel / (float)RenderWidth - 1; //x-coordinate in camera space
-        maxRay.Directon.x = loc.Facing.x + CameraPlane.x * cameraX;
-        maxRay.Directon.y = loc.Facing.y + CameraPlane.y * cameraX;
-
-        CastRay(maxRay, loc.Position);
+        maxRay.Directon = GetRayDirection(maxPixel, loc);
+        CastOrReuseRay(maxRay, loc.Position, context);
     }
 
-    if (maxRay.Distance < 0 && minRay.Distance < 0)
+    // both rays left the map, but rays stopped by the view distance can have nearer cells between them
+    if (maxRay.Distance < 0 && minRay.Distance < 0 && !minRay.PastViewDistance && !maxRay.PastViewDistance)
         return true;
 
     return minRay.HitCellIndex == maxRay.HitCellIndex;
@@ -207,21 +424,37 @@ void Raycaster::UpdateRayset(const EntityLocation& loc)
 {
     SetCellVis(int(loc.Position.x), int(loc.Position.y));
 
-    for (uint16_t i = 0; i < RenderWidth; i++)
+    for (int i = 0; i < RenderWidth; i++)
         RaySet[i].HitCellIndex = -1;
 
-    size_t index = 0;
-    std::vector<std::pair<int, int>> pendingCasts;
+    MainContext.CastCount = 0;
+    MainContext.ReusedCount = 0;
+    MainContext.PendingCasts.clear();
+    MainContext.PendingCasts.reserve(RenderWidth);
+    MainContext.PendingCasts.emplace_back(0, RenderWidth - 1);
 
-    pendingCasts.reserve(RenderWidth);
-    pendingCasts.emplace_back(0, RenderWidth - 1);
+    if (Workers)
+        UpdateRaysetParallel(loc);
+    else
+        ProcessPendingCasts(MainContext, loc, MainContext.PendingCasts.max_size());
 
-    while (index < pendingCasts.size())
+    CastCount += MainContext.CastCount;
+    ReusedCount += MainContext.ReusedCount;
+}
+
+// run the bisection over the pending pairs until they are all done, or until there are frontierLimit pairs waiting
+// returns the index of the first pair that was not processed
+size_t Raycaster::ProcessPendingCasts(CastContext& context, const EntityLocation& loc, size_t frontierLimit)
+{
+    size_t index = 0;
+    std::vector<std::pair<int, int>>& pendingCasts = context.PendingCasts;
+
+    while (index < pendingCasts.size() && pendingCasts.size() - index < frontierLimit)
     {
         int min = pendingCasts[index].first;
         int max = pendingCasts[index].second;
 
-        if (!CastRayPair(min, max, loc))
+        if (!CastRayPair(min, max, loc, context))
         {
             if (max - min > 1)
             {
@@ -237,6 +470,105 @@ void Raycaster::UpdateRayset(const EntityLocation& loc)
 
         index++;
     }
+
+    return index;
+}
+
+// start the bisection on this thread until there are enough pairs to go around, then hand contiguous groups of them to the workers
+// the end points of every pending pair are cast before the split, so each group only writes to rays inside its own range
+// and the same pairs get subdivided as they would on one thread
+void Raycaster::UpdateRaysetParallel(const EntityLocation& loc)
+{
+    constexpr int jobsPerThread = 4;
+    size_t jobTarget = size_t(Workers->GetThreadCount() * jobsPerThread);
+
+    std::vector<std::pair<int, int>>& pendingCasts = MainContext.PendingCasts;
+
+    size_t index = ProcessPendingCasts(MainContext, loc, jobTarget);
+    if (index >= pendingCasts.size())
+        return;
+
+    pendingCasts.erase(pendingCasts.begin(), pendingCasts.begin() + index);
+    std::sort(pendingCasts.begin(), pendingCasts.end());
+
+    std::vector<int>& endPoints = MainContext.EndPointList;
+    endPoints.clear();
+    for (const auto& pair : pendingCasts)
+    {
+        if (RaySet[pair.first].HitCellIndex < 0)
+            endPoints.push_back(pair.first);
+        if (RaySet[pair.second].HitCellIndex < 0)
+            endPoints.push_back(pair.second);
+    }
+    std::sort(endPoints.begin(), endPoints.end());
+    endPoints.erase(std::unique(endPoints.begin(), endPoints.end()), endPoints.end());
+
+    for (int pixel : endPoints)
+    {
+        RaySet[pixel].Directon = GetRayDirection(pixel, loc);
+        CastOrReuseRay(RaySet[pixel], loc.Position, MainContext);
+    }
+
+    size_t jobCount = std::min(jobTarget, pendingCasts.size());
+
+    // a ray that left the map without entering a cell still reads as uncast, and would be cast again by both groups that share it
+    for (size_t job = 1; job < jobCount; job++)
+    {
+        if (RaySet[pendingCasts[(job * pendingCasts.size()) / jobCount].first].HitCellIndex < 0)
+        {
+            ProcessPendingCasts(MainContext, loc, pendingCasts.max_size());
+            return;
+        }
+    }
+
+    JobContexts.resize(jobCount);
+
+    for (size_t job = 0; job < jobCount; job++)
+    {
+        CastContext& context = JobContexts[job];
+        context.CastCount = 0;
+        context.ReusedCount = 0;
+        context.SharedStatus = false;
+        context.VisitedCells.Clear();
+        context.VisitedBlocks.Clear();
+        context.PendingCasts.assign(pendingCasts.begin() + (job * pendingCasts.size()) / jobCount, pendingCasts.begin() + ((job + 1) * pendingCasts.size()) / jobCount);
+    }
+
+    Workers->ParallelFor(int(jobCount), [this, &loc](int job)
+        {
+            CastContext& context = JobContexts[job];
+            ProcessPendingCasts(context, loc, context.PendingCasts.max_size());
+        });
+
+    // merge the cells each group visited, in column order
+    for (size_t job = 0; job < jobCount; job++)
+    {
+        CastContext& context = JobContexts[job];
+        CastCount += context.CastCount;
+        ReusedCount += context.ReusedCount;
+
+        for (int cellIndex : context.VisitedCells.GetCells())
+        {
+            if (CellStatus[cellIndex] == 1)
+                continue;
+
+            int x = 0;
+            int y = 0;
+            WorldMap->GetCellXY(cellIndex, x, y);
+            SetCellVis(x, y);
+        }
+
+        for (int blockKey : context.VisitedBlocks.GetCells())
+            SetBlockVis(blockKey >> BlockLevelShift, blockKey & ((1 << BlockLevelShift) - 1));
+    }
+}
+
+void Raycaster::SetThreadCount(int threads)
+{
+    if (threads <= 1)
+        Workers.reset();
+    else if (!Workers || Workers->GetThreadCount() != threads)
+        Workers = std::make_unique<WorkerPool>(threads);
 }
 
 bool Raycaster::IsCellVis(int x, int y) const
@@ -245,7 +577,19 @@ bool Raycaster::IsCellVis(int x, int y) const
         return false;
 
     int index = y * (int)WorldMap->GetWidth() + x;
-    return CellStatus[index] == 1;
+    if (CellStatus[index] == 1)
+        return true;
+
+    // or inside an empty block that a ray skipped over
+    const OccupancyPyramid& occupancy = WorldMap->GetOccupancy();
+    for (int level = 1; level <= int(BlockStatus.size()) && level <= occupancy.GetLevelCount(); level++)
+    {
+        size_t blockIndex = size_t(y >> level) * occupancy.GetLevel(level).Width + (x >> level);
+        if (blockIndex < BlockStatus[level - 1].size() && BlockStatus[level - 1][blockIndex] == 1)
+            return true;
+    }
+
+    return false;
 }
 
 void Raycaster::SetCellVis(int x, int y)
@@ -254,6 +598,11 @@ void Raycaster::SetCellVis(int x, int y)
         return;
 
     int index = y * (int)WorldMap->GetWidth() + x;
+
+    // the bake says this cell can't be seen from here
+    if (PVSActive && PVSStatus[index] == 0)
+        return;
+
     uint8_t& id = CellStatus[index];
     if (id == 1)
         return;
@@ -262,3 +611,18 @@ void Raycaster::SetCellVis(int x, int y)
     HitCells.push_back(index);
     HitCellLocs.emplace_back(Vector2i{ x, y });
 }
+
+void Raycaster::SetBlockVis(int level, int blockIndex)
+{
+    if (!WorldMap || level < 1 || level > int(BlockStatus.size()) || level > WorldMap->GetOccupancy().GetLevelCount())
+        return;
+
+    std::vector<uint8_t>& status = BlockStatus[level - 1];
+    if (blockIndex < 0 || blockIndex >= int(status.size()) || status[blockIndex] == 1)
+        return;
+
+    status[blockIndex] = 1;
+
+    int width = WorldMap->GetOccupancy().GetLevel(level).Width;
+    HitBlocks.push_back(VisibleBlock{ (blockIndex % width) << level, (blockIndex / width) << level, level, 1 << level });
+}
@@ -0,0 +1,195 @@
+#include "raycaster.h"
+
+#include <algorithm>
+
+void Raycaster::SetVisibilityBackend(VisibilityBackend backend)
+{
+    Backend = backend;
+    CoherentValid = false;
+}
+
+static float Cross(const Vector2& a, const Vector2& b)
+{
+    return a.x * b.y - a.y * b.x;
+}
+
+// limit a range of slopes to the ones where a + b * slope >= 0
+static void ClipSlopeRange(float a, float b, float& minSlope, float& maxSlope)
+{
+    if (b > 0)
+        minSlope = std::max(minSlope, -a / b);
+    else if (b < 0)
+        maxSlope = std::min(maxSlope, -a / b);
+    else if (a < 0)
+        maxSlope = minSlope;
+}
+
+// find every cell that can be seen from the position, inside the view, with no rays
+// the view is split into eight octants, each one is walked column by column away from the position
+// while keeping the set of slopes that are still open, every wall that is seen removes its slopes from the set
+void Raycaster::UpdateBeams(const EntityLocation& loc)
+{
+    for (auto& ray : RaySet)
+    {
+        ray.HitCellIndex = -1;
+        ray.Distance = -1;
+    }
+
+    if (!WorldMap)
+        return;
+
+    int originX = int(floorf(loc.Position.x));
+    int originY = int(floorf(loc.Position.y));
+    if (originX < 0 || originX >= WorldMap->GetWidth() || originY < 0 || originY >= WorldMap->GetHeight())
+        return;
+
+    SetCellVis(originX, originY);
+
+    // the edges of the view, the same as the first and last screen columns
+    Vector2 minEdge = Vector2Subtract(loc.Facing, CameraPlane);
+    Vector2 maxEdge = Vector2Add(loc.Facing, CameraPlane);
+
+    SweepOctant(loc.Position, 1, 0, 0, 1, minEdge, maxEdge);
+    SweepOctant(loc.Position, 1, 0, 0, -1, minEdge, maxEdge);
+    SweepOctant(loc.Position, -1, 0, 0, 1, minEdge, maxEdge);
+    SweepOctant(loc.Position, -1, 0, 0, -1, minEdge, maxEdge);
+    SweepOctant(loc.Position, 0, 1, 1, 0, minEdge, maxEdge);
+    SweepOctant(loc.Position, 0, 1, -1, 0, minEdge, maxEdge);
+    SweepOctant(loc.Position, 0, -1, 1, 0, minEdge, maxEdge);
+    SweepOctant(loc.Position, 0, -1, -1, 0, minEdge, maxEdge);
+
+    // faces on the diagonals are seen from two octants
+    std::sort(HitFaces.begin(), HitFaces.end(), [](const VisibleFace& a, const VisibleFace& b)
+        {
+            if (a.Cell.y != b.Cell.y)
+                return a.Cell.y < b.Cell.y;
+            if (a.Cell.x != b.Cell.x)
+                return a.Cell.x < b.Cell.x;
+            return a.Normal < b.Normal;
+        });
+
+    HitFaces.erase(std::unique(HitFaces.begin(), HitFaces.end(), [](const VisibleFace& a, const VisibleFace& b)
+        {
+            return a.Cell.x == b.Cell.x && a.Cell.y == b.Cell.y && a.Normal == b.Normal;
+        }), HitFaces.end());
+}
+
+// walk one octant, where directions go one cell along the primary axis for every 0 to 1 cells along the secondary axis
+// the slope of a direction is how far it goes along the secondary axis for each step along the primary axis
+void Raycaster::SweepOctant(const Vector2& pos, int primaryX, int primaryY, int secondaryX, int secondaryY, const Vector2& minEdge, const Vector2& maxEdge)
+{
+    Vector2 primary = { float(primaryX), float(primaryY) };
+    Vector2 secondary = { float(secondaryX), float(secondaryY) };
+
+    // the slopes whose direction, primary + slope * secondary, is between the edges of the view
+    float side = Cross(minEdge, maxEdge) < 0 ? -1.0f : 1.0f;
+    float minSlope = 0;
+    float maxSlope = 1;
+    ClipSlopeRange(side * Cross(minEdge, primary), side * Cross(minEdge, secondary), minSlope, maxSlope);
+    ClipSlopeRange(side * Cross(primary, maxEdge), side * Cross(secondary, maxEdge), minSlope, maxSlope);
+
+    if (minSlope >= maxSlope)
+        return;
+
+    OpenSlopes.assign(1, std::pair<float, float>(minSlope, maxSlope));
+
+    int originX = int(floorf(pos.x));
+    int originY = int(floorf(pos.y));
+
+    // how far the position is into its cell, measured along each axis in the direction the octant goes
+    float primaryOffset = primaryX != 0 ? (primaryX > 0 ? pos.x - originX : originX + 1 - pos.x) : (primaryY > 0 ? pos.y - originY : originY + 1 - pos.y);
+    float secondaryOffset = secondaryX != 0 ? (secondaryX > 0 ? pos.x - originX : originX + 1 - pos.x) : (secondaryY > 0 ? pos.y - originY : originY + 1 - pos.y);
+
+    // the face a ray goes through when it steps along each axis
+    HitNormals nearFace = primaryX != 0 ? (primaryX > 0 ? HitNormals::West : HitNormals::East) : (primaryY > 0 ? HitNormals::South : HitNormals::North);
+    HitNormals bottomFace = secondaryX != 0 ? (secondaryX > 0 ? HitNormals::West : HitNormals::East) : (secondaryY > 0 ? HitNormals::South : HitNormals::North);
+
+    const OccupancyGrid& solidGrid = WorldMap->GetSolidGrid();
+
+    for (int column = 0; !OpenSlopes.empty(); column++)
+    {
+        int columnX = originX + column * primaryX;
+        int columnY = originY + column * primaryY;
+        if (columnX < TraceMinX || columnX > TraceMaxX || columnY < TraceMinY || columnY > TraceMaxY)
+            break;
+
+        // the distance along the primary axis to the near and far side of the column
+        float nearDist = std::max(column - primaryOffset, 0.0f);
+        float farDist = column + 1 - primaryOffset;
+        if (farDist <= 0)
+            continue;
+
+        // start at the first row whose cells reach the lowest open slope
+        int firstRow = 0;
+        if (nearDist > 0)
+            firstRow = std::max(0, int(floorf(OpenSlopes.front().first * nearDist + secondaryOffset)) - 1);
+
+        for (int row = firstRow; !OpenSlopes.empty(); row++)
+        {
+            float bottom = row - secondaryOffset;
+            float minCellSlope = bottom > 0 ? bottom / farDist : 0;
+            if (minCellSlope >= OpenSlopes.back().second)
+                break;
+
+            int cellX = columnX + row * secondaryX;
+            int cellY = columnY + row * secondaryY;
+            if (cellX < TraceMinX || cellX > TraceMaxX || cellY < TraceMinY || cellY > TraceMaxY)
+                break;
+
+            float maxCellSlope = nearDist > 0 ? (row + 1 - secondaryOffset) / nearDist : float(1e30);
+
+            // slopes above this go in through the near face, below it through the bottom face
+            float nearEntry = bottom <= 0 ? float(-1e30) : (nearDist > 0 ? bottom / nearDist : float(1e30));
+
+            bool visible = false;
+            bool nearSeen = false;
+            bool bottomSeen = false;
+
+            for (const auto& open : OpenSlopes)
+            {
+                if (open.first >= maxCellSlope)
+                    break;
+
+                float minSeen = std::max(open.first, minCellSlope);
+                float maxSeen = std::min(open.second, maxCellSlope);
+                if (minSeen >= maxSeen)
+                    continue;
+
+                visible = true;
+                nearSeen |= maxSeen > nearEntry;
+                bottomSeen |= minSeen < nearEntry;
+            }
+
+            if (!visible)
+                continue;
+
+            SetCellVis(cellX, cellY);
+
+            // the cell the view is in does not block it, the same as a cast ray
+            if ((column == 0 && row == 0) || !solidGrid.IsSolidUnchecked(cellX, cellY) || WorldMap->GetCellTileUnchecked(cellX, cellY) == 0)
+                continue;
+
+            if (nearSeen)
+                HitFaces.push_back(VisibleFace{ Vector2i(cellX, cellY), nearFace });
+            if (bottomSeen)
+                HitFaces.push_back(VisibleFace{ Vector2i(cellX, cellY), bottomFace });
+
+            // nothing goes past a wall
+            ClippedSlopes.clear();
+            for (const auto& open : OpenSlopes)
+            {
+                if (open.second <= minCellSlope || open.first >= maxCellSlope)
+                {
+                    ClippedSlopes.push_back(open);
+                    continue;
+                }
+
+                if (open.first < minCellSlope)
+                    ClippedSlopes.emplace_back(open.first, minCellSlope);
+                if (open.second > maxCellSlope)
+                    ClippedSlopes.emplace_back(maxCellSlope, open.second);
+            }
+            OpenSlopes.swap(ClippedSlopes);
+        }
+    }
+}
@@ -0,0 +1,341 @@
+#include "raycaster.h"
+
+#include <algorithm>
+
+void Raycaster::SetCoherentMode(bool enabled)
+{
+    CoherentMode = enabled;
+    CoherentValid = false;
+}
+
+// the angle of a direction away from the facing, in radians
+static float GetRelativeAngle(const Vector2& facing, float x, float y)
+{
+    return atan2f(facing.x * y - facing.y * x, facing.x * x + facing.y * y);
+}
+
+// the range of angles a rectangle of cells covers from the view position, relative to the facing
+// false when the rectangle wraps around behind the view, the view position must not be inside it
+bool Raycaster::GetRelativeAngles(float minX, float minY, float maxX, float maxY, float& minAngle, float& maxAngle) const
+{
+    float corners[4] =
+    {
+        GetRelativeAngle(ReuseFacing, minX - ReusePosition.x, minY - ReusePosition.y),
+        GetRelativeAngle(ReuseFacing, maxX - ReusePosition.x, minY - ReusePosition.y),
+        GetRelativeAngle(ReuseFacing, minX - ReusePosition.x, maxY - ReusePosition.y),
+        GetRelativeAngle(ReuseFacing, maxX - ReusePosition.x, maxY - ReusePosition.y),
+    };
+
+    minAngle = *std::min_element(corners, corners + 4);
+    maxAngle = *std::max_element(corners, corners + 4);
+
+    return maxAngle - minAngle < PI;
+}
+
+static float Cross(const Vector2& a, const Vector2& b)
+{
+    return a.x * b.y - a.y * b.x;
+}
+
+// true if the inside of the triangle and the inside of the box overlap, only touching along an edge or a corner does not count
+static bool TriangleOverlapsBox(const Vector2 (&tri)[3], float minX, float minY, float maxX, float maxY)
+{
+    if (std::max({ tri[0].x, tri[1].x, tri[2].x }) <= minX || std::min({ tri[0].x, tri[1].x, tri[2].x }) >= maxX)
+        return false;
+
+    if (std::max({ tri[0].y, tri[1].y, tri[2].y }) <= minY || std::min({ tri[0].y, tri[1].y, tri[2].y }) >= maxY)
+        return false;
+
+    const Vector2 corners[4] = { { minX, minY }, { maxX, minY }, { minX, maxY }, { maxX, maxY } };
+
+    for (int i = 0; i < 3; i++)
+    {
+        const Vector2& start = tri[i];
+        const Vector2& end = tri[(i + 1) % 3];
+        const Vector2& other = tri[(i + 2) % 3];
+
+        // the edge's line, with the triangle on one side of it
+        Vector2 normal = { start.y - end.y, end.x - start.x };
+        float edge = normal.x * start.x + normal.y * start.y;
+        float side = normal.x * other.x + normal.y * other.y - edge;
+
+        bool separated = true;
+        for (const auto& corner : corners)
+        {
+            if ((normal.x * corner.x + normal.y * corner.y - edge) * side > 0)
+                separated = false;
+        }
+
+        if (separated)
+            return false;
+    }
+
+    return true;
+}
+
+// where a ray from the view meets the face it hit, put exactly on the face so the wedge's far edge lies along it
+static Vector2 GetFacePoint(const Vector2& pos, const RayResult& hit)
+{
+    Vector2 point = pos;
+
+    switch (hit.Normal)
+    {
+    case HitNormals::East:
+    case HitNormals::West:
+        point.x = float(hit.Normal == HitNormals::East ? hit.TargetCell.x + 1 : hit.TargetCell.x);
+        point.y = pos.y + hit.Directon.y * (point.x - pos.x) / hit.Directon.x;
+        point.y = std::clamp(point.y, float(hit.TargetCell.y), float(hit.TargetCell.y + 1));
+        break;
+    case HitNormals::North:
+    case HitNormals::South:
+        point.y = float(hit.Normal == HitNormals::North ? hit.TargetCell.y + 1 : hit.TargetCell.y);
+        point.x = pos.x + hit.Directon.x * (point.y - pos.y) / hit.Directon.y;
+        point.x = std::clamp(point.x, float(hit.TargetCell.x), float(hit.TargetCell.x + 1));
+        break;
+    }
+
+    return point;
+}
+
+// true if two old rays hit the same face of the same cell and nothing solid is in the wedge between them
+// every ray inside the wedge then reaches that face without passing another solid cell, so it hits the same face
+// walks the occupancy blocks down from the top, only opening the ones that have a solid cell and overlap the wedge
+bool Raycaster::IsWedgeClear(const RayResult& first, const RayResult& second)
+{
+    if (first.HitCellIndex != second.HitCellIndex || first.Normal != second.Normal)
+        return false;
+
+    const Vector2 wedge[3] = { ReusePosition, GetFacePoint(ReusePosition, first), GetFacePoint(ReusePosition, second) };
+    if (Cross(Vector2Subtract(wedge[1], wedge[0]), Vector2Subtract(wedge[2], wedge[0])) == 0)
+        return false;
+
+    const OccupancyPyramid& occupancy = WorldMap->GetOccupancy();
+    const OccupancyGrid& solid = WorldMap->GetSolidGrid();
+
+    // the last level is one block over the whole map
+    WedgeBlocks.clear();
+    WedgeBlocks.push_back(WedgeBlock{ occupancy.GetLevelCount(), 0, 0 });
+
+    while (!WedgeBlocks.empty())
+    {
+        WedgeBlock block = WedgeBlocks.back();
+        WedgeBlocks.pop_back();
+
+        if (block.X >= solid.GetWidth() || block.Y >= solid.GetHeight())
+            continue;
+
+        int size = 1 << block.Level;
+        if (!TriangleOverlapsBox(wedge, float(block.X), float(block.Y), float(block.X + size), float(block.Y + size)))
+            continue;
+
+        if (block.Level == 0)
+        {
+            if (solid.IsSolidUnchecked(block.X, block.Y) && (block.X != first.TargetCell.x || block.Y != first.TargetCell.y))
+                return false;
+
+            continue;
+        }
+
+        if (occupancy.IsBlockEmpty(block.Level, block.X, block.Y))
+            continue;
+
+        int half = size >> 1;
+        WedgeBlocks.push_back(WedgeBlock{ block.Level - 1, block.X, block.Y });
+        WedgeBlocks.push_back(WedgeBlock{ block.Level - 1, block.X + half, block.Y });
+        WedgeBlocks.push_back(WedgeBlock{ block.Level - 1, block.X, block.Y + half });
+        WedgeBlocks.push_back(WedgeBlock{ block.Level - 1, block.X + half, block.Y + half });
+    }
+
+    return true;
+}
+
+// true if the angle range does not touch any edited cell
+bool Raycaster::IsAngleRangeValid(float minAngle, float maxAngle) const
+{
+    for (const auto& range : InvalidAngles)
+    {
+        if (minAngle <= range.second && maxAngle >= range.first)
+            return false;
+    }
+
+    return true;
+}
+
+// returns true when the view and the map are the same as last frame, so its results still stand
+// otherwise, if only the facing or some cells changed, sets up the old rays so the cast can fill columns from them
+bool Raycaster::StartCoherentFrame(const EntityLocation& loc)
+{
+    ReuseActive = false;
+
+    if (!CoherentValid || !WorldMap || WorldMap != CoherentMap || !WorldMap->GetEditsSince(CoherentVersion, EditedAreas))
+        return false;
+
+    // moving changes every ray
+    if (loc.Position.x != CoherentLocation.Position.x || loc.Position.y != CoherentLocation.Position.y)
+        return false;
+
+    if (loc.Facing.x == CoherentLocation.Facing.x && loc.Facing.y == CoherentLocation.Facing.y && EditedAreas.empty())
+        return true;
+
+    // the beam sweep has no rays to reuse
+    if (Backend != VisibilityBackend::RayBisection)
+        return false;
+
+    ReuseFacing = loc.Facing;
+    ReusePosition = loc.Position;
+
+    // the columns that can see an edited cell have to be cast again
+    InvalidAngles.clear();
+    for (const MapEditArea& area : EditedAreas)
+    {
+        float minX = float(area.MinX);
+        float minY = float(area.MinY);
+        float maxX = float(area.MaxX + 1);
+        float maxY = float(area.MaxY + 1);
+
+        // an edit to the cells the view is in changes everything
+        if (loc.Position.x >= minX && loc.Position.x <= maxX && loc.Position.y >= minY && loc.Position.y <= maxY)
+            return false;
+
+        float minAngle = 0;
+        float maxAngle = 0;
+        if (GetRelativeAngles(minX, minY, maxX, maxY, minAngle, maxAngle))
+            InvalidAngles.emplace_back(minAngle, maxAngle);
+    }
+
+    // the rays that hit something last frame, in angle order from the new facing
+    CoherentRays.clear();
+    for (const auto& ray : RaySet)
+    {
+        if (ray.HitCellIndex >= 0 && ray.Distance >= 0)
+            CoherentRays.push_back(CoherentRay{ GetRelativeAngle(ReuseFacing, ray.Directon.x, ray.Directon.y), ray });
+    }
+
+    std::sort(CoherentRays.begin(), CoherentRays.end(), [](const CoherentRay& a, const CoherentRay& b) { return a.Angle < b.Angle; });
+
+    for (size_t i = 0; i + 1 < CoherentRays.size(); i++)
+        CoherentRays[i].ClearToNext = IsWedgeClear(CoherentRays[i].Ray, CoherentRays[i + 1].Ray);
+
+    PreviousCells = HitCellLocs;
+    PreviousBlocks = HitBlocks;
+
+    ReuseActive = true;
+    return false;
+}
+
+// the cells and blocks seen last frame that are still inside the view and not behind an edit
+// the columns that were cast this frame added their own cells already
+void Raycaster::KeepPreviousCells()
+{
+    float minView = GetRelativeAngle(ReuseFacing, RaySet.front().Directon.x, RaySet.front().Directon.y);
+    float maxView = GetRelativeAngle(ReuseFacing, RaySet.back().Directon.x, RaySet.back().Directon.y);
+    if (minView > maxView)
+        std::swap(minView, maxView);
+
+    for (const auto& cell : PreviousCells)
+    {
+        float minAngle = 0;
+        float maxAngle = 0;
+        if (!GetRelativeAngles(float(cell.x), float(cell.y), float(cell.x + 1), float(cell.y + 1), minAngle, maxAngle))
+            continue;
+
+        if (maxAngle >= minView && minAngle <= maxView && IsAngleRangeValid(minAngle, maxAngle))
+            SetCellVis(cell.x, cell.y);
+    }
+
+    const OccupancyPyramid& occupancy = WorldMap->GetOccupancy();
+
+    for (const auto& block : PreviousBlocks)
+    {
+        // an edit may have put a wall in it
+        if (block.Level > occupancy.GetLevelCount() || !occupancy.IsBlockEmpty(block.Level, block.X, block.Y))
+            continue;
+
+        bool containsView = ReusePosition.x >= block.X && ReusePosition.x <= block.X + block.Size
+            && ReusePosition.y >= block.Y && ReusePosition.y <= block.Y + block.Size;
+
+        float minAngle = 0;
+        float maxAngle = 0;
+        if (!containsView)
+        {
+            if (!GetRelativeAngles(float(block.X), float(block.Y), float(block.X + block.Size), float(block.Y + block.Size), minAngle, maxAngle))
+                continue;
+
+            if (maxAngle < minView || minAngle > maxView || !IsAngleRangeValid(minAngle, maxAngle))
+                continue;
+        }
+
+        SetBlockVis(block.Level, (block.Y >> block.Level) * occupancy.GetLevel(block.Level).Width + (block.X >> block.Level));
+    }
+}
+
+// fill in a ray from the two old rays on either side of it, if nothing solid is between them and the face they both hit
+bool Raycaster::ReuseRay(RayResult& ray) const
+{
+    float angle = GetRelativeAngle(ReuseFacing, ray.Directon.x, ray.Directon.y);
+
+    auto after = std::lower_bound(CoherentRays.begin(), CoherentRays.end(), angle, [](const CoherentRay& a, float value) { return a.Angle < value; });
+    if (after == CoherentRays.end())
+        return false;
+
+    // the same column as last frame
+    if (after->Angle == angle && after->Ray.Directon.x == ray.Directon.x && after->Ray.Directon.y == ray.Directon.y)
+    {
+        if (!IsAngleRangeValid(angle, angle))
+            return false;
+
+        ray = after->Ray;
+        return true;
+    }
+
+    if (after == CoherentRays.begin())
+        return false;
+
+    auto before = after - 1;
+    if (!before->ClearToNext)
+        return false;
+
+    if (!IsAngleRangeValid(before->Angle, after->Angle))
+        return false;
+
+    // the distance to the plane of the face that was hit, the same value the DDA ends with
+    const RayResult& hit = before->Ray;
+    float distance = -1;
+
+    switch (hit.Normal)
+    {
+    case HitNormals::East:
+        distance = (hit.TargetCell.x + 1 - ReusePosition.x) / ray.Directon.x;
+        break;
+    case HitNormals::West:
+        distance = (hit.TargetCell.x - ReusePosition.x) / ray.Directon.x;
+        break;
+    case HitNormals::North:
+        distance = (hit.TargetCell.y + 1 - ReusePosition.y) / ray.Directon.y;
+        break;
+    case HitNormals::South:
+        distance = (hit.TargetCell.y - ReusePosition.y) / ray.Directon.y;
+        break;
+    }
+
+    if (!(distance >= 0))
+        return false;
+
+    ray.Distance = distance;
+    ray.Normal = hit.Normal;
+    ray.HitGridType = hit.HitGridType;
+    ray.HitCellIndex = hit.HitCellIndex;
+    ray.TargetCell = hit.TargetCell;
+    return true;
+}
+
+void Raycaster::CastOrReuseRay(RayResult& ray, const Vector2& pos, CastContext& context)
+{
+    if (ReuseActive && ReuseRay(ray))
+    {
+        context.ReusedCount++;
+        return;
+    }
+
+    CastRay(ray, pos, context);
+}
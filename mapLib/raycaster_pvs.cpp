@@ -0,0 +1,118 @@
+#include "raycaster.h"
+
+#include <algorithm>
+
+void Raycaster::SetPVS(const PotentiallyVisibleSet* pvs)
+{
+    PVS = pvs;
+    PVSCellIndex = -1;
+    CoherentValid = false;
+}
+
+// find the set for the cell the view is in, and the bounds that traversal is clamped to
+// the set is only decoded again when the view moves into another cell
+void Raycaster::UpdatePVS(const EntityLocation& loc)
+{
+    if (!WorldMap)
+        return;
+
+    int cellX = int(floorf(loc.Position.x));
+    int cellY = int(floorf(loc.Position.y));
+
+    int cellIndex = -1;
+    if (PVS && PVS->GetWidth() == WorldMap->GetWidth() && PVS->GetHeight() == WorldMap->GetHeight()
+        && cellX >= 0 && cellX < WorldMap->GetWidth() && cellY >= 0 && cellY < WorldMap->GetHeight())
+        cellIndex = WorldMap->GetCellIndex(cellX, cellY);
+
+    if (PVSActive && cellIndex == PVSCellIndex)
+        return;
+
+    // rays that were cast with the old bounds can't be reused
+    if (PVSActive)
+        ReuseActive = false;
+
+    for (int index : PVSCells)
+        PVSStatus[index] = 0;
+
+    PVSCells.clear();
+    PVSActive = false;
+    PVSCellIndex = cellIndex;
+
+    TraceMinX = 0;
+    TraceMinY = 0;
+    TraceMaxX = WorldMap->GetWidth() - 1;
+    TraceMaxY = WorldMap->GetHeight() - 1;
+
+    if (cellIndex < 0)
+        return;
+
+    // cells inside walls have no set, so they are cast without one
+    PVS->GetVisibleCells(cellIndex, PVSCells);
+    if (PVSCells.empty())
+        return;
+
+    if (PVSStatus.size() != CellStatus.size())
+        PVSStatus.assign(CellStatus.size(), 0);
+
+    TraceMinX = WorldMap->GetWidth();
+    TraceMinY = WorldMap->GetHeight();
+    TraceMaxX = -1;
+    TraceMaxY = -1;
+
+    for (int index : PVSCells)
+    {
+        PVSStatus[index] = 1;
+
+        int x = 0;
+        int y = 0;
+        WorldMap->GetCellXY(index, x, y);
+        TraceMinX = std::min(TraceMinX, x);
+        TraceMinY = std::min(TraceMinY, y);
+        TraceMaxX = std::max(TraceMaxX, x);
+        TraceMaxY = std::max(TraceMaxY, y);
+    }
+
+    PVSActive = true;
+    ReuseActive = false;
+}
+
+// the cells of the set that are inside the view, a cell is only dropped when all of its corners are past the same edge
+void Raycaster::UpdatePVSView(const EntityLocation& loc)
+{
+    if (!PVSActive)
+    {
+        UpdateRayset(loc);
+        return;
+    }
+
+    for (auto& ray : RaySet)
+    {
+        ray.HitCellIndex = -1;
+        ray.Distance = -1;
+    }
+
+    Vector2 minEdge = Vector2Subtract(loc.Facing, CameraPlane);
+    Vector2 maxEdge = Vector2Add(loc.Facing, CameraPlane);
+    float side = (minEdge.x * maxEdge.y - minEdge.y * maxEdge.x) < 0 ? -1.0f : 1.0f;
+
+    for (int index : PVSCells)
+    {
+        int x = 0;
+        int y = 0;
+        WorldMap->GetCellXY(index, x, y);
+
+        bool insideMin = false;
+        bool insideMax = false;
+        for (int corner = 0; corner < 4; corner++)
+        {
+            float dx = x + (corner & 1) - loc.Position.x;
+            float dy = y + (corner >> 1) - loc.Position.y;
+
+            insideMin |= side * (minEdge.x * dy - minEdge.y * dx) >= 0;
+            insideMax |= side * (dx * maxEdge.y - dy * maxEdge.x) >= 0;
+        }
+
+        if (insideMin && insideMax)
+            SetCellVis(x, y);
+    }
+}
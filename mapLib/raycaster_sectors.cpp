@@ -0,0 +1,174 @@
+#include "raycaster.h"
+
+#include <algorithm>
+
+static float Cross(const Vector2& a, const Vector2& b)
+{
+    return a.x * b.y - a.y * b.x;
+}
+
+// true if a direction is between the edges of a view narrower than half a turn
+static bool IsInWedge(const Vector2& dir, const Vector2& minEdge, const Vector2& maxEdge, float side)
+{
+    return side * Cross(minEdge, dir) >= 0 && side * Cross(dir, maxEdge) >= 0;
+}
+
+// narrow a span of cells in a row to the ones the edge of the view does not cut off completely
+// the edge keeps the points where a * dx + c * dy >= 0, relative to the view position
+static void ClipRowSpan(float a, float c, int y, const Vector2& pos, int& minX, int& maxX)
+{
+    // the most any point of the row gets from the y term, the cells then only need one good x
+    float best = std::max(c * (y - pos.y), c * (y + 1 - pos.y));
+
+    // a little slack so a cell that only touches the edge is kept, the same as when testing its corners
+    constexpr float slack = 1e-4f;
+
+    if (a > 0)
+        minX = std::max(minX, int(ceilf(pos.x - 1 - best / a - slack)));
+    else if (a < 0)
+        maxX = std::min(maxX, int(floorf(pos.x - best / a + slack)));
+    else if (best < 0)
+        maxX = minX - 1;
+}
+
+// follow the map's edits since the last frame, or split the whole map when they are not known
+void Raycaster::UpdateSectors()
+{
+    if (SectorSource != WorldMap || !WorldMap->GetEditsSince(SectorVersion, SectorEdits))
+    {
+        Sectors.Build(*WorldMap);
+    }
+    else
+    {
+        for (const MapEditArea& area : SectorEdits)
+            Sectors.UpdateRegion(*WorldMap, area.MinX, area.MinY, area.MaxX, area.MaxY);
+    }
+
+    SectorSource = WorldMap;
+    SectorVersion = WorldMap->GetVersion();
+}
+
+void Raycaster::UpdateSectorView(const EntityLocation& loc)
+{
+    if (!WorldMap)
+        return;
+
+    UpdateSectors();
+
+    int start = Sectors.GetSectorAt(int(floorf(loc.Position.x)), int(floorf(loc.Position.y)));
+    if (start < 0)
+    {
+        UpdateRayset(loc);
+        return;
+    }
+
+    for (auto& ray : RaySet)
+    {
+        ray.HitCellIndex = -1;
+        ray.Distance = -1;
+    }
+
+    SectorOnPath.assign(Sectors.GetSectorCount(), 0);
+    SectorVisits = 0;
+
+    Vector2 minEdge = Vector2Subtract(loc.Facing, CameraPlane);
+    Vector2 maxEdge = Vector2Add(loc.Facing, CameraPlane);
+    float side = Cross(minEdge, maxEdge) < 0 ? -1.0f : 1.0f;
+
+    if (VisitSector(start, loc.Position, minEdge, maxEdge, side))
+        return;
+
+    // too many paths, throw the walk away and cast instead
+    for (const auto& i : HitCells)
+        CellStatus[i] = 0;
+
+    HitCells.clear();
+    HitCellLocs.clear();
+    ClearBlockStatus();
+
+    UpdateRayset(loc);
+}
+
+// mark the cells of a sector, and the walls around it, that are inside the view
+// then go through each portal that is ahead, with the view narrowed to the part of it that goes through the portal
+bool Raycaster::VisitSector(int index, const Vector2& pos, const Vector2& minEdge, const Vector2& maxEdge, float side)
+{
+    if (++SectorVisits > MaxSectorVisits)
+        return false;
+
+    const SectorMap::Sector& sector = Sectors.GetSector(index);
+
+    for (int y = sector.MinY - 1; y <= sector.MaxY + 1; y++)
+    {
+        if (y < 0 || y >= WorldMap->GetHeight())
+            continue;
+
+        // the corners are only touched at a point, so the rows past the sector only need the cells along its edge
+        bool borderY = y < sector.MinY || y > sector.MaxY;
+        int minX = std::max(borderY ? sector.MinX : sector.MinX - 1, 0);
+        int maxX = std::min(borderY ? sector.MaxX : sector.MaxX + 1, WorldMap->GetWidth() - 1);
+
+        ClipRowSpan(-side * minEdge.y, side * minEdge.x, y, pos, minX, maxX);
+        ClipRowSpan(side * maxEdge.y, -side * maxEdge.x, y, pos, minX, maxX);
+
+        for (int x = minX; x <= maxX; x++)
+        {
+            // open cells on the border belong to the sectors past the portals
+            bool border = borderY || x < sector.MinX || x > sector.MaxX;
+            if (border && Sectors.GetSectorAt(x, y) >= 0)
+                continue;
+
+            SetCellVis(x, y);
+        }
+    }
+
+    SectorOnPath[index] = 1;
+
+    for (const auto& portal : sector.Portals)
+    {
+        if (SectorOnPath[portal.Sector])
+            continue;
+
+        Vector2 start = { portal.StartX - pos.x, portal.StartY - pos.y };
+        Vector2 end = { portal.EndX - pos.x, portal.EndY - pos.y };
+
+        // portals behind the view lead back the way it came
+        float ahead = start.x * portal.NormalX + start.y * portal.NormalY;
+        if (ahead < 0)
+            continue;
+
+        Vector2 portalMin = minEdge;
+        Vector2 portalMax = maxEdge;
+
+        if (ahead > 0)
+        {
+            if (side * Cross(start, end) < 0)
+                std::swap(start, end);
+
+            // each edge of the overlap is an edge of one range that is inside the other
+            if (IsInWedge(start, minEdge, maxEdge, side))
+                portalMin = start;
+            else if (!IsInWedge(minEdge, start, end, side))
+                continue;
+
+            if (IsInWedge(end, minEdge, maxEdge, side))
+                portalMax = end;
+            else if (!IsInWedge(maxEdge, start, end, side))
+                continue;
+
+            if (side * Cross(portalMin, portalMax) <= 0)
+                continue;
+        }
+        else if (start.x * end.x + start.y * end.y > 0)
+        {
+            // standing in line with the portal, but not on it
+            continue;
+        }
+
+        if (!VisitSector(portal.Sector, pos, portalMin, portalMax, side))
+            return false;
+    }
+
+    SectorOnPath[index] = 0;
+    return true;
+}
@@ -0,0 +1,233 @@
+#include "sector_map.h"
+#include "map.h"
+
+#include <algorithm>
+
+bool SectorMap::IsOpen(const Map& map, int x, int y)
+{
+    return !map.GetCellSolid(x, y) || map.GetCellTile(x, y) == 0;
+}
+
+void SectorMap::Build(const Map& map)
+{
+    Width = map.GetWidth();
+    Height = map.GetHeight();
+    CellSectors.assign(size_t(Width) * Height, -1);
+
+    Sectors.clear();
+    FreeSectors.clear();
+
+    for (int y = 0; y < Height; y++)
+    {
+        for (int x = 0; x < Width; x++)
+        {
+            if (CellSectors[y * Width + x] < 0 && IsOpen(map, x, y))
+                AddSector(map, x, y);
+        }
+    }
+
+    for (int i = 0; i < int(Sectors.size()); i++)
+        LinkSector(i);
+}
+
+void SectorMap::UpdateCell(const Map& map, int x, int y)
+{
+    UpdateRegion(map, x, y, x, y);
+}
+
+// remove the sectors of the area's cells and their neighbors, split the cells they had again and relink everything that touches them
+// joining the neighbors back in keeps painting one cell at a time from leaving a trail of tiny sectors
+void SectorMap::UpdateRegion(const Map& map, int minX, int minY, int maxX, int maxY)
+{
+    if (Width != map.GetWidth() || Height != map.GetHeight())
+    {
+        Build(map);
+        return;
+    }
+
+    minX = std::max(minX, 0);
+    minY = std::max(minY, 0);
+    maxX = std::min(maxX, Width - 1);
+    maxY = std::min(maxY, Height - 1);
+    if (minX > maxX || minY > maxY)
+        return;
+
+    RegionCells.clear();
+    for (int y = minY; y <= maxY; y++)
+    {
+        for (int x = minX; x <= maxX; x++)
+            RegionCells.push_back(y * Width + x);
+    }
+
+    // the area and the cells beside its edges, the corners only touch it diagonally
+    const int offsets[5][2] = { {0, 0}, {1, 0}, {-1, 0}, {0, 1}, {0, -1} };
+    for (int y = minY - 1; y <= maxY + 1; y++)
+    {
+        for (int x = minX - 1; x <= maxX + 1; x++)
+        {
+            bool outsideX = x < minX || x > maxX;
+            bool outsideY = y < minY || y > maxY;
+            if (outsideX && outsideY)
+                continue;
+
+            int sector = GetSectorAt(x, y);
+            if (sector >= 0)
+                RemoveSector(sector);
+        }
+    }
+
+    std::sort(RegionCells.begin(), RegionCells.end());
+    RegionCells.erase(std::unique(RegionCells.begin(), RegionCells.end()), RegionCells.end());
+
+    RelinkSectors.clear();
+    for (int index : RegionCells)
+    {
+        if (CellSectors[index] < 0 && IsOpen(map, index % Width, index / Width))
+            RelinkSectors.push_back(AddSector(map, index % Width, index / Width));
+    }
+
+    // the sectors around the region had portals into the removed ones
+    for (int index : RegionCells)
+    {
+        int cellX = index % Width;
+        int cellY = index / Width;
+
+        for (int i = 1; i < 5; i++)
+        {
+            int sector = GetSectorAt(cellX + offsets[i][0], cellY + offsets[i][1]);
+            if (sector >= 0)
+                RelinkSectors.push_back(sector);
+        }
+    }
+
+    std::sort(RelinkSectors.begin(), RelinkSectors.end());
+    RelinkSectors.erase(std::unique(RelinkSectors.begin(), RelinkSectors.end()), RelinkSectors.end());
+
+    for (int sector : RelinkSectors)
+        LinkSector(sector);
+}
+
+// grow a rectangle from its top left cell, first along the row, then down for as long as every cell below is free
+int SectorMap::AddSector(const Map& map, int x, int y)
+{
+    int maxX = x;
+    while (maxX + 1 < Width && CellSectors[y * Width + maxX + 1] < 0 && IsOpen(map, maxX + 1, y))
+        maxX++;
+
+    int maxY = y;
+    while (maxY + 1 < Height)
+    {
+        bool free = true;
+        for (int cellX = x; cellX <= maxX && free; cellX++)
+            free = CellSectors[(maxY + 1) * Width + cellX] < 0 && IsOpen(map, cellX, maxY + 1);
+
+        if (!free)
+            break;
+
+        maxY++;
+    }
+
+    int index = 0;
+    if (!FreeSectors.empty())
+    {
+        index = FreeSectors.back();
+        FreeSectors.pop_back();
+    }
+    else
+    {
+        index = int(Sectors.size());
+        Sectors.emplace_back();
+    }
+
+    Sector& sector = Sectors[index];
+    sector.MinX = x;
+    sector.MinY = y;
+    sector.MaxX = maxX;
+    sector.MaxY = maxY;
+    sector.Portals.clear();
+
+    for (int cellY = y; cellY <= maxY; cellY++)
+    {
+        for (int cellX = x; cellX <= maxX; cellX++)
+            CellSectors[cellY * Width + cellX] = index;
+    }
+
+    return index;
+}
+
+// free a sector and add its cells to the region being split again
+void SectorMap::RemoveSector(int index)
+{
+    Sector& sector = Sectors[index];
+
+    for (int y = sector.MinY; y <= sector.MaxY; y++)
+    {
+        for (int x = sector.MinX; x <= sector.MaxX; x++)
+        {
+            CellSectors[y * Width + x] = -1;
+            RegionCells.push_back(y * Width + x);
+        }
+    }
+
+    sector.MaxX = sector.MinX - 1;
+    sector.MaxY = sector.MinY - 1;
+    sector.Portals.clear();
+
+    FreeSectors.push_back(index);
+}
+
+void SectorMap::AddPortal(Sector& sector, int neighbor, int startX, int startY, int endX, int endY, int normalX, int normalY)
+{
+    Portal portal;
+    portal.Sector = neighbor;
+    portal.StartX = float(startX);
+    portal.StartY = float(startY);
+    portal.EndX = float(endX);
+    portal.EndY = float(endY);
+    portal.NormalX = normalX;
+    portal.NormalY = normalY;
+    sector.Portals.push_back(portal);
+}
+
+// find the portals of a sector, one for each run of cells along an edge that belong to the same neighbor
+void SectorMap::LinkSector(int index)
+{
+    Sector& sector = Sectors[index];
+    sector.Portals.clear();
+
+    // the rows above and below
+    for (int side = 0; side < 2; side++)
+    {
+        int y = side == 0 ? sector.MinY - 1 : sector.MaxY + 1;
+        int edgeY = side == 0 ? sector.MinY : sector.MaxY + 1;
+
+        for (int x = sector.MinX; x <= sector.MaxX;)
+        {
+            int neighbor = GetSectorAt(x, y);
+            int start = x;
+            while (x <= sector.MaxX && GetSectorAt(x, y) == neighbor)
+                x++;
+
+            if (neighbor >= 0)
+                AddPortal(sector, neighbor, start, edgeY, x, edgeY, 0, side == 0 ? -1 : 1);
+        }
+    }
+
+    // the columns to the left and right
+    for (int side = 0; side < 2; side++)
+    {
+        int x = side == 0 ? sector.MinX - 1 : sector.MaxX + 1;
+        int edgeX = side == 0 ? sector.MinX : sector.MaxX + 1;
+
+        for (int y = sector.MinY; y <= sector.MaxY;)
+        {
+            int neighbor = GetSectorAt(x, y);
+            int start = y;
+            while (y <= sector.MaxY && GetSectorAt(x, y) == neighbor)
+                y++;
+
+            if (neighbor >= 0)
+                AddPortal(sector, neighbor, edgeX, start, edgeX, y, side == 0 ? -1 : 1, 0);
+        }
+    }
+}
@@ -1,13 +1,84 @@
-
 #include "view_render.h"
+#include "raymath.h"
 #include "rlgl.h"
 
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+// merged faces run their u past the end of their tile, the tile range in the second texture coordinates wraps it back
+// the derivatives are of the unwrapped u, so the mipmap does not jump to its smallest level at each tile edge
+static const char* TileVertexShader330 = R"(#version 330
+in vec3 vertexPosition;
+in vec2 vertexTexCoord;
+in vec2 vertexTexCoord2;
+in vec4 vertexColor;
+uniform mat4 mvp;
+out vec2 fragTexCoord;
+out vec2 fragTileRange;
+out vec4 fragColor;
+void main()
+{
+    fragTexCoord = vertexTexCoord;
+    fragTileRange = vertexTexCoord2;
+    fragColor = vertexColor;
+    gl_Position = mvp * vec4(vertexPosition, 1.0);
+})";
+
+static const char* TileFragmentShader330 = R"(#version 330
+in vec2 fragTexCoord;
+in vec2 fragTileRange;
+in vec4 fragColor;
+uniform sampler2D texture0;
+uniform vec4 colDiffuse;
+out vec4 finalColor;
+void main()
+{
+    float u = fragTileRange.x + fract((fragTexCoord.x - fragTileRange.x) / fragTileRange.y) * fragTileRange.y;
+    finalColor = textureGrad(texture0, vec2(u, fragTexCoord.y), dFdx(fragTexCoord), dFdy(fragTexCoord)) * colDiffuse * fragColor;
+})";
+
+// GLSL 100 and 120 have no textureGrad, so the wrapped tiles can show a thin seam at their edges when mipmapped
+static const char* TileVertexShaderLegacy = R"(
+attribute vec3 vertexPosition;
+attribute vec2 vertexTexCoord;
+attribute vec2 vertexTexCoord2;
+attribute vec4 vertexColor;
+uniform mat4 mvp;
+varying vec2 fragTexCoord;
+varying vec2 fragTileRange;
+varying vec4 fragColor;
+void main()
+{
+    fragTexCoord = vertexTexCoord;
+    fragTileRange = vertexTexCoord2;
+    fragColor = vertexColor;
+    gl_Position = mvp * vec4(vertexPosition, 1.0);
+})";
+
+static const char* TileFragmentShaderLegacy = R"(
+#ifdef GL_ES
+precision highp float;
+#endif
+varying vec2 fragTexCoord;
+varying vec2 fragTileRange;
+varying vec4 fragColor;
+uniform sampler2D texture0;
+uniform vec4 colDiffuse;
+void main()
+{
+    float u = fragTileRange.x + fract((fragTexCoord.x - fragTileRange.x) / fragTileRange.y) * fragTileRange.y;
+    gl_FragColor = texture2D(texture0, vec2(u, fragTexCoord.y)) * colDiffuse * fragColor;
+})";
+
 ViewRenderer::ViewRenderer(const Raycaster& raycaster, const Map* map)
     : Caster(raycaster)
     , WorldMap(map)
 {
     ViewCamera.fovy = 40;
     ViewCamera.up.z = 1;
+
+    FaceCache.SetMap(map);
 }
 
 void ViewRenderer::SetTileTexture(const Texture2D& texture)
@@ -18,15 +89,57 @@ void ViewRenderer::SetTileTexture(const Texture2D& texture)
         GenTextureMipmaps(&MapTiles);
         SetTextureFilter(MapTiles, TEXTURE_FILTER_ANISOTROPIC_4X);
     }
+
+    // merged floors and ceilings run their v over more than one tile
+    SetTextureWrap(MapTiles, TEXTURE_WRAP_REPEAT);
+
+    // the texture coordinates depend on the size of the texture
+    FaceCache.SetAtlasSize(MapTiles.width, MapTiles.height);
 }
 
 void ViewRenderer::SetMap(const Map* map)
 {
+    if (map != WorldMap)
+        UnloadChunkMeshes();
+
     WorldMap = map;
+    FaceCache.SetMap(map);
+}
+
+// a mesh made here points at arrays owned by a MapMeshData, so raylib can still draw from them on OpenGL 1.1
+// they are taken out before unloading, as raylib would free them as its own
+void ViewRenderer::UnloadSharedMesh(Mesh& mesh)
+{
+    if (mesh.vboId == nullptr)
+        return;
+
+    mesh.vertices = nullptr;
+    mesh.texcoords = nullptr;
+    mesh.texcoords2 = nullptr;
+    mesh.normals = nullptr;
+    mesh.colors = nullptr;
+    mesh.indices = nullptr;
+
+    UnloadMesh(mesh);
+    mesh = Mesh{ 0 };
 }
 
 void ViewRenderer::Unload()
 {
+    UnloadChunkMeshes();
+    UnloadSharedMesh(StreamMesh);
+    StreamData.Clear();
+
+    // the material would unload the tile texture along with itself, its shader is the tile shader when that loaded
+    if (MeshMaterial.maps)
+    {
+        MeshMaterial.maps[MATERIAL_MAP_DIFFUSE].texture.id = rlGetTextureIdDefault();
+        UnloadMaterial(MeshMaterial);
+        MeshMaterial = Material{ 0 };
+    }
+    TileShader = Shader{ 0 };
+    TileShaderTried = false;
+
     UnloadTexture(MapTiles);
 }
 
@@ -43,196 +156,389 @@ void ViewRenderer::Draw(const EntityLocation& loc)
     ViewCamera.target.y = loc.Position.y + loc.Facing.y;
     ViewCamera.target.z = 0.5f;
 
+    FaceCache.Update();
+
+    if (!MeshMaterial.maps)
+        MeshMaterial = LoadMaterialDefault();
+    MeshMaterial.maps[MATERIAL_MAP_DIFFUSE].texture = MapTiles;
+
+    if (!TileShaderTried)
+        LoadTileShader();
+
+    StartCulling(loc);
+
     BeginMode3D(ViewCamera);
     FaceCount = 0;
+    UnculledFaceCount = 0;
 
-    for (const auto& pos : Caster.GetHitCelList())
-    {
-        if (WorldMap->GetCellSolid(pos.x,pos.y) == 0)
-        {
-            DrawCellFloor(pos.x, pos.y);
-            DrawCellCeiling(pos.x, pos.y);
-        }
-        else
-        {
-            DrawCellWall(pos.x, pos.y, WorldMap->GetCellTile(pos.x, pos.y));
-        }
-    }
+    if (UseChunkMeshes)
+        DrawChunkMeshes();
+    else
+        DrawVisibleCells();
 
     EndMode3D();
 }
 
-void ViewRenderer::GetCellTypeUs(uint8_t cellType, float& uStart, float& uEnd)
+// only tried once, without the shader the faces are drawn as they were built
+void ViewRenderer::LoadTileShader()
 {
-    uStart = float(MapTiles.height * (cellType - 1));
-    uEnd = uStart + MapTiles.height - 1;
+    TileShaderTried = true;
+
+    int version = rlGetVersion();
+    if (version == RL_OPENGL_11)
+        return;
+
+    Shader shader = { 0 };
+    if (version == RL_OPENGL_33 || version == RL_OPENGL_43)
+    {
+        shader = LoadShaderFromMemory(TileVertexShader330, TileFragmentShader330);
+    }
+    else
+    {
+        std::string header = version == RL_OPENGL_21 ? "#version 120\n" : "#version 100\n";
+        shader = LoadShaderFromMemory((header + TileVertexShaderLegacy).c_str(), (header + TileFragmentShaderLegacy).c_str());
+    }
 
-    uStart /= MapTiles.width;
-    uEnd /= MapTiles.width;
+    // raylib hands back its default shader when one fails to build
+    if (shader.id == 0 || shader.id == rlGetShaderIdDefault())
+        return;
+
+    TileShader = shader;
+    MeshMaterial.shader = TileShader;
 }
 
-void rlVertex3if(int x, int y, float z)
+void ViewRenderer::StartCulling(const EntityLocation& loc)
 {
-    rlVertex3f(float(x), float(y), z);
+    Culling.Position = loc.Position;
+    Culling.Facing = Vector2Normalize(loc.Facing);
+    Culling.MaxDistance = MaxViewDistance;
+
+    // the floor is as far below the eye as the ceiling is above it, and both only come into the view this far out
+    Culling.FloorDepth = ViewCamera.position.z / tanf(ViewCamera.fovy * 0.5f * DEG2RAD);
 }
 
-void ViewRenderer::DrawCellFloor(int x, int y)
+bool ViewRenderer::IsWallVisible(int x, int y, WallSide side) const
 {
-    float uStart = 0;
-    float uEnd = 1;
-    FaceCount++;
-    GetCellTypeUs(10, uStart, uEnd);
+    float startX = float(x);
+    float startY = float(y);
+    float endX = float(x);
+    float endY = float(y);
+    bool facing = false;
 
-    rlSetTexture(MapTiles.id);
+    switch (side)
+    {
+    case WallSide::North:
+        startY = endY = float(y + 1);
+        endX = float(x + 1);
+        facing = Culling.Position.y > startY;
+        break;
+
+    case WallSide::South:
+        endX = float(x + 1);
+        facing = Culling.Position.y < startY;
+        break;
+
+    case WallSide::East:
+        startX = endX = float(x + 1);
+        endY = float(y + 1);
+        facing = Culling.Position.x > startX;
+        break;
+
+    case WallSide::West:
+        endY = float(y + 1);
+        facing = Culling.Position.x < startX;
+        break;
+    }
 
-    rlBegin(RL_QUADS);
-    rlColor4ub(255, 255, 255, 255);
-    rlNormal3f(0, 0, 1);
+    if (!facing)
+        return false;
 
-    rlTexCoord2f(uStart, 0);
-    rlVertex3if(x, y, 0);
+    float startDepth = Culling.GetDepth(startX, startY);
+    float endDepth = Culling.GetDepth(endX, endY);
 
-    rlTexCoord2f(uEnd, 0);
-    rlVertex3if(x + 1, y, 0);
+    if (std::max(startDepth, endDepth) <= 0)
+        return false;
 
-    rlTexCoord2f(uEnd, 1);
-    rlVertex3if(x + 1, y + 1, 0);
+    return Culling.MaxDistance <= 0 || std::min(startDepth, endDepth) <= Culling.MaxDistance;
+}
 
-    rlTexCoord2f(uStart, 1);
-    rlVertex3if(x, y + 1, 0);
+bool ViewRenderer::IsFloorVisible(int x, int y) const
+{
+    float center = Culling.GetDepth(x + 0.5f, y + 0.5f);
+    float extent = 0.5f * (fabsf(Culling.Facing.x) + fabsf(Culling.Facing.y));
 
-    rlEnd();
+    if (center + extent < Culling.FloorDepth)
+        return false;
+
+    return Culling.MaxDistance <= 0 || center - extent <= Culling.MaxDistance;
 }
 
-void ViewRenderer::DrawCellCeiling(int x, int y)
+// an area is kept while any of it is in front of the view and not past the max view distance
+bool ViewRenderer::IsAreaVisible(int minX, int minY, int maxX, int maxY) const
 {
-    float uStart = 0;
-    float uEnd = 1;
-    FaceCount++;
-    GetCellTypeUs(9, uStart, uEnd);
+    float center = Culling.GetDepth((minX + maxX) * 0.5f, (minY + maxY) * 0.5f);
+    float extent = 0.5f * (fabsf(Culling.Facing.x) * (maxX - minX) + fabsf(Culling.Facing.y) * (maxY - minY));
+
+    if (center + extent <= 0)
+        return false;
 
-    rlSetTexture(MapTiles.id);
+    return Culling.MaxDistance <= 0 || center - extent <= Culling.MaxDistance;
+}
 
-    rlBegin(RL_QUADS);
-    rlColor4ub(255, 255, 255, 255);
-    rlNormal3f(0, 0, 1);
+void ViewRenderer::CopyToStream(const MapMeshData& source, int firstFace, int count)
+{
+    if (StreamedFaces + count > StreamFaceLimit)
+        FlushStream();
 
-    rlTexCoord2f(uStart, 0);
-    rlVertex3if(x, y, 1);
+    memcpy(StreamData.Vertices.data() + StreamedFaces * MapMeshData::FaceVertexFloats,
+        source.Vertices.data() + firstFace * MapMeshData::FaceVertexFloats,
+        count * MapMeshData::FaceVertexFloats * sizeof(float));
 
-    rlTexCoord2f(uStart, 1);
-    rlVertex3if(x, y + 1, 1);
+    memcpy(StreamData.TexCoords.data() + StreamedFaces * MapMeshData::FaceTexCoordFloats,
+        source.TexCoords.data() + firstFace * MapMeshData::FaceTexCoordFloats,
+        count * MapMeshData::FaceTexCoordFloats * sizeof(float));
 
-    rlTexCoord2f(uEnd, 1);
-    rlVertex3if(x + 1, y + 1, 1);
+    memcpy(StreamData.TileRanges.data() + StreamedFaces * MapMeshData::FaceTileRangeFloats,
+        source.TileRanges.data() + firstFace * MapMeshData::FaceTileRangeFloats,
+        count * MapMeshData::FaceTileRangeFloats * sizeof(float));
 
-    rlTexCoord2f(uEnd, 0);
-    rlVertex3if(x + 1, y, 1);
+    memcpy(StreamData.Colors.data() + StreamedFaces * MapMeshData::FaceColorBytes,
+        source.Colors.data() + firstFace * MapMeshData::FaceColorBytes,
+        count * MapMeshData::FaceColorBytes);
 
-    rlEnd();
+    StreamedFaces += count;
 }
 
-void ViewRenderer::DrawCellWall(int x, int y, uint8_t cellType)
+// the culling stage, between the raycaster's visible cells and the stream
+// when merging, the faces that are kept are gathered for the greedy mesher instead of copied
+void ViewRenderer::StreamCell(int x, int y)
 {
-    if (!WorldMap)
+    MapFaceCache::CellFaces faces = FaceCache.GetCell(x, y);
+    if (faces.FaceCount == 0)
+        return;
+
+    UnculledFaceCount += faces.FaceCount;
+
+    bool merging = IsMerging();
+    if (!FaceCulling && !merging)
+    {
+        CopyToStream(*faces.Data, faces.FirstFace, faces.FaceCount);
         return;
+    }
+
+    // an empty cell's block is its floor and its ceiling, which are culled together
+    if (faces.FaceMask == 0)
+    {
+        if (FaceCulling && !IsFloorVisible(x, y))
+            return;
+
+        if (merging)
+            FrameFaces.push_back(CellFace{ x, y, 0, CellFace::FloorSide });
+        else
+            CopyToStream(*faces.Data, faces.FirstFace, faces.FaceCount);
+        return;
+    }
+
+    uint8_t tile = merging ? WorldMap->GetCellTile(x, y) : 0;
+
+    // a wall's block has a face for each side in its mask, in the order of the sides
+    int face = faces.FirstFace;
+    for (uint8_t side = 0; side < 4; side++)
+    {
+        if (!(faces.FaceMask & (1 << side)))
+            continue;
 
-    float uStart = 0;
-    float uEnd = 1;
+        if (!FaceCulling || IsWallVisible(x, y, WallSide(side)))
+        {
+            if (merging)
+                FrameFaces.push_back(CellFace{ x, y, tile, side });
+            else
+                CopyToStream(*faces.Data, face, 1);
+        }
+        face++;
+    }
+}
 
-    GetCellTypeUs(cellType, uStart, uEnd);
+void ViewRenderer::FlushStream()
+{
+    if (StreamedFaces == 0)
+        return;
 
-    static Color wallColors[4] = { WHITE, Color{128,128,128,255}, Color{196,196,196,255} , Color{200,200,200,255} };
+    UpdateMeshBuffer(StreamMesh, RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION, StreamData.Vertices.data(), StreamedFaces * MapMeshData::FaceVertexFloats * sizeof(float), 0);
+    UpdateMeshBuffer(StreamMesh, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TEXCOORD01, StreamData.TexCoords.data(), StreamedFaces * MapMeshData::FaceTexCoordFloats * sizeof(float), 0);
+    UpdateMeshBuffer(StreamMesh, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TEXCOORD02, StreamData.TileRanges.data(), StreamedFaces * MapMeshData::FaceTileRangeFloats * sizeof(float), 0);
+    UpdateMeshBuffer(StreamMesh, RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR, StreamData.Colors.data(), StreamedFaces * MapMeshData::FaceColorBytes, 0);
 
-    rlSetTexture(MapTiles.id);
-    rlBegin(RL_QUADS);
-    Color tint = WHITE;
+    // only as many triangles as were copied in are drawn
+    StreamMesh.vertexCount = StreamedFaces * 4;
+    StreamMesh.triangleCount = StreamedFaces * 2;
+    DrawMesh(StreamMesh, MeshMaterial, MatrixIdentity());
 
-    if (!WorldMap->GetCellSolid(x, y + 1))
+    FaceCount += StreamedFaces;
+    StreamedFaces = 0;
+}
+
+// each visible cell's block of faces is copied from the cache, the walls were worked out when the cell's chunk was built
+void ViewRenderer::DrawVisibleCells()
+{
+    if (!StreamMesh.vboId)
     {
-        FaceCount++;
-        // north
-        tint = wallColors[0];
+        StreamData.Vertices.resize(StreamFaceLimit * MapMeshData::FaceVertexFloats);
+        StreamData.TexCoords.resize(StreamFaceLimit * MapMeshData::FaceTexCoordFloats);
+        StreamData.TileRanges.resize(StreamFaceLimit * MapMeshData::FaceTileRangeFloats);
+        StreamData.Colors.resize(StreamFaceLimit * MapMeshData::FaceColorBytes);
+
+        // every face is a quad, so the indexes never change
+        StreamData.Indices.resize(StreamFaceLimit * MapMeshData::FaceIndexCount);
+        for (int face = 0; face < StreamFaceLimit; face++)
+        {
+            uint16_t first = uint16_t(face * 4);
+            uint16_t* indices = StreamData.Indices.data() + face * MapMeshData::FaceIndexCount;
+            indices[0] = first;
+            indices[1] = uint16_t(first + 1);
+            indices[2] = uint16_t(first + 2);
+            indices[3] = first;
+            indices[4] = uint16_t(first + 2);
+            indices[5] = uint16_t(first + 3);
+        }
 
-        rlColor4ub(tint.r, tint.g, tint.b, 255);
-        rlNormal3f(0, 1, 0);
+        StreamMesh.vertexCount = StreamFaceLimit * 4;
+        StreamMesh.triangleCount = StreamFaceLimit * 2;
+        StreamMesh.vertices = StreamData.Vertices.data();
+        StreamMesh.texcoords = StreamData.TexCoords.data();
+        StreamMesh.texcoords2 = StreamData.TileRanges.data();
+        StreamMesh.colors = StreamData.Colors.data();
+        StreamMesh.indices = StreamData.Indices.data();
+        UploadMesh(&StreamMesh, true);
+    }
 
-        rlTexCoord2f(uStart, 1);
-        rlVertex3if(x + 1, y + 1, 0);
+    StreamedFaces = 0;
+    FrameFaces.clear();
 
-        rlTexCoord2f(uEnd, 1);
-        rlVertex3if(x, y + 1, 0);
+    for (const auto& pos : Caster.GetHitCelList())
+        StreamCell(pos.x, pos.y);
 
-        rlTexCoord2f(uEnd, 0);
-        rlVertex3if(x, y + 1, 1);
+    // empty blocks that rays skipped over are all floor
+    for (const auto& block : Caster.GetHitBlockList())
+    {
+        int maxX = std::min(block.X + block.Size, WorldMap->GetWidth());
+        int maxY = std::min(block.Y + block.Size, WorldMap->GetHeight());
 
-        rlTexCoord2f(uStart, 0);
-        rlVertex3if(x + 1, y + 1, 1);
+        for (int y = block.Y; y < maxY; y++)
+        {
+            for (int x = block.X; x < maxX; x++)
+                StreamCell(x, y);
+        }
     }
 
-    // south
-    if (!WorldMap->GetCellSolid(x, y - 1))
+    // the kept faces are merged across cells, and the merged quads go through the stream like the cells' faces do
+    if (!FrameFaces.empty())
     {
-        FaceCount++;
+        FrameMerged.Clear();
+        FaceCache.GetBuilder().BuildMerged(FrameFaces, FrameMerged);
 
-        tint = wallColors[1];
-        rlColor4ub(tint.r, tint.g, tint.b, 255);
-        rlNormal3f(0, -1, 0);
+        for (int face = 0; face < FrameMerged.FaceCount; face += StreamFaceLimit)
+            CopyToStream(FrameMerged, face, std::min(StreamFaceLimit, FrameMerged.FaceCount - face));
+    }
 
-        rlTexCoord2f(uStart, 1);
-        rlVertex3if(x + 1, y, 0);
+    FlushStream();
+}
 
-        rlTexCoord2f(uStart, 0);
-        rlVertex3if(x + 1, y, 1);
+void ViewRenderer::UnloadChunkMeshes()
+{
+    for (auto& chunk : ChunkMeshes)
+        UnloadSharedMesh(chunk.GPUMesh);
 
-        rlTexCoord2f(uEnd, 0);
-        rlVertex3if(x, y, 1);
+    ChunkMeshes.clear();
+}
 
-        rlTexCoord2f(uEnd, 1);
-        rlVertex3if(x, y, 0);
-    }
+void ViewRenderer::AddVisibleChunk(int chunkX, int chunkY)
+{
+    if (chunkX < 0 || chunkY < 0 || chunkX >= FaceCache.GetChunksX() || chunkY >= FaceCache.GetChunksY())
+        return;
+
+    int index = chunkY * FaceCache.GetChunksX() + chunkX;
+    if (ChunkMeshes[index].DrawnFrame == Frame)
+        return;
+
+    ChunkMeshes[index].DrawnFrame = Frame;
+    VisibleChunks.push_back(index);
+}
 
-    // east
-    if (!WorldMap->GetCellSolid(x + 1, y))
+// every chunk holding a cell the raycaster saw is drawn whole, the depth buffer hides what the rays did not reach
+void ViewRenderer::DrawChunkMeshes()
+{
+    size_t chunkCount = size_t(FaceCache.GetChunksX()) * FaceCache.GetChunksY();
+    if (ChunkMeshes.size() != chunkCount)
     {
-        FaceCount++;
-        tint = wallColors[2];
-        rlColor4ub(tint.r, tint.g, tint.b, 255);
-        rlNormal3f(1, 0, 0);
+        UnloadChunkMeshes();
+        ChunkMeshes.resize(chunkCount);
+    }
 
-        rlTexCoord2f(uStart, 1);
-        rlVertex3if(x + 1, y, 0);
+    Frame++;
+    VisibleChunks.clear();
 
-        rlTexCoord2f(uEnd, 1);
-        rlVertex3if(x + 1, y + 1, 0);
+    int chunkSize = MapFaceCache::ChunkSize;
+    for (const auto& pos : Caster.GetHitCelList())
+        AddVisibleChunk(pos.x / chunkSize, pos.y / chunkSize);
 
-        rlTexCoord2f(uEnd, 0);
-        rlVertex3if(x + 1, y + 1, 1);
+    for (const auto& block : Caster.GetHitBlockList())
+    {
+        int maxX = (block.X + block.Size - 1) / chunkSize;
+        int maxY = (block.Y + block.Size - 1) / chunkSize;
 
-        rlTexCoord2f(uStart, 0);
-        rlVertex3if(x + 1, y, 1);
+        for (int chunkY = block.Y / chunkSize; chunkY <= maxY; chunkY++)
+        {
+            for (int chunkX = block.X / chunkSize; chunkX <= maxX; chunkX++)
+                AddVisibleChunk(chunkX, chunkY);
+        }
     }
 
-    // west
-    if (!WorldMap->GetCellSolid(x - 1, y))
+    bool merging = IsMerging();
+
+    for (int index : VisibleChunks)
     {
-        FaceCount++;
-        tint = wallColors[3];
-        rlColor4ub(tint.r, tint.g, tint.b, 255);
-        rlNormal3f(-1, 0, 0);
+        int chunkX = index % FaceCache.GetChunksX();
+        int chunkY = index / FaceCache.GetChunksX();
+        const MapFaceCache::Chunk* chunk = FaceCache.GetChunk(chunkX, chunkY);
+        ChunkMesh& chunkMesh = ChunkMeshes[index];
+
+        // the merged faces are built once for each build of the chunk, and uploaded in place of its cells' faces
+        const MapMeshData& data = merging ? *FaceCache.GetMergedChunk(chunkX, chunkY) : chunk->Data;
+
+        if (chunkMesh.Revision != chunk->Revision || chunkMesh.Merged != merging)
+        {
+            UnloadSharedMesh(chunkMesh.GPUMesh);
+            chunkMesh.Revision = chunk->Revision;
+            chunkMesh.Merged = merging;
+
+            if (data.FaceCount > 0)
+            {
+                Mesh& mesh = chunkMesh.GPUMesh;
+                mesh.vertexCount = data.GetVertexCount();
+                mesh.triangleCount = data.GetTriangleCount();
+                mesh.vertices = const_cast<float*>(data.Vertices.data());
+                mesh.texcoords = const_cast<float*>(data.TexCoords.data());
+                mesh.texcoords2 = const_cast<float*>(data.TileRanges.data());
+                mesh.normals = const_cast<float*>(data.Normals.data());
+                mesh.colors = const_cast<uint8_t*>(data.Colors.data());
+                mesh.indices = const_cast<uint16_t*>(data.Indices.data());
+
+                UploadMesh(&mesh, false);
+            }
+        }
 
-        rlTexCoord2f(uStart, 1);
-        rlVertex3if(x, y, 0);
+        if (chunk->Data.FaceCount == 0)
+            continue;
 
-        rlTexCoord2f(uStart, 0);
-        rlVertex3if(x, y, 1);
+        UnculledFaceCount += chunk->Data.FaceCount;
 
-        rlTexCoord2f(uEnd, 0);
-        rlVertex3if(x, y + 1, 1);
+        int minX = chunkX * chunkSize;
+        int minY = chunkY * chunkSize;
+        if (FaceCulling && !IsAreaVisible(minX, minY, minX + chunkSize, minY + chunkSize))
+            continue;
 
-        rlTexCoord2f(uEnd, 1);
-        rlVertex3if(x, y + 1, 0);
+        DrawMesh(chunkMesh.GPUMesh, MeshMaterial, MatrixIdentity());
+        FaceCount += data.FaceCount;
     }
-
-    rlEnd();
 }
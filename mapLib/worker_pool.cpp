@@ -0,0 +1,86 @@
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool(int threadCount)
+{
+    for (int i = 1; i < threadCount; i++)
+        Workers.emplace_back(&WorkerPool::WorkerLoop, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        Quit = true;
+    }
+    WakeWorkers.notify_all();
+
+    for (auto& worker : Workers)
+        worker.join();
+}
+
+int WorkerPool::GetHardwareThreadCount()
+{
+    int count = int(std::thread::hardware_concurrency());
+    return count > 0 ? count : 1;
+}
+
+void WorkerPool::ParallelFor(int count, const std::function<void(int)>& job)
+{
+    if (count <= 0)
+        return;
+
+    if (Workers.empty() || count == 1)
+    {
+        for (int i = 0; i < count; i++)
+            job(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        CurrentJob = &job;
+        JobCount = count;
+        NextJob = 0;
+        BusyWorkers = int(Workers.size());
+        BatchId++;
+    }
+    WakeWorkers.notify_all();
+
+    // the calling thread works too
+    RunJobs();
+
+    std::unique_lock<std::mutex> lock(Lock);
+    BatchDone.wait(lock, [this]() { return BusyWorkers == 0; });
+    CurrentJob = nullptr;
+}
+
+void WorkerPool::RunJobs()
+{
+    for (int i = NextJob++; i < JobCount; i = NextJob++)
+        (*CurrentJob)(i);
+}
+
+void WorkerPool::WorkerLoop()
+{
+    uint64_t lastBatch = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(Lock);
+            WakeWorkers.wait(lock, [this, lastBatch]() { return Quit || BatchId != lastBatch; });
+
+            if (Quit)
+                return;
+
+            lastBatch = BatchId;
+        }
+
+        RunJobs();
+
+        std::lock_guard<std::mutex> guard(Lock);
+        BusyWorkers--;
+        if (BusyWorkers == 0)
+            BatchDone.notify_one();
+    }
+}
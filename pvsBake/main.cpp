@@ -0,0 +1,39 @@
+/*
+*   PVS baker
+*   Bakes the potentially visible set for a map and writes it next to the map file, where the game looks for it
+*
+*   usage: pvsBake [map file] [thread count]
+*/
+
+#include "map.h"
+#include "map_serializer.h"
+#include "potentially_visible_set.h"
+#include "worker_pool.h"
+
+#include <chrono>
+#include <cstdlib>
+
+int main(int argc, char* argv[])
+{
+    const char* mapFile = argc > 1 ? argv[1] : "resources/maps/test.mres";
+    int threads = argc > 2 ? atoi(argv[2]) : WorkerPool::GetHardwareThreadCount();
+
+    MapSerializer serializer;
+    Map map = serializer.ReadResource(mapFile);
+
+    PotentiallyVisibleSet pvs;
+
+    auto start = std::chrono::steady_clock::now();
+    pvs.Bake(map, threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::string outFile = PotentiallyVisibleSet::GetSidecarPath(mapFile);
+    if (!pvs.Write(outFile))
+    {
+        printf("could not write %s\n", outFile.c_str());
+        return 1;
+    }
+
+    printf("baked %s %dx%d on %d threads in %.2fs, wrote %s (%d bytes)\n", mapFile, map.GetWidth(), map.GetHeight(), threads, seconds, outFile.c_str(), int(pvs.GetDataSize()));
+    return 0;
+}
@@ -0,0 +1,1085 @@
+/*
+*   Raycaster benchmark
+*   Casts the same set of views through each raycaster mode, without opening a window, and reports the throughput
+*   Also checks the faces the map mesh builder makes for the renderer, which needs no GPU
+*   Then replays a camera path, recorded in the game with F5 or scripted from the map, and reports the per frame numbers
+*
+*   usage: raycastBench [options] [map file] [render width] [thread count]
+*
+*   --path file         replay a recorded camera path instead of the scripted one
+*   --frames count      frames in the scripted path
+*   --backend name      rays, beam, pvs or sectors for the replay
+*   --coherent          replay in coherent mode
+*   --json              only replay the path, and write the report to stdout as JSON
+*/
+
+#include "raymath.h"
+
+#include "camera_path.h"
+#include "map.h"
+#include "map_mesh.h"
+#include "map_serializer.h"
+#include "raycaster.h"
+#include "line_of_sight.h"
+#include "potentially_visible_set.h"
+#include "sector_map.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+constexpr float BenchFOVY = 40;
+constexpr int BenchFacings = 64;
+constexpr int BenchPositions = 128;
+constexpr int BenchPasses = 3;
+constexpr size_t PVSBakeCellLimit = 128 * 128;
+constexpr int ScriptedPathFrames = 4000;
+
+struct BenchResult
+{
+    double Seconds = 0;
+    long long Casts = 0;
+    long long Frames = 0;
+};
+
+// up to BenchPositions empty cell centers, spread over the map, looking in BenchFacings directions
+std::vector<EntityLocation> BuildViewList(const Map& map)
+{
+    std::vector<Vector2> positions;
+
+    for (int y = 0; y < map.GetHeight(); y++)
+    {
+        for (int x = 0; x < map.GetWidth(); x++)
+        {
+            if (map.GetCellPassable(x, y))
+                positions.push_back(Vector2{ x + 0.5f, y + 0.5f });
+        }
+    }
+
+    size_t stride = positions.size() / BenchPositions + 1;
+
+    std::vector<EntityLocation> views;
+    for (size_t p = 0; p < positions.size(); p += stride)
+    {
+        for (int i = 0; i < BenchFacings; i++)
+        {
+            float angle = (i * 360.0f / BenchFacings) * DEG2RAD;
+            views.push_back(EntityLocation{ positions[p], Vector2{ cosf(angle), sinf(angle) } });
+        }
+    }
+
+    return views;
+}
+
+BenchResult RunViews(Raycaster& raycaster, const std::vector<EntityLocation>& views)
+{
+    BenchResult result;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (int pass = 0; pass < BenchPasses; pass++)
+    {
+        for (const auto& view : views)
+        {
+            raycaster.StartFrame(view);
+            result.Casts += raycaster.GetCastCount();
+            result.Frames++;
+        }
+    }
+
+    result.Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    return result;
+}
+
+// rays that were not cast this frame keep stale values, so only the cast ones are compared
+bool SameRay(const RayResult& a, const RayResult& b)
+{
+    if (a.HitCellIndex < 0 || b.HitCellIndex < 0)
+        return a.HitCellIndex == b.HitCellIndex;
+
+    return memcmp(&a.Directon, &b.Directon, sizeof(Vector2)) == 0
+        && memcmp(&a.Distance, &b.Distance, sizeof(float)) == 0
+        && a.Normal == b.Normal
+        && a.HitGridType == b.HitGridType
+        && a.HitCellIndex == b.HitCellIndex
+        && a.TargetCell.x == b.TargetCell.x
+        && a.TargetCell.y == b.TargetCell.y;
+}
+
+std::vector<int> GetSortedCells(const Map& map, const Raycaster& raycaster)
+{
+    std::vector<int> cells;
+    for (const auto& loc : raycaster.GetHitCelList())
+        cells.push_back(map.GetCellIndex(loc));
+
+    std::sort(cells.begin(), cells.end());
+    return cells;
+}
+
+bool SeesCells(const Raycaster& reference, const Raycaster& test)
+{
+    for (const auto& loc : reference.GetHitCelList())
+    {
+        if (!test.IsCellVis(loc.x, loc.y))
+            return false;
+    }
+
+    return true;
+}
+
+// cast every view with both casters and count the views that do not match
+int CompareViews(const Map& map, Raycaster& reference, Raycaster& test, const std::vector<EntityLocation>& views)
+{
+    int mismatches = 0;
+    bool skipping = test.GetEmptySpaceSkipping();
+
+    for (const auto& view : views)
+    {
+        reference.StartFrame(view);
+        test.StartFrame(view);
+
+        bool same = reference.GetCastCount() == test.GetCastCount();
+
+        for (size_t i = 0; same && i < reference.GetResults().size(); i++)
+            same = SameRay(reference.GetResults()[i], test.GetResults()[i]);
+
+        // skipping marks whole blocks as seen, so it only has to see every cell the reference does
+        if (same && skipping)
+            same = SeesCells(reference, test);
+        else if (same)
+            same = GetSortedCells(map, reference) == GetSortedCells(map, test);
+
+        if (!same)
+            mismatches++;
+    }
+
+    return mismatches;
+}
+
+void PrintResult(const char* name, const BenchResult& result)
+{
+    printf("%-10s %8lld frames %10lld casts %8.3f s %12.0f rays/sec %8.1f us/frame\n",
+        name, result.Frames, result.Casts, result.Seconds,
+        result.Casts / result.Seconds, result.Seconds * 1000000.0 / result.Frames);
+}
+
+// every view's position checks line of sight to every other position, with and without the viewer's visible cells
+// the answers with the visible cells have to match the grid walks exactly
+void RunLineOfSight(const Map& map, Raycaster& raycaster, const std::vector<EntityLocation>& views, int threads)
+{
+    std::vector<LineOfSightQuery> queries;
+    for (size_t i = 0; i < views.size(); i += BenchFacings)
+        queries.push_back(LineOfSightQuery{ views[i].Position, views[0].Position });
+
+    std::vector<LineOfSightResult> results(queries.size());
+
+    LineOfSight lineOfSight(&map);
+    lineOfSight.SetThreadCount(threads);
+
+    std::vector<uint8_t> walked(views.size() * queries.size());
+
+    for (int cached = 0; cached < 2; cached++)
+    {
+        long long queryCount = 0;
+        long long walkCount = 0;
+        long long wrongCount = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+
+        for (size_t v = 0; v < views.size(); v++)
+        {
+            raycaster.StartFrame(views[v]);
+            lineOfSight.SetViewer(cached ? &raycaster : nullptr, views[v].Position);
+
+            for (auto& query : queries)
+                query.Target = views[v].Position;
+
+            lineOfSight.Query(queries.data(), results.data(), queries.size());
+            queryCount += queries.size();
+            walkCount += lineOfSight.GetWalkCount();
+
+            uint8_t* answers = walked.data() + v * queries.size();
+            for (size_t q = 0; q < queries.size(); q++)
+            {
+                if (!cached)
+                    answers[q] = results[q].Visible;
+                else if (answers[q] != uint8_t(results[q].Visible))
+                    wrongCount++;
+            }
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        printf("%-10s %8lld queries %10lld walks %8.3f s (includes the raycast for each view)", cached ? "los+vis" : "los", queryCount, walkCount, seconds);
+        if (cached)
+            printf(", %lld answers differ from the grid walk", wrongCount);
+        printf("\n");
+    }
+}
+
+// the beam sweep against the ray bisection, at the bench width and at a quarter of it
+// the cells only the sweep finds are the ones the bisection missed. The other way around are cells behind a diagonal gap
+// of zero width, that the DDA steps through on a ray that goes exactly through the corner, and the sweep treats as closed
+void RunBeams(const Map& map, Raycaster& reference, const std::vector<EntityLocation>& views, int renderWidth, float fovX)
+{
+    Raycaster beams(&map, renderWidth, fovX);
+    beams.SetVisibilityBackend(VisibilityBackend::BeamSweep);
+
+    PrintResult("beam", RunViews(beams, views));
+
+    long long referenceCells = 0;
+    long long beamCells = 0;
+    long long missedCells = 0;
+    long long wrongCells = 0;
+    long long faces = 0;
+
+    for (const auto& view : views)
+    {
+        reference.StartFrame(view);
+        beams.StartFrame(view);
+
+        referenceCells += reference.GetHitCelList().size();
+        beamCells += beams.GetHitCelList().size();
+        faces += beams.GetHitFaceList().size();
+
+        for (const auto& cell : beams.GetHitCelList())
+        {
+            if (!reference.IsCellVis(cell.x, cell.y))
+                missedCells++;
+        }
+
+        for (const auto& cell : reference.GetHitCelList())
+        {
+            if (!beams.IsCellVis(cell.x, cell.y))
+                wrongCells++;
+        }
+    }
+
+    printf("beam       %.1f cells/view (%.1f faces) vs %.1f bisection, %.2f cells/view missed by the bisection, %lld bisection cells through corners\n",
+        double(beamCells) / views.size(), double(faces) / views.size(), double(referenceCells) / views.size(), double(missedCells) / views.size(), wrongCells);
+
+    // the sweep does not depend on the width, the bisection does
+    Raycaster narrowBeams(&map, renderWidth / 4, fovX);
+    narrowBeams.SetVisibilityBackend(VisibilityBackend::BeamSweep);
+    Raycaster narrowRays(&map, renderWidth / 4, fovX);
+
+    PrintResult("beam/4", RunViews(narrowBeams, views));
+    PrintResult("rays/4", RunViews(narrowRays, views));
+}
+
+// bake the map, then cast with the set clamping the rays, and with the set as the whole backend
+// returns the views that lost a cell the rays see without the set, from the cell centres or from points off them
+int RunPVS(const Map& map, Raycaster& reference, const std::vector<EntityLocation>& views, int renderWidth, float fovX, int threads)
+{
+    // the bake follows lines out of every cell, which is too slow to wait on for the large maps
+    if (size_t(map.GetWidth()) * map.GetHeight() > PVSBakeCellLimit)
+    {
+        printf("pvs        skipped, the map has more than %d cells\n", int(PVSBakeCellLimit));
+        return 0;
+    }
+
+    PotentiallyVisibleSet pvs;
+
+    auto start = std::chrono::steady_clock::now();
+    pvs.Bake(map, threads);
+    double bakeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("pvs        baked in %.2fs, %d bytes (%.1f per cell)\n", bakeSeconds, int(pvs.GetDataSize()), double(pvs.GetDataSize()) / (map.GetWidth() * map.GetHeight()));
+
+    Raycaster clamped(&map, renderWidth, fovX);
+    clamped.SetPVS(&pvs);
+
+    Raycaster culled(&map, renderWidth, fovX);
+    culled.SetPVS(&pvs);
+    culled.SetVisibilityBackend(VisibilityBackend::PotentiallyVisible);
+
+    PrintResult("rays+pvs", RunViews(clamped, views));
+    PrintResult("pvs", RunViews(culled, views));
+
+    // the same views moved to a spread of points inside their cells, out to near the edges
+    std::vector<EntityLocation> offCentre = views;
+    uint32_t seed = 1;
+    for (auto& view : offCentre)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        view.Position.x = floorf(view.Position.x) + 0.01f + 0.98f * float(seed >> 8) / 16777216.0f;
+        seed = seed * 1664525u + 1013904223u;
+        view.Position.y = floorf(view.Position.y) + 0.01f + 0.98f * float(seed >> 8) / 16777216.0f;
+    }
+
+    int failedViews = 0;
+
+    auto compare = [&](const char* name, const std::vector<EntityLocation>& compareViews)
+    {
+        long long referenceCells = 0;
+        long long droppedCells = 0;
+        long long culledCells = 0;
+        long long missingCells = 0;
+
+        for (const auto& view : compareViews)
+        {
+            reference.StartFrame(view);
+            clamped.StartFrame(view);
+            culled.StartFrame(view);
+
+            referenceCells += reference.GetHitCelList().size();
+            culledCells += culled.GetHitCelList().size();
+
+            bool failed = false;
+            for (const auto& cell : reference.GetHitCelList())
+            {
+                if (!clamped.IsCellVis(cell.x, cell.y))
+                {
+                    droppedCells++;
+                    failed = true;
+                }
+                if (!culled.IsCellVis(cell.x, cell.y))
+                {
+                    missingCells++;
+                    failed = true;
+                }
+            }
+
+            if (failed)
+                failedViews++;
+        }
+
+        printf("%-10s %.1f cells/view vs %.1f bisection, %.2f cells/view dropped by the clamped rays, %.2f missing from the set\n", name,
+            double(culledCells) / compareViews.size(), double(referenceCells) / compareViews.size(), double(droppedCells) / compareViews.size(), double(missingCells) / compareViews.size());
+    };
+
+    compare("pvs", views);
+    compare("pvs/off", offCentre);
+
+    if (failedViews != 0)
+        printf("pvs        sets are MISSING cells in %d views\n", failedViews);
+
+    return failedViews;
+}
+
+// the same casts against a copy of the map kept in 64x64 palette chunks, which has to find the same cells
+// returns the views that differ from the dense map
+int RunChunked(const Map& map, Raycaster& reference, const std::vector<EntityLocation>& views, int renderWidth, float fovX)
+{
+    Map chunked = map;
+    chunked.SetStorage(MapStorage::Chunked);
+
+    const MapChunkStore& chunks = chunked.GetChunks();
+    int chunkCount = chunks.GetChunksX() * chunks.GetChunksY();
+
+    printf("chunked    cells %.2f MB dense vs %.2f MB chunked, %d of %d chunks uniform\n",
+        map.GetCellMemoryUse() / (1024.0 * 1024.0), chunked.GetCellMemoryUse() / (1024.0 * 1024.0), chunks.GetUniformChunkCount(), chunkCount);
+
+    Raycaster raycaster(&chunked, renderWidth, fovX);
+    int mismatches = CompareViews(chunked, reference, raycaster, views);
+
+    // a fresh caster for each, so neither one runs warm
+    Raycaster dense(&map, renderWidth, fovX);
+    PrintResult("dense", RunViews(dense, views));
+    PrintResult("chunked", RunViews(raycaster, views));
+
+    if (mismatches != 0)
+        printf("chunked    results DIFFER from dense in %d of %d views\n", mismatches, int(views.size()));
+
+    return mismatches;
+}
+
+// cast with a short view distance, and check every cell the rays see without it, that is near enough to be in range from any side, is still seen
+// returns the views that lost a cell, for the single and multi threaded casts
+int RunViewDistance(const Map& map, Raycaster& reference, const std::vector<EntityLocation>& views, int renderWidth, float fovX, int threads)
+{
+    constexpr float viewDistance = 16;
+
+    int failed = 0;
+    for (int threadCount : { 1, threads })
+    {
+        Raycaster raycaster(&map, renderWidth, fovX);
+        raycaster.SetThreadCount(threadCount);
+        raycaster.SetMaxViewDistance(viewDistance);
+
+        const char* name = threadCount > 1 ? "fog/thr" : "fog";
+        PrintResult(name, RunViews(raycaster, views));
+
+        int failedViews = 0;
+        long long missedCells = 0;
+        for (const auto& view : views)
+        {
+            reference.StartFrame(view);
+            raycaster.StartFrame(view);
+
+            int missed = 0;
+            for (const auto& cell : reference.GetHitCelList())
+            {
+                // the far corner of the cell, every ray into it enters before this
+                float dx = std::max(fabsf(cell.x - view.Position.x), fabsf(cell.x + 1 - view.Position.x));
+                float dy = std::max(fabsf(cell.y - view.Position.y), fabsf(cell.y + 1 - view.Position.y));
+
+                if (dx * dx + dy * dy < viewDistance * viewDistance && !raycaster.IsCellVis(cell.x, cell.y))
+                    missed++;
+            }
+
+            missedCells += missed;
+            if (missed != 0)
+                failedViews++;
+        }
+
+        if (failedViews != 0)
+            printf("%-10s results MISSING %lld cells in range in %d of %d views\n", name, missedCells, failedViews, int(views.size()));
+
+        failed += failedViews;
+    }
+
+    return failed;
+}
+
+// walk the sectors from each view, then again while a cell in front of the view is walled up and opened each frame
+// the walk sees through corners the rays miss, so extra cells are expected, missing ones are not
+void RunSectors(Map& map, Raycaster& reference, const std::vector<EntityLocation>& views, int renderWidth, float fovX)
+{
+    Raycaster sectors(&map, renderWidth, fovX);
+    sectors.SetVisibilityBackend(VisibilityBackend::SectorPortals);
+
+    PrintResult("sectors", RunViews(sectors, views));
+
+    SectorMap build;
+    auto start = std::chrono::steady_clock::now();
+    build.Build(map);
+    double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    long long referenceCells = 0;
+    long long sectorCells = 0;
+    long long missingCells = 0;
+
+    for (const auto& view : views)
+    {
+        reference.StartFrame(view);
+        sectors.StartFrame(view);
+
+        referenceCells += reference.GetHitCelList().size();
+        sectorCells += sectors.GetHitCelList().size();
+
+        for (const auto& cell : reference.GetHitCelList())
+        {
+            if (!sectors.IsCellVis(cell.x, cell.y))
+                missingCells++;
+        }
+    }
+
+    printf("sectors    %d sectors built in %.3f ms, %.1f cells/view vs %.1f bisection, %.2f cells/view missing\n",
+        build.GetLiveSectorCount(), buildSeconds * 1000, double(sectorCells) / views.size(), double(referenceCells) / views.size(), double(missingCells) / views.size());
+
+    BenchResult edits;
+    long long editMissing = 0;
+
+    for (size_t v = 0; v < views.size(); v += BenchFacings / 4)
+    {
+        const EntityLocation& view = views[v];
+        int cellX = int(floorf(view.Position.x + view.Facing.x * 2));
+        int cellY = int(floorf(view.Position.y + view.Facing.y * 2));
+        if (map.GetCellSolid(cellX, cellY) || !map.GetCellPassable(cellX, cellY))
+            continue;
+
+        for (int i = 0; i < 2; i++)
+        {
+            map.SetCellState(cellX, cellY, i == 0 ? CellState::Solid : CellState::Empty);
+
+            start = std::chrono::steady_clock::now();
+            sectors.StartFrame(view);
+            edits.Seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            edits.Frames++;
+
+            reference.StartFrame(view);
+            for (const auto& cell : reference.GetHitCelList())
+            {
+                if (!sectors.IsCellVis(cell.x, cell.y))
+                    editMissing++;
+            }
+        }
+    }
+
+    if (edits.Frames > 0)
+        printf("sectors    %lld edit frames at %.1f us/frame, %.2f cells/view missing\n", edits.Frames, edits.Seconds * 1e6 / edits.Frames, double(editMissing) / edits.Frames);
+}
+
+// the cell and side of every cell sized part of every face in the mesh, as one key each, so meshes that merge faces
+// differently can be compared. Sides are the WallSide values, then 4 for floors and 5 for ceilings
+void GetMeshCellFaces(const Map& map, const MapMeshData& mesh, std::vector<int>& keys)
+{
+    for (int face = 0; face < mesh.FaceCount; face++)
+    {
+        const float* vertices = &mesh.Vertices[face * MapMeshData::FaceVertexFloats];
+        const float* normal = &mesh.Normals[face * MapMeshData::FaceVertexFloats];
+
+        float minX = vertices[0];
+        float minY = vertices[1];
+        float maxX = vertices[0];
+        float maxY = vertices[1];
+        for (int i = 1; i < 4; i++)
+        {
+            minX = std::min(minX, vertices[i * 3]);
+            minY = std::min(minY, vertices[i * 3 + 1]);
+            maxX = std::max(maxX, vertices[i * 3]);
+            maxY = std::max(maxY, vertices[i * 3 + 1]);
+        }
+
+        int side = CellFace::FloorSide;
+        if (normal[2] < 0)
+            side = CellFace::FloorSide + 1;
+        else if (normal[1] > 0)
+            side = int(WallSide::North);
+        else if (normal[1] < 0)
+            side = int(WallSide::South);
+        else if (normal[0] > 0)
+            side = int(WallSide::East);
+        else if (normal[0] < 0)
+            side = int(WallSide::West);
+
+        // a wall lies on the edge of its cells, on the far side of them from where its normal points
+        int cellMinX = int(minX);
+        int cellMinY = int(minY);
+        int cellMaxX = int(maxX);
+        int cellMaxY = int(maxY);
+        if (normal[0] != 0)
+        {
+            cellMinX -= normal[0] > 0 ? 1 : 0;
+            cellMaxX = cellMinX + 1;
+        }
+        if (normal[1] != 0)
+        {
+            cellMinY -= normal[1] > 0 ? 1 : 0;
+            cellMaxY = cellMinY + 1;
+        }
+
+        for (int y = cellMinY; y < cellMaxY; y++)
+        {
+            for (int x = cellMinX; x < cellMaxX; x++)
+                keys.push_back((side * map.GetHeight() + y) * map.GetWidth() + x);
+        }
+    }
+}
+
+// the faces whose triangles do not wind counter clockwise seen from the side the normal points to, the side the GPU draws,
+// or whose normal does not point out of the face into an open cell
+int CountBadFaces(const Map& map, const MapMeshData& mesh)
+{
+    int badFaces = 0;
+    for (int face = 0; face < mesh.FaceCount; face++)
+    {
+        const float* normal = &mesh.Normals[face * MapMeshData::FaceVertexFloats];
+        bool bad = false;
+
+        for (int triangle = 0; triangle < 2; triangle++)
+        {
+            const uint16_t* indices = &mesh.Indices[face * MapMeshData::FaceIndexCount + triangle * 3];
+            Vector3 a = { mesh.Vertices[indices[0] * 3], mesh.Vertices[indices[0] * 3 + 1], mesh.Vertices[indices[0] * 3 + 2] };
+            Vector3 b = { mesh.Vertices[indices[1] * 3], mesh.Vertices[indices[1] * 3 + 1], mesh.Vertices[indices[1] * 3 + 2] };
+            Vector3 c = { mesh.Vertices[indices[2] * 3], mesh.Vertices[indices[2] * 3 + 1], mesh.Vertices[indices[2] * 3 + 2] };
+
+            Vector3 facing = Vector3Normalize(Vector3CrossProduct(Vector3Subtract(b, a), Vector3Subtract(c, a)));
+            if (Vector3DotProduct(facing, Vector3{ normal[0], normal[1], normal[2] }) < 0.999f)
+                bad = true;
+        }
+
+        Vector3 center = { 0, 0, 0 };
+        for (int i = 0; i < 4; i++)
+            center = Vector3Add(center, Vector3{ mesh.Vertices[face * MapMeshData::FaceVertexFloats + i * 3], mesh.Vertices[face * MapMeshData::FaceVertexFloats + i * 3 + 1], mesh.Vertices[face * MapMeshData::FaceVertexFloats + i * 3 + 2] });
+        center = Vector3Scale(center, 0.25f);
+
+        Vector3 front = Vector3Add(center, Vector3Scale(Vector3{ normal[0], normal[1], normal[2] }, 0.5f));
+        if (front.z <= 0 || front.z >= 1 || map.GetCellSolid(int(floorf(front.x)), int(floorf(front.y))))
+            bad = true;
+
+        if (bad)
+            badFaces++;
+    }
+
+    return badFaces;
+}
+
+// build the map in areas, cell by cell and merged, and check both cover the same cell faces and that every face is the right way around
+// returns the number of problems found
+int CheckMapMesh(const char* name, const Map& map, const MapMeshBuilder& builder)
+{
+    // small enough that the 16 bit indexes of an area never wrap
+    constexpr int areaSize = 32;
+
+    int badFaces = 0;
+    int cellFaceCount = 0;
+    int mergedFaceCount = 0;
+    std::vector<int> cellKeys;
+    std::vector<int> mergedKeys;
+    std::vector<CellFace> faces;
+
+    for (int areaY = 0; areaY < map.GetHeight(); areaY += areaSize)
+    {
+        for (int areaX = 0; areaX < map.GetWidth(); areaX += areaSize)
+        {
+            MapMeshData cells;
+            builder.BuildArea(map, areaX, areaY, areaX + areaSize, areaY + areaSize, cells);
+
+            faces.clear();
+            for (int y = areaY; y < std::min(areaY + areaSize, map.GetHeight()); y++)
+            {
+                for (int x = areaX; x < std::min(areaX + areaSize, map.GetWidth()); x++)
+                    MapMeshBuilder::GetCellFaces(map, x, y, MapMeshBuilder::GetFaceMask(map, x, y), faces);
+            }
+
+            MapMeshData merged;
+            builder.BuildMerged(faces, merged);
+
+            badFaces += CountBadFaces(map, cells) + CountBadFaces(map, merged);
+            cellFaceCount += cells.FaceCount;
+            mergedFaceCount += merged.FaceCount;
+
+            GetMeshCellFaces(map, cells, cellKeys);
+            GetMeshCellFaces(map, merged, mergedKeys);
+        }
+    }
+
+    std::sort(cellKeys.begin(), cellKeys.end());
+    std::sort(mergedKeys.begin(), mergedKeys.end());
+
+    bool sameCells = cellKeys == mergedKeys && int(cellKeys.size()) == cellFaceCount;
+
+    printf("%-10s %d faces cell by cell, %d merged, %s, %d faces wound or facing the wrong way\n", name, cellFaceCount, mergedFaceCount,
+        sameCells ? "same cells covered" : "cells covered DIFFER", badFaces);
+
+    return badFaces + (sameCells ? 0 : 1);
+}
+
+// check the mesh builder without a GPU, the face masks and counts of a small map that are known by hand, then the meshes of it and the loaded map
+// returns the number of problems found
+int RunMesh(const Map& loaded)
+{
+    // row 0 is the bottom, the open cells are walled in on every side and the map edge counts as open
+    // the left wall of the room has its own tile, so the west walls of column 0 do not merge past it
+    const char* rows[] =
+    {
+        "####",
+        "2..#",
+        "####",
+    };
+
+    const uint8_t expectedMasks[3][4] =
+    {
+        { 10, 3, 3, 6 },
+        { 12, 0, 0, 12 },
+        { 9, 3, 3, 5 },
+    };
+
+    constexpr int expectedFaces = 24;
+    constexpr int expectedMerged = 12;
+
+    Map map;
+    map.ResizeRaw(4, 3);
+    for (int y = 0; y < 3; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            MapCell cell;
+            cell.State = rows[y][x] == '.' ? CellState::Empty : CellState::Solid;
+            cell.Tile = rows[y][x] == '2' ? 2 : 1;
+            map.SetCellRaw(x, y, cell);
+        }
+    }
+    map.UpdateOccupancy();
+
+    MapMeshBuilder builder;
+    builder.SetAtlasSize(64 * 10, 64);
+
+    int problems = 0;
+    MapMeshData cells;
+    std::vector<CellFace> faces;
+    for (int y = 0; y < 3; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            uint8_t mask = builder.BuildCell(map, x, y, cells);
+            if (mask != expectedMasks[y][x] || MapMeshBuilder::GetFaceMask(map, x, y) != expectedMasks[y][x])
+            {
+                printf("mesh       cell %d,%d has face mask %d, expected %d\n", x, y, int(mask), int(expectedMasks[y][x]));
+                problems++;
+            }
+
+            MapMeshBuilder::GetCellFaces(map, x, y, mask, faces);
+        }
+    }
+
+    MapMeshData merged;
+    builder.BuildMerged(faces, merged);
+
+    if (cells.FaceCount != expectedFaces || merged.FaceCount != expectedMerged)
+    {
+        printf("mesh       small map built %d faces and %d merged, expected %d and %d\n", cells.FaceCount, merged.FaceCount, expectedFaces, expectedMerged);
+        problems++;
+    }
+
+    if (cells.GetVertexCount() != cells.FaceCount * 4 || cells.GetTriangleCount() != cells.FaceCount * 2)
+    {
+        printf("mesh       small map has %d vertices and %d triangles for %d faces\n", cells.GetVertexCount(), cells.GetTriangleCount(), cells.FaceCount);
+        problems++;
+    }
+
+    problems += CheckMapMesh("mesh/small", map, builder);
+    problems += CheckMapMesh("mesh", loaded, builder);
+
+    return problems;
+}
+
+struct ReplayOptions
+{
+    const char* PathFile = nullptr;
+    int Frames = ScriptedPathFrames;
+    const char* Backend = "rays";
+    bool Coherent = false;
+    bool Json = false;
+};
+
+// the faces ViewRenderer::Draw would draw for the cells the raycaster found
+int CountFaces(const Map& map, const Raycaster& raycaster)
+{
+    int faces = 0;
+
+    for (const auto& pos : raycaster.GetHitCelList())
+    {
+        if (!map.GetCellSolid(pos.x, pos.y))
+        {
+            faces += 2;
+            continue;
+        }
+
+        faces += map.GetCellSolid(pos.x, pos.y + 1) ? 0 : 1;
+        faces += map.GetCellSolid(pos.x, pos.y - 1) ? 0 : 1;
+        faces += map.GetCellSolid(pos.x + 1, pos.y) ? 0 : 1;
+        faces += map.GetCellSolid(pos.x - 1, pos.y) ? 0 : 1;
+    }
+
+    for (const auto& block : raycaster.GetHitBlockList())
+    {
+        int sizeX = std::min(block.X + block.Size, map.GetWidth()) - block.X;
+        int sizeY = std::min(block.Y + block.Size, map.GetHeight()) - block.Y;
+        faces += 2 * sizeX * sizeY;
+    }
+
+    return faces;
+}
+
+int CountCells(const Map& map, const Raycaster& raycaster)
+{
+    int cells = int(raycaster.GetHitCelList().size());
+
+    for (const auto& block : raycaster.GetHitBlockList())
+        cells += (std::min(block.X + block.Size, map.GetWidth()) - block.X) * (std::min(block.Y + block.Size, map.GetHeight()) - block.Y);
+
+    return cells;
+}
+
+// nearest rank, the values are sorted
+double GetPercentile(const std::vector<double>& values, double percentile)
+{
+    size_t rank = size_t(ceil(percentile / 100.0 * values.size()));
+    return values[std::min(std::max<size_t>(rank, 1), values.size()) - 1];
+}
+
+void PrintJsonStats(const char* name, std::vector<double>& values, bool last)
+{
+    std::sort(values.begin(), values.end());
+
+    double total = 0;
+    for (double value : values)
+        total += value;
+
+    printf("    \"%s\": { \"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f }%s\n",
+        name, total / values.size(), GetPercentile(values, 50), GetPercentile(values, 95), GetPercentile(values, 99), values.back(), last ? "" : ",");
+}
+
+// cast every frame of the path once to warm up, then again timing each frame on its own
+bool RunReplay(Map& map, const char* mapFile, int renderWidth, float fovX, int threads, const ReplayOptions& options)
+{
+    CameraPath path;
+    if (options.PathFile)
+    {
+        if (!path.Read(options.PathFile))
+        {
+            printf("could not read camera path %s\n", options.PathFile);
+            return false;
+        }
+    }
+    else
+    {
+        path.BuildScripted(map, options.Frames);
+    }
+
+    if (path.GetFrameCount() == 0)
+    {
+        printf("no frames to replay\n");
+        return false;
+    }
+
+    Raycaster raycaster(&map, renderWidth, fovX);
+    raycaster.SetThreadCount(threads);
+    raycaster.SetCoherentMode(options.Coherent);
+
+    PotentiallyVisibleSet pvs;
+    if (strcmp(options.Backend, "beam") == 0)
+    {
+        raycaster.SetVisibilityBackend(VisibilityBackend::BeamSweep);
+    }
+    else if (strcmp(options.Backend, "pvs") == 0)
+    {
+        if (!pvs.Read(PotentiallyVisibleSet::GetSidecarPath(mapFile)) || !pvs.IsBakedFor(map))
+            pvs.Bake(map, threads);
+
+        raycaster.SetPVS(&pvs);
+        raycaster.SetVisibilityBackend(VisibilityBackend::PotentiallyVisible);
+    }
+    else if (strcmp(options.Backend, "sectors") == 0)
+    {
+        raycaster.SetVisibilityBackend(VisibilityBackend::SectorPortals);
+    }
+    else if (strcmp(options.Backend, "rays") != 0)
+    {
+        printf("unknown backend %s\n", options.Backend);
+        return false;
+    }
+
+    for (const auto& frame : path.GetFrames())
+        raycaster.StartFrame(frame);
+
+    size_t count = path.GetFrameCount();
+    std::vector<double> times;
+    std::vector<double> casts;
+    std::vector<double> cells;
+    std::vector<double> faces;
+    times.reserve(count);
+    casts.reserve(count);
+    cells.reserve(count);
+    faces.reserve(count);
+
+    for (const auto& frame : path.GetFrames())
+    {
+        auto start = std::chrono::steady_clock::now();
+        raycaster.StartFrame(frame);
+        times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e6);
+
+        casts.push_back(raycaster.GetCastCount());
+        cells.push_back(CountCells(map, raycaster));
+        faces.push_back(CountFaces(map, raycaster));
+    }
+
+    if (!options.Json)
+    {
+        std::vector<double> sorted = times;
+        std::sort(sorted.begin(), sorted.end());
+        printf("path       %d frames, %s, p50 %.1f us, p95 %.1f us, p99 %.1f us\n", int(count), options.Backend,
+            GetPercentile(sorted, 50), GetPercentile(sorted, 95), GetPercentile(sorted, 99));
+        return true;
+    }
+
+    printf("{\n");
+    printf("    \"map\": \"%s\",\n", mapFile);
+    printf("    \"width\": %d,\n", map.GetWidth());
+    printf("    \"height\": %d,\n", map.GetHeight());
+    printf("    \"renderWidth\": %d,\n", renderWidth);
+    printf("    \"threads\": %d,\n", threads);
+    printf("    \"backend\": \"%s\",\n", options.Backend);
+    printf("    \"coherent\": %s,\n", options.Coherent ? "true" : "false");
+    printf("    \"path\": \"%s\",\n", options.PathFile ? options.PathFile : "scripted");
+    printf("    \"frames\": %d,\n", int(count));
+    PrintJsonStats("frameMicroseconds", times, false);
+    PrintJsonStats("casts", casts, false);
+    PrintJsonStats("cells", cells, false);
+    PrintJsonStats("faces", faces, true);
+    printf("}\n");
+
+    return true;
+}
+
+// from each position, sit still, then pan slowly while a wall in view is touched now and then
+// coherent mode should cast next to nothing while idle, and every reused column should hit the same face as a full cast
+int RunCoherent(Map& map, Raycaster& reference, const std::vector<EntityLocation>& views, int renderWidth, float fovX)
+{
+    constexpr int idleFrames = 16;
+    constexpr int panFrames = 32;
+    constexpr float panStep = 0.5f * DEG2RAD;
+    constexpr int editInterval = 8;
+
+    Raycaster raycaster(&map, renderWidth, fovX);
+    raycaster.SetCoherentMode(true);
+
+    long long idleCasts = 0;
+    long long panCasts = 0;
+    long long panReused = 0;
+    long long fullCasts = 0;
+    long long referenceCells = 0;
+    long long missingCells = 0;
+    long long extraCells = 0;
+    long long frames = 0;
+    int wrongRays = 0;
+
+    for (size_t v = 0; v < views.size(); v += BenchFacings / 4)
+    {
+        EntityLocation view = views[v];
+        raycaster.StartFrame(view);
+
+        for (int i = 0; i < idleFrames; i++)
+        {
+            raycaster.StartFrame(view);
+            idleCasts += raycaster.GetCastCount();
+        }
+
+        for (int i = 0; i < panFrames; i++)
+        {
+            view.Facing = Vector2Rotate(view.Facing, panStep);
+
+            if (i % editInterval == editInterval - 1 && !raycaster.GetHitCelList().empty())
+            {
+                for (const auto& cell : raycaster.GetHitCelList())
+                {
+                    if (map.GetCellSolid(cell.x, cell.y))
+                    {
+                        map.SetCellTile(cell.x, cell.y, map.GetCellTile(cell.x, cell.y));
+                        break;
+                    }
+                }
+            }
+
+            raycaster.StartFrame(view);
+            reference.StartFrame(view);
+
+            panCasts += raycaster.GetCastCount();
+            panReused += raycaster.GetReusedCount();
+            fullCasts += reference.GetCastCount();
+            frames++;
+
+            // the reused distance comes from the face's plane rather than the walk, so only the hit is compared
+            for (size_t r = 0; r < reference.GetResults().size(); r++)
+            {
+                const RayResult& expected = reference.GetResults()[r];
+                const RayResult& ray = raycaster.GetResults()[r];
+                if (expected.HitCellIndex != ray.HitCellIndex || (expected.HitCellIndex >= 0 && expected.Normal != ray.Normal))
+                    wrongRays++;
+            }
+
+            for (const auto& cell : reference.GetHitCelList())
+            {
+                referenceCells++;
+                if (!raycaster.IsCellVis(cell.x, cell.y))
+                    missingCells++;
+            }
+
+            for (const auto& cell : raycaster.GetHitCelList())
+            {
+                if (!reference.IsCellVis(cell.x, cell.y))
+                    extraCells++;
+            }
+        }
+    }
+
+    int positions = int((views.size() + BenchFacings / 4 - 1) / (BenchFacings / 4));
+    printf("coherent   idle %.2f casts/frame, pan %.1f casts/frame (%.1f reused) vs %.1f full, %d rays differ, cells missing %.2f%% extra %.2f%%\n",
+        double(idleCasts) / (double(positions) * idleFrames), double(panCasts) / frames, double(panReused) / frames, double(fullCasts) / frames,
+        wrongRays, 100.0 * missingCells / referenceCells, 100.0 * extraCells / referenceCells);
+
+    return wrongRays;
+}
+
+struct BenchMode
+{
+    const char* Name;
+    int Threads;
+    bool Skipping;
+};
+
+int main(int argc, char* argv[])
+{
+    ReplayOptions replay;
+    std::vector<const char*> args;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--path") == 0 && i + 1 < argc)
+            replay.PathFile = argv[++i];
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            replay.Frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc)
+            replay.Backend = argv[++i];
+        else if (strcmp(argv[i], "--coherent") == 0)
+            replay.Coherent = true;
+        else if (strcmp(argv[i], "--json") == 0)
+            replay.Json = true;
+        else
+            args.push_back(argv[i]);
+    }
+
+    const char* mapFile = args.size() > 0 ? args[0] : "resources/maps/test.mres";
+    int renderWidth = args.size() > 1 ? atoi(args[1]) : 3840;
+    int threads = args.size() > 2 ? atoi(args[2]) : WorkerPool::GetHardwareThreadCount();
+
+    // a failed read leaves the default map, whose numbers would look like the real map's
+    MapSerializer serializer;
+    Map map;
+    if (!serializer.ReadResource(mapFile, map))
+    {
+        printf("could not read map %s\n", mapFile);
+        return 1;
+    }
+
+    // same horizontal FOV the game uses for a 16:9 screen
+    float fovX = 2.0f * atanf(tanf(BenchFOVY * DEG2RAD * 0.5f) * (16.0f / 9.0f)) * RAD2DEG;
+
+    if (replay.Json)
+        return RunReplay(map, mapFile, renderWidth, fovX, threads, replay) ? 0 : 1;
+
+    std::vector<EntityLocation> views = BuildViewList(map);
+    if (views.empty())
+    {
+        printf("no open cells in %s\n", mapFile);
+        return 1;
+    }
+
+    printf("map %s %dx%d, render width %d, %d views, %d threads\n", mapFile, map.GetWidth(), map.GetHeight(), renderWidth, int(views.size()), threads);
+
+    BenchMode modes[] =
+    {
+        { "scalar", 1, false },
+        { "threaded", threads, false },
+        { "skip", 1, true },
+        { "thr+skip", threads, true },
+    };
+
+    Raycaster reference(&map, renderWidth, fovX);
+
+    int totalMismatches = 0;
+    for (const BenchMode& mode : modes)
+    {
+        Raycaster raycaster(&map, renderWidth, fovX);
+        raycaster.SetThreadCount(mode.Threads);
+        raycaster.SetEmptySpaceSkipping(mode.Skipping);
+
+        int mismatches = CompareViews(map, reference, raycaster, views);
+
+        PrintResult(mode.Name, RunViews(raycaster, views));
+
+        if (mismatches != 0)
+        {
+            printf("%-10s results DIFFER from scalar in %d of %d views\n", mode.Name, mismatches, int(views.size()));
+            totalMismatches += mismatches;
+        }
+    }
+
+    totalMismatches += RunChunked(map, reference, views, renderWidth, fovX);
+    totalMismatches += RunViewDistance(map, reference, views, renderWidth, fovX, threads);
+
+    RunBeams(map, reference, views, renderWidth, fovX);
+    totalMismatches += RunPVS(map, reference, views, renderWidth, fovX, threads);
+    RunSectors(map, reference, views, renderWidth, fovX);
+
+    totalMismatches += RunMesh(map);
+
+    RunLineOfSight(map, reference, views, threads);
+    totalMismatches += RunCoherent(map, reference, views, renderWidth, fovX);
+
+    bool replayed = RunReplay(map, mapFile, renderWidth, fovX, threads, replay);
+
+    return totalMismatches == 0 && replayed ? 0 : 1;
+}